@@ -0,0 +1,293 @@
+/*******************************************
+	BattleRunner.cpp
+
+	Runs many independent battles across all
+	cores and aggregates their results
+********************************************/
+
+#include <thread>
+#include <map>
+#include <iomanip>
+#include <cfloat>
+using namespace std;
+
+#include "CTimer.h"
+#include "EntityManager.h"
+#include "ProjectileCollision.h"
+#include "ThinkScheduler.h"
+#include "Simulation.h"
+#include "BattleRunner.h"
+
+namespace gen
+{
+	// The current thread's world, from Simulation.cpp
+	extern thread_local CEntityManager EntityManager;
+	extern thread_local CProjectileCollision ProjectileCollision;
+	extern thread_local CThinkScheduler ThinkScheduler;
+
+
+	// Totals over all battles for one tank template
+	struct STemplateTotals
+	{
+		TUInt32  tanks;
+		TUInt32  killed;
+		TFloat32 killTime; // Sum of the kill times of the killed tanks
+		TUInt32  damageDealt;
+	};
+
+
+	//-----------------------------------------------------------------------------
+	// Constructors
+	//-----------------------------------------------------------------------------
+
+	// Constructor takes the level to run and the maximum number of fixed ticks per battle at the
+	// given tick rate
+	CBattleRunner::CBattleRunner(const string& levelFile, TUInt32 maxTicks, TFloat32 tickRate)
+	{
+		m_LevelFile = levelFile;
+		m_MaxTicks = maxTicks;
+		m_TickTime = 1.0f / tickRate;
+		m_NumThreads = 0;
+		m_FirstSeed = 0;
+		m_NextBattle = 0;
+		m_RunTime = 0.0f;
+	}
+
+
+	//-----------------------------------------------------------------------------
+	// Running
+	//-----------------------------------------------------------------------------
+
+	// Run the given number of battles with seeds counting up from the first seed, with up to the
+	// given number of battles running at once. Returns false if any battle's level could not be
+	// loaded
+	bool CBattleRunner::Run(TUInt32 numBattles, TUInt32 numThreads, TUInt32 firstSeed)
+	{
+		m_NumThreads = Max(1u, Min(numThreads, numBattles));
+		m_FirstSeed = firstSeed;
+		m_NextBattle = 0;
+		m_Results.assign(numBattles, SBattleResult());
+
+		CTimer timer;
+		vector<thread> workers;
+		for (TUInt32 worker = 0; worker < m_NumThreads; ++worker)
+		{
+			workers.push_back(thread(&CBattleRunner::RunWorker, this));
+		}
+		for (TUInt32 worker = 0; worker < m_NumThreads; ++worker)
+		{
+			workers[worker].join();
+		}
+		m_RunTime = timer.GetLapTime();
+
+		for (TUInt32 battle = 0; battle < numBattles; ++battle)
+		{
+			if (!m_Results[battle].loaded)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Run battles from the shared count until there are none left. Each battle is run on a new
+	// thread so it gets a world of its own - starting a thread costs little next to a battle
+	void CBattleRunner::RunWorker()
+	{
+		TUInt32 battle;
+		while ((battle = m_NextBattle++) < m_Results.size())
+		{
+			thread battleThread(&CBattleRunner::RunBattle, this, battle);
+			battleThread.join();
+		}
+	}
+
+	// Run the battle with the given index on the current thread's world
+	void CBattleRunner::RunBattle(TUInt32 battle)
+	{
+		SBattleResult& result = m_Results[battle];
+		result.seed = m_FirstSeed + battle;
+		result.winner = -1;
+		result.length = 0.0f;
+		result.ticks = 0;
+		result.tanks.clear();
+		result.loaded = SimulationSetup(m_LevelFile, result.seed);
+		if (!result.loaded)
+		{
+			SimulationShutdown();
+			return;
+		}
+
+		// The think budget is measured in real time, so how many tanks think each frame would
+		// depend on the machine's load. Lift it so a battle's result depends only on its seed
+		ThinkScheduler.SetBudget(FLT_MAX);
+
+		// Note the tanks at the start, they are destroyed during the battle
+		vector<TEntityUID> tankUIDs;
+		EntityManager.BeginEnumEntities("", "", "Tank");
+		CEntity* entity = EntityManager.EnumEntity();
+		while (entity != 0)
+		{
+			CTankEntity* tank = static_cast<CTankEntity*>(entity);
+			STankResult tankResult = { tank->Template()->GetName(), tank->GetTeam(), false, 0.0f, 0 };
+			result.tanks.push_back(tankResult);
+			tankUIDs.push_back(tank->GetUID());
+			entity = EntityManager.EnumEntity();
+		}
+		EntityManager.EndEnumEntities();
+
+		// Run until at most one team has tanks left, noting when each tank is killed
+		SendToAllTanks(Msg_Start);
+		vector<TUInt32> liveTanks;
+		while (result.ticks < m_MaxTicks)
+		{
+			SimulationStep(m_TickTime, kBattleFocus);
+			++result.ticks;
+			result.length += m_TickTime;
+
+			liveTanks.assign(liveTanks.size(), 0);
+			for (TUInt32 i = 0; i < tankUIDs.size(); ++i)
+			{
+				STankResult& tankResult = result.tanks[i];
+				if (!tankResult.killed)
+				{
+					CTankEntity* tank = static_cast<CTankEntity*>(EntityManager.GetEntity(tankUIDs[i]));
+					if (tank == 0 || tank->m_State == CTankEntity::Dead || tank->GetHP() <= 0)
+					{
+						tankResult.killed = true;
+						tankResult.killTime = result.length;
+						continue;
+					}
+					if (tankResult.team >= liveTanks.size())
+					{
+						liveTanks.resize(tankResult.team + 1, 0);
+					}
+					++liveTanks[tankResult.team];
+				}
+			}
+
+			TUInt32 teamsLeft = 0;
+			TInt32 lastTeam = -1;
+			for (TUInt32 team = 0; team < liveTanks.size(); ++team)
+			{
+				if (liveTanks[team] > 0)
+				{
+					++teamsLeft;
+					lastTeam = team;
+				}
+			}
+			if (teamsLeft <= 1)
+			{
+				result.winner = lastTeam;
+				break;
+			}
+		}
+
+		for (TUInt32 i = 0; i < tankUIDs.size(); ++i)
+		{
+			result.tanks[i].damageDealt = ProjectileCollision.GetDamageDealt(tankUIDs[i]);
+		}
+		SimulationShutdown();
+	}
+
+
+	//-----------------------------------------------------------------------------
+	// Report
+	//-----------------------------------------------------------------------------
+
+	// Write the win rates, time-to-kill and damage dealt per tank template for the last run
+	void CBattleRunner::WriteReport(ostream& out)
+	{
+		TUInt32 numBattles = static_cast<TUInt32>(m_Results.size());
+		if (numBattles == 0)
+		{
+			return;
+		}
+
+		// Gather the totals
+		vector<TUInt32> wins;
+		TUInt32 undecided = 0;
+		TUInt32 totalTicks = 0;
+		TFloat32 decidedLength = 0.0f;
+		map<string, STemplateTotals> templates;
+		for (TUInt32 battle = 0; battle < numBattles; ++battle)
+		{
+			const SBattleResult& result = m_Results[battle];
+			totalTicks += result.ticks;
+			if (result.winner < 0)
+			{
+				++undecided;
+			}
+			else
+			{
+				if (static_cast<TUInt32>(result.winner) >= wins.size())
+				{
+					wins.resize(result.winner + 1, 0);
+				}
+				++wins[result.winner];
+				decidedLength += result.length;
+			}
+
+			for (TUInt32 i = 0; i < result.tanks.size(); ++i)
+			{
+				const STankResult& tank = result.tanks[i];
+				STemplateTotals& totals = templates[tank.templateName];
+				++totals.tanks;
+				totals.damageDealt += tank.damageDealt;
+				if (tank.killed)
+				{
+					++totals.killed;
+					totals.killTime += tank.killTime;
+				}
+			}
+		}
+		TUInt32 decided = numBattles - undecided;
+
+		// Throughput
+		out << fixed << setprecision(2);
+		out << "Level:      " << m_LevelFile << ", up to " << m_MaxTicks << " ticks at " << 1.0f / m_TickTime << " ticks/s" << endl;
+		out << "Battles:    " << numBattles << " on " << m_NumThreads << " threads, seeds " << m_FirstSeed
+		    << " to " << m_FirstSeed + numBattles - 1 << endl;
+		out << "Run:        " << m_RunTime << "s, " << numBattles / m_RunTime << " battles/s, "
+		    << totalTicks / m_RunTime << " ticks/s" << endl << endl;
+
+		// Win rates
+		out << left << setw(16) << "Outcome" << right << setw(10) << "Battles" << setw(8) << "%" << endl;
+		for (TUInt32 team = 0; team < wins.size(); ++team)
+		{
+			out << left << "Team " << setw(11) << team << right << setw(10) << wins[team]
+			    << setw(8) << wins[team] * 100.0f / numBattles << endl;
+		}
+		out << left << setw(16) << "Undecided" << right << setw(10) << undecided
+		    << setw(8) << undecided * 100.0f / numBattles << endl;
+		if (decided > 0)
+		{
+			out << "Decided battles last " << decidedLength / decided << "s on average" << endl;
+		}
+		out << endl;
+
+		// Per template - time-to-kill is the mean battle time at which tanks of the template were
+		// killed, damage is the total dealt by the template's shells per battle
+		out << left << setw(20) << "Template" << right << setw(12) << "Tanks/battle" << setw(10) << "Killed %"
+		    << setw(10) << "TTK s" << setw(16) << "Damage/battle" << setw(14) << "Damage/tank" << endl;
+		for (map<string, STemplateTotals>::iterator it = templates.begin(); it != templates.end(); ++it)
+		{
+			const STemplateTotals& totals = it->second;
+			out << left << setw(20) << it->first << right
+			    << setw(12) << static_cast<TFloat32>(totals.tanks) / numBattles
+			    << setw(10) << totals.killed * 100.0f / totals.tanks;
+			if (totals.killed > 0)
+			{
+				out << setw(10) << totals.killTime / totals.killed;
+			}
+			else
+			{
+				out << setw(10) << "-";
+			}
+			out << setw(16) << static_cast<TFloat32>(totals.damageDealt) / numBattles
+			    << setw(14) << static_cast<TFloat32>(totals.damageDealt) / totals.tanks << endl;
+		}
+	}
+
+
+} // namespace gen
@@ -0,0 +1,121 @@
+/*******************************************
+	BattleRunner.h
+
+	Runs many independent battles across all
+	cores and aggregates their results
+********************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <ostream>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+
+namespace gen
+{
+
+	// Tanks think as often as they would with the game's camera at its starting position
+	const CVector3 kBattleFocus = CVector3(0.0f, 30.0f, -100.0f);
+
+
+	// The outcome for one tank in a battle
+	struct STankResult
+	{
+		string   templateName;
+		TUInt32  team;
+		bool     killed;
+		TFloat32 killTime;    // Battle time the tank was killed, if it was
+		TUInt32  damageDealt; // Total damage of the tank's shells that hit an enemy
+	};
+
+	// The outcome of one battle
+	struct SBattleResult
+	{
+		TUInt32  seed;
+		bool     loaded;  // False if the level could not be loaded
+		TInt32   winner;  // Team with the only tanks left, -1 if no team or more than one
+		TFloat32 length;  // Battle time until the battle was decided or ran out of ticks
+		TUInt32  ticks;
+		vector<STankResult> tanks;
+	};
+
+
+	// Monte Carlo battle runner. Runs a number of battles on the same level, each with its own
+	// random seed, spread over a set number of threads. All the simulation's world variables are
+	// thread_local, so each battle runs on a new thread of its own and starts with a newly
+	// constructed world with nothing shared with the other battles. A battle ends when at most one
+	// team has tanks left or after a maximum number of ticks
+	class CBattleRunner
+	{
+		/////////////////////////////////////
+		//	Constructors/Destructors
+	public:
+		// Constructor takes the level to run and the maximum number of fixed ticks per battle at
+		// the given tick rate
+		CBattleRunner(const string& levelFile, TUInt32 maxTicks, TFloat32 tickRate);
+
+		// No destructor needed
+
+	private:
+		// Disallow use of copy constructor and assignment operator (private and not defined)
+		CBattleRunner(const CBattleRunner&);
+		CBattleRunner& operator=(const CBattleRunner&);
+
+
+		/////////////////////////////////////
+		//	Public interface
+	public:
+
+		// Run the given number of battles with seeds counting up from the first seed, with up to
+		// the given number of battles running at once. Returns false if any battle's level could
+		// not be loaded
+		bool Run(TUInt32 numBattles, TUInt32 numThreads, TUInt32 firstSeed);
+
+		// Return the results of the last run, in seed order
+		const vector<SBattleResult>& GetResults()
+		{
+			return m_Results;
+		}
+
+		// Return the real time the last run took in seconds
+		TFloat32 GetRunTime()
+		{
+			return m_RunTime;
+		}
+
+		// Write the win rates, time-to-kill and damage dealt per tank template for the last run
+		void WriteReport(ostream& out);
+
+
+		/////////////////////////////////////
+		//	Private interface
+	private:
+
+		// Run battles from the shared count until there are none left. Each battle is run on a new
+		// thread so it gets a world of its own
+		void RunWorker();
+
+		// Run the battle with the given index on the current thread's world
+		void RunBattle(TUInt32 battle);
+
+
+		// Settings for every battle
+		string   m_LevelFile;
+		TUInt32  m_MaxTicks;
+		TFloat32 m_TickTime;
+
+		// Current run - next battle index to hand out and one result per battle
+		TUInt32         m_NumThreads;
+		TUInt32         m_FirstSeed;
+		atomic<TUInt32> m_NextBattle;
+		vector<SBattleResult> m_Results;
+		TFloat32        m_RunTime;
+	};
+
+
+} // namespace gen
@@ -0,0 +1,737 @@
+/*******************************************
+	BattleSim.cpp
+
+	Headless battle simulator - runs the tank
+	battle with no window or D3D device and
+	reports the simulation throughput
+********************************************/
+
+// Usage: BattleSim [ticks] [tick rate] [level file] [battles] [threads] [seed] [replay file]
+//        BattleSim -replay <replay file> [from tick] [to tick]
+//        BattleSim -messenger [messages per frame] [frames]
+//        BattleSim -soak [frames]
+//        BattleSim -navgrid [searches]
+// Loads the level (Entities.xml by default), starts all the tanks and runs the given number of
+// fixed steps (3600 by default) as fast as possible at the given tick rate (60 by default). Reports
+// ticks per second, the time spent in each phase of the simulation and in each tank state and part
+// of the tank behaviour (from the tank profiler), and which team won. Meshes are loaded by the
+// null mesh (NullMesh.cpp) so only their hierarchy and bounds are kept
+// If more than one battle is asked for, the battles are run by the battle runner instead, on the
+// given number of threads (one per core by default) with seeds counting up from the given seed (1
+// by default). Each stops at the given number of ticks or when it is decided. Reports win rates,
+// time-to-kill and damage dealt per tank template
+// A single battle is recorded if a replay file is given. With -replay, a recorded battle (from the
+// game or the simulator) is run again with the same inputs. The steps before the from tick are run
+// untimed, then those up to the to tick (the end by default) are timed and the phase times and
+// tank profile reported, so the same stretch of a battle can be profiled before and after a
+// change. Keyframes whose checksum doesn't match the replayed world are reported, showing the
+// battle has changed
+// With -messenger, the messenger's send queue is stress tested and benchmarked with 1, 4 and 16
+// threads sending messages at once, the given number per frame (100000 by default) shared between
+// them, for the given number of frames (20 by default). Every message must be delivered exactly
+// once with each sender's messages in the order they were sent. Reports the messages sent per second
+// With -soak, the messenger is run for the given number of frames (a million by default) with one
+// recipient dying and another created every frame and messages sent to both live and dead
+// recipients. Fails if the mailboxes, node pool or timed messages grow after a warm-up, if
+// messages other than those to dead recipients go missing or if timed messages arrive late
+// With -navgrid, path finding is benchmarked on a 512x512 grid with random blocked cells from a
+// fixed seed. The given number of long paths (1000 by default) are searched for with no per-frame
+// limit and then asked for again from the cache. Reports requests per millisecond for each
+// StressTest.xml is a level with a thousand generated tanks (a TankLoop element, see ParseLevel.cpp)
+// for profiling large battles, e.g. BattleSim 600 60 StressTest.xml. StressTest10k.xml and
+// StressTest50k.xml have ten and fifty thousand tanks over larger areas, with the same number of
+// tanks and buildings for each unit of area, to see how the time per step grows with battle size
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "CTimer.h"
+#include "CRandom.h"
+#include "EntityManager.h"
+#include "NavGrid.h"
+#include "TankProfiler.h"
+#include "Simulation.h"
+#include "BattleRunner.h"
+#include "Replay.h"
+
+namespace gen
+{
+	// Entity manager holding the tanks
+	extern thread_local CEntityManager EntityManager;
+
+	// Tank behaviour timings
+	extern thread_local CTankProfiler TankProfiler;
+
+
+	// Tanks on one team, and those still alive with their total HP
+	struct STeamResult
+	{
+		TUInt32 tanks;
+		TUInt32 liveTanks;
+		TInt32  liveHP;
+	};
+
+	// Count the tanks on each team, and those still alive with their HP
+	void CountTeams(vector<STeamResult>& teams)
+	{
+		for (TUInt32 team = 0; team < teams.size(); ++team)
+		{
+			teams[team].tanks = 0;
+			teams[team].liveTanks = 0;
+			teams[team].liveHP = 0;
+		}
+
+		EntityManager.BeginEnumEntities("", "", "Tank");
+		CEntity* entity = EntityManager.EnumEntity();
+		while (entity != 0)
+		{
+			CTankEntity* tank = static_cast<CTankEntity*>(entity);
+			TUInt32 team = tank->GetTeam();
+			if (team >= teams.size())
+			{
+				STeamResult noTanks = { 0, 0, 0 };
+				teams.resize(team + 1, noTanks);
+			}
+			++teams[team].tanks;
+			if (tank->m_State != CTankEntity::Dead && tank->GetHP() > 0)
+			{
+				++teams[team].liveTanks;
+				teams[team].liveHP += tank->GetHP();
+			}
+			entity = EntityManager.EnumEntity();
+		}
+		EntityManager.EndEnumEntities();
+	}
+
+	// Write the time spent in each phase over the given number of ticks
+	void PrintPhaseTimes(const SSimPhaseTimes& phaseTimes, TUInt32 numTicks)
+	{
+		TFloat32 phaseTotal = 0.0f;
+		for (TUInt32 phase = 0; phase < NumSimPhases; ++phase)
+		{
+			phaseTotal += phaseTimes.time[phase];
+		}
+		cout << left << setw(12) << "Phase" << right << setw(12) << "Total ms" << setw(12) << "us/tick" << setw(8) << "%" << endl;
+		for (TUInt32 phase = 0; phase < NumSimPhases; ++phase)
+		{
+			TFloat32 time = phaseTimes.time[phase];
+			cout << left << setw(12) << GetSimPhaseName(static_cast<ESimPhase>(phase)) << right
+			     << setw(12) << time * 1000.0f << setw(12) << time * 1000000.0f / numTicks
+			     << setw(8) << (phaseTotal > 0.0f ? time * 100.0f / phaseTotal : 0.0f) << endl;
+		}
+		cout << endl;
+	}
+
+	// Write the tank behaviour time in each profiler zone since the given profiler totals were
+	// taken, over the given number of ticks. State times include the parts that ran in them
+	void PrintTankProfile(const STankProfileStats& startTotals, TUInt32 numTicks)
+	{
+		const STankProfileStats& totals = TankProfiler.GetTotals();
+		cout << left << setw(12) << "Tank zone" << right << setw(12) << "Calls/tick" << setw(12) << "us/tick"
+		     << setw(12) << "us/call" << endl;
+		for (TUInt32 zone = 0; zone < NumTankZones; ++zone)
+		{
+			TUInt32 calls = totals.zones[zone].calls - startTotals.zones[zone].calls;
+			TFloat32 time = totals.zones[zone].time - startTotals.zones[zone].time;
+			cout << left << setw(12) << CTankProfiler::GetZoneName(static_cast<ETankProfileZone>(zone)) << right
+			     << setw(12) << static_cast<TFloat32>(calls) / numTicks << setw(12) << time * 1000000.0f / numTicks
+			     << setw(12) << (calls > 0 ? time * 1000000.0f / calls : 0.0f) << endl;
+		}
+		cout << endl;
+	}
+
+	// Replay a recorded battle, timing the steps from one tick to another
+	int ReplayBattle(const string& replayFile, TUInt32 fromTick, TUInt32 toTick)
+	{
+		CReplayPlayer player;
+		if (!player.Open(replayFile))
+		{
+			cout << "Failed to open replay " << replayFile << endl;
+			return 1;
+		}
+		toTick = Min(toTick, player.GetNumTicks());
+		if (fromTick >= toTick)
+		{
+			cout << "Replay " << replayFile << " has " << player.GetNumTicks() << " ticks" << endl;
+			return 1;
+		}
+		if (!player.Start())
+		{
+			cout << "Failed to load level " << player.GetLevelFile() << endl;
+			return 1;
+		}
+
+		CTimer timer;
+		player.SeekTo(fromTick);
+		TFloat32 seekTime = timer.GetLapTime();
+
+		SSimPhaseTimes phaseTimes;
+		for (TUInt32 phase = 0; phase < NumSimPhases; ++phase)
+		{
+			phaseTimes.time[phase] = 0.0f;
+		}
+		STankProfileStats startProfile = TankProfiler.GetTotals();
+		timer.GetLapTime();
+		while (player.GetTick() < toTick)
+		{
+			if (!player.Step(&phaseTimes))
+			{
+				break;
+			}
+		}
+		TFloat32 runTime = timer.GetLapTime();
+		TUInt32 numTicks = player.GetTick() - fromTick;
+
+		cout << fixed << setprecision(2);
+		cout << "Replay:     " << replayFile << ", " << player.GetNumTicks() << " ticks, "
+		     << player.GetKeyframes().size() << " keyframes" << endl;
+		cout << "Level:      " << player.GetLevelFile() << ", seed " << player.GetSeed() << endl;
+		cout << "Seek:       " << fromTick << " ticks in " << seekTime * 1000.0f << "ms" << endl;
+		cout << "Run:        ticks " << fromTick << " to " << player.GetTick() << " in " << runTime * 1000.0f << "ms, "
+		     << numTicks / runTime << " ticks/s" << endl << endl;
+		PrintPhaseTimes(phaseTimes, numTicks);
+		PrintTankProfile(startProfile, numTicks);
+
+		if (player.GetNumMismatches() == 0)
+		{
+			cout << "Checksums:  All keyframes match" << endl;
+		}
+		else
+		{
+			cout << "Checksums:  " << player.GetNumMismatches() << " keyframes differ, first at tick "
+			     << player.GetFirstMismatchTick() << endl;
+		}
+
+		SimulationShutdown();
+		return player.GetNumMismatches() == 0 ? 0 : 2;
+	}
+
+
+	// Send a producer's share of each frame's messages to the given messenger. Messages go to the
+	// recipients in turn, numbered in the damage payload so their order can be checked. Alternate
+	// groups are sent one at a time and as a batch. Waits for the main thread to start each frame
+	void SendTestMessages(CMessenger* messenger, TEntityUID sender, TUInt32 numMessages, TUInt32 numRecipients,
+	                      TUInt32 numFrames, atomic<TUInt32>* startedFrames, atomic<TUInt32>* finishedSenders)
+	{
+		const TUInt32 kGroupSize = 16;
+		TEntityUID to[kGroupSize];
+		SMessage msgs[kGroupSize];
+		for (TUInt32 frame = 0; frame < numFrames; ++frame)
+		{
+			while (startedFrames->load(memory_order_acquire) <= frame)
+			{
+				this_thread::yield();
+			}
+
+			for (TUInt32 message = 0; message < numMessages; message += kGroupSize)
+			{
+				TUInt32 groupSize = Min(kGroupSize, numMessages - message);
+				for (TUInt32 i = 0; i < groupSize; ++i)
+				{
+					SDamagePayload number = { static_cast<TInt32>(message + i) };
+					to[i] = 1 + (message + i) % numRecipients;
+					msgs[i].type = Msg_Go;
+					msgs[i].from = sender;
+					msgs[i].SetPayload(number);
+				}
+				if ((message / kGroupSize) % 2 == 0)
+				{
+					for (TUInt32 i = 0; i < groupSize; ++i)
+					{
+						messenger->SendMessage(to[i], msgs[i]);
+					}
+				}
+				else
+				{
+					messenger->SendMessageBatch(to, msgs, groupSize);
+				}
+			}
+			finishedSenders->fetch_add(1, memory_order_release);
+		}
+	}
+
+	// Stress test and benchmark the messenger's send queue with 1, 4 and 16 sending threads
+	int TestMessenger(TUInt32 messagesPerFrame, TUInt32 numFrames)
+	{
+		const TUInt32 kNumRecipients = 64;
+		const TUInt32 kFirstSender = 1000;
+		const TUInt32 kProducerCounts[] = { 1, 4, 16 };
+
+		cout << fixed << setprecision(2);
+		cout << left << setw(12) << "Producers" << right << setw(12) << "Messages" << setw(12) << "Send ms"
+		     << setw(12) << "Deliver ms" << setw(12) << "M msgs/s" << setw(10) << "Errors" << endl;
+		TUInt32 totalErrors = 0;
+		for (TUInt32 count = 0; count < sizeof(kProducerCounts) / sizeof(kProducerCounts[0]); ++count)
+		{
+			TUInt32 numProducers = kProducerCounts[count];
+			TUInt32 numMessages = Max(messagesPerFrame / numProducers, 1u);
+
+			// A messenger of its own, reached by the producers through a pointer as a world's helper
+			// threads reach it through GetWorldMessenger
+			CMessenger* messenger = new CMessenger;
+			for (TUInt32 recipient = 1; recipient <= kNumRecipients; ++recipient)
+			{
+				messenger->OpenMailbox(recipient);
+			}
+
+			atomic<TUInt32> startedFrames(0);
+			atomic<TUInt32> finishedSenders(0);
+			vector<thread> producers;
+			for (TUInt32 producer = 0; producer < numProducers; ++producer)
+			{
+				producers.push_back(thread(SendTestMessages, messenger, kFirstSender + producer, numMessages,
+				                           kNumRecipients, numFrames, &startedFrames, &finishedSenders));
+			}
+
+			CTimer timer;
+			TFloat32 sendTime = 0.0f;
+			TFloat32 deliverTime = 0.0f;
+			TUInt32 errors = 0;
+			vector<TInt32> nextNumber(numProducers);
+			for (TUInt32 frame = 0; frame < numFrames; ++frame)
+			{
+				// Let the producers send the frame's messages and wait for them all to finish
+				timer.GetLapTime();
+				startedFrames.store(frame + 1, memory_order_release);
+				while (finishedSenders.load(memory_order_acquire) < (frame + 1) * numProducers)
+				{
+					this_thread::yield();
+				}
+				sendTime += timer.GetLapTime();
+
+				messenger->Update(0.0f);
+				deliverTime += timer.GetLapTime();
+
+				// Each recipient must have every sender's messages for it, in the order sent
+				TUInt32 numDelivered = 0;
+				for (TUInt32 recipient = 1; recipient <= kNumRecipients; ++recipient)
+				{
+					for (TUInt32 producer = 0; producer < numProducers; ++producer)
+					{
+						nextNumber[producer] = recipient - 1;
+					}
+					TUInt32 numFetched;
+					const SMessage* msgs = messenger->FetchAll(recipient, &numFetched);
+					for (TUInt32 message = 0; message < numFetched; ++message)
+					{
+						TUInt32 producer = msgs[message].from - kFirstSender;
+						if (producer >= numProducers ||
+						    msgs[message].GetPayload<SDamagePayload>().damage != nextNumber[producer])
+						{
+							++errors;
+							continue;
+						}
+						nextNumber[producer] += kNumRecipients;
+					}
+					for (TUInt32 producer = 0; producer < numProducers; ++producer)
+					{
+						if (nextNumber[producer] < static_cast<TInt32>(numMessages))
+						{
+							++errors;
+						}
+					}
+					numDelivered += numFetched;
+				}
+				if (numDelivered != numMessages * numProducers)
+				{
+					++errors;
+				}
+			}
+			for (TUInt32 producer = 0; producer < numProducers; ++producer)
+			{
+				producers[producer].join();
+			}
+			delete messenger;
+
+			TUInt32 totalMessages = numMessages * numProducers * numFrames;
+			cout << left << setw(12) << numProducers << right << setw(12) << totalMessages
+			     << setw(12) << sendTime * 1000.0f << setw(12) << deliverTime * 1000.0f
+			     << setw(12) << (sendTime > 0.0f ? totalMessages / sendTime / 1000000.0f : 0.0f)
+			     << setw(10) << errors << endl;
+			totalErrors += errors;
+		}
+
+		cout << endl << (totalErrors == 0 ? "All messages delivered in order" : "Messages lost or out of order") << endl;
+		return totalErrors == 0 ? 0 : 2;
+	}
+
+	// Soak test the messenger for the given number of frames with recipients dying all the time. Each
+	// frame the oldest mailbox is closed and a new one opened, messages are sent to live recipients,
+	// to the one about to close and to recently closed ones, and a timed message is sent. After a
+	// warm-up the mailbox count and node pool must stay the same, exactly the messages to closed
+	// mailboxes must be rejected and timed messages must keep arriving on time
+	int SoakTestMessenger(TUInt32 numFrames)
+	{
+		const TUInt32  kNumLive = 256;         // Open mailboxes
+		const TUInt32  kNumDead = 16;          // Recently closed mailboxes still sent to
+		const TUInt32  kMessagesPerFrame = 512;
+		const TUInt32  kWarmUpFrames = 1000;
+		const TFloat32 kFrameTime = 1.0f / 60.0f;
+		const TFloat32 kTimerDelay = 0.5f;     // 30 frames
+		const TInt32   kMinTimerFrames = 29;   // Frames after the one it was sent in that a timed message
+		const TInt32   kMaxTimerFrames = 30;   // may arrive, ticks and frames don't line up exactly
+
+		CMessenger* messenger = new CMessenger;
+		vector<TEntityUID> live(kNumLive);
+		vector<TEntityUID> dead(kNumDead, 0);
+		TEntityUID nextUID = 1;
+		for (TUInt32 recipient = 0; recipient < kNumLive; ++recipient)
+		{
+			live[recipient] = nextUID++;
+			messenger->OpenMailbox(live[recipient]);
+		}
+
+		TUInt32 expectedRejected = 0;
+		TUInt32 warmPoolBlocks = 0;
+		TUInt32 peakTimedPending = 0;
+		TUInt32 errors = 0;
+		TUInt32 firstErrorFrame = 0;
+		CTimer timer;
+		SMessage msg;
+		msg.from = SystemUID;
+		cout << left << setw(12) << "Frame" << right << setw(12) << "Mailboxes" << setw(12) << "Pool blocks"
+		     << setw(12) << "Timed" << setw(12) << "Rejected" << setw(10) << "Errors" << endl;
+		for (TUInt32 frame = 0; frame < numFrames; ++frame)
+		{
+			// The oldest mailbox is closed after this frame's sends, so its messages are rejected
+			TUInt32 oldest = frame % kNumLive;
+			TUInt32 numExpected = 0;
+			msg.type = Msg_Go;
+			for (TUInt32 message = 0; message < kMessagesPerFrame; ++message)
+			{
+				TUInt32 recipient = (frame + message) % kNumLive;
+				messenger->SendMessage(live[recipient], msg);
+				if (recipient == oldest)
+				{
+					++expectedRejected;
+				}
+				else
+				{
+					++numExpected;
+				}
+			}
+			for (TUInt32 recipient = 0; recipient < kNumDead; ++recipient)
+			{
+				if (dead[recipient] != 0)
+				{
+					messenger->SendMessage(dead[recipient], msg);
+					++expectedRejected;
+				}
+			}
+
+			// A timed message numbered with the frame it was sent in, to a recipient that will still be
+			// open when it arrives
+			SDamagePayload sentFrame = { static_cast<TInt32>(frame) };
+			msg.type = Msg_Expire;
+			msg.SetPayload(sentFrame);
+			messenger->SendMessageAfter(live[(oldest + kNumLive / 2) % kNumLive], msg, kTimerDelay);
+
+			dead[frame % kNumDead] = live[oldest];
+			messenger->CloseMailbox(live[oldest]);
+			live[oldest] = nextUID++;
+			messenger->OpenMailbox(live[oldest]);
+
+			messenger->Update(kFrameTime);
+
+			TUInt32 numFetched = 0;
+			TUInt32 frameErrors = 0;
+			for (TUInt32 recipient = 0; recipient < kNumLive; ++recipient)
+			{
+				TUInt32 numMessages;
+				const SMessage* msgs = messenger->FetchAll(live[recipient], &numMessages);
+				for (TUInt32 message = 0; message < numMessages; ++message)
+				{
+					if (msgs[message].type == Msg_Go)
+					{
+						++numFetched;
+						continue;
+					}
+					TInt32 delay = static_cast<TInt32>(frame) - msgs[message].GetPayload<SDamagePayload>().damage;
+					if (delay < kMinTimerFrames || delay > kMaxTimerFrames)
+					{
+						++frameErrors;
+					}
+				}
+			}
+			if (numFetched != numExpected)
+			{
+				++frameErrors;
+			}
+
+			// Once warmed up nothing may grow
+			const SMessengerStats& stats = messenger->GetStats();
+			if (frame == kWarmUpFrames)
+			{
+				warmPoolBlocks = messenger->GetNumPoolBlocks();
+			}
+			if (frame >= kWarmUpFrames)
+			{
+				if (stats.numMailboxes != kNumLive || messenger->GetNumPoolBlocks() > warmPoolBlocks ||
+				    stats.timedPending > peakTimedPending)
+				{
+					++frameErrors;
+				}
+			}
+			else
+			{
+				peakTimedPending = Max(peakTimedPending, stats.timedPending);
+			}
+			if (messenger->GetNumRejected() != expectedRejected)
+			{
+				++frameErrors;
+				expectedRejected = messenger->GetNumRejected(); // Report each mismatch once
+			}
+
+			if (frameErrors > 0 && errors == 0)
+			{
+				firstErrorFrame = frame;
+			}
+			errors += frameErrors;
+			if ((frame + 1) % Max(numFrames / 10, 1u) == 0 || frame + 1 == numFrames)
+			{
+				cout << left << setw(12) << frame + 1 << right << setw(12) << stats.numMailboxes
+				     << setw(12) << messenger->GetNumPoolBlocks() << setw(12) << stats.timedPending
+				     << setw(12) << messenger->GetNumRejected() << setw(10) << errors << endl;
+			}
+		}
+		TFloat32 runTime = timer.GetLapTime();
+		delete messenger;
+
+		cout << endl << numFrames << " frames in " << fixed << setprecision(2) << runTime << "s" << endl;
+		if (errors == 0)
+		{
+			cout << "Messenger stayed flat" << endl;
+		}
+		else
+		{
+			cout << errors << " errors, first at frame " << firstErrorFrame << endl;
+		}
+		return errors == 0 ? 0 : 2;
+	}
+
+	// Benchmark path finding on a 512x512 grid with a fifth of its cells blocked at random. The given
+	// number of requests between open cells at least half the grid apart are searched with no
+	// per-frame limit, then the same requests are made again and answered from the path cache
+	int TestNavGrid(TUInt32 numSearches)
+	{
+		const TInt32   kGridSize = 512;
+		const TFloat32 kBlockedFraction = 0.2f;
+		const TUInt64  kSeed = 1;
+
+		// Every search is allowed in one frame and every path kept
+		CNavGrid navGrid(numSearches, numSearches);
+		navGrid.Create(CVector3(0.0f, 0.0f, 0.0f), CVector3(kGridSize - 1.0f, 0.0f, kGridSize - 1.0f), 1.0f);
+		CRandom random(kSeed);
+		vector<TUInt32> blocked;
+		for (TUInt32 cell = 0; cell < static_cast<TUInt32>(kGridSize * kGridSize); ++cell)
+		{
+			if (random.Random(0.0f, 1.0f) < kBlockedFraction)
+			{
+				blocked.push_back(cell);
+			}
+		}
+		navGrid.BlockCells(blocked);
+
+		vector<CVector3> starts;
+		vector<CVector3> goals;
+		while (starts.size() < numSearches)
+		{
+			CVector3 start(random.Random(0, kGridSize - 1) + 0.5f, 0.0f, random.Random(0, kGridSize - 1) + 0.5f);
+			CVector3 goal(random.Random(0, kGridSize - 1) + 0.5f, 0.0f, random.Random(0, kGridSize - 1) + 0.5f);
+			if (!navGrid.IsBlocked(start) && !navGrid.IsBlocked(goal) && (goal - start).Length() >= kGridSize / 2)
+			{
+				starts.push_back(start);
+				goals.push_back(goal);
+			}
+		}
+
+		// First pass searches every request, second finds them all in the cache
+		TFloat32 passTimes[2];
+		TUInt32 numFound[2] = { 0, 0 };
+		vector<CVector3> waypoints;
+		CTimer timer;
+		for (TUInt32 pass = 0; pass < 2; ++pass)
+		{
+			navGrid.Update();
+			timer.GetLapTime();
+			for (TUInt32 request = 0; request < numSearches; ++request)
+			{
+				if (navGrid.FindPath(starts[request], goals[request], waypoints) == Path_Found)
+				{
+					++numFound[pass];
+				}
+			}
+			passTimes[pass] = timer.GetLapTime();
+		}
+
+		cout << fixed << setprecision(2);
+		cout << "Grid:       " << navGrid.GetNumCellsX() << "x" << navGrid.GetNumCellsZ() << ", "
+		     << blocked.size() << " cells blocked, seed " << kSeed << endl;
+		cout << "Requests:   " << numSearches << " at least " << kGridSize / 2 << " cells apart, "
+		     << numFound[0] << " with a route" << endl;
+		cout << "Searched:   " << navGrid.GetSearches() << " searches in " << passTimes[0] * 1000.0f << "ms, "
+		     << numSearches / (passTimes[0] * 1000.0f) << " requests/ms" << endl;
+		cout << "Cached:     " << navGrid.GetCacheHits() << " cache hits in " << passTimes[1] * 1000.0f << "ms, "
+		     << numSearches / (passTimes[1] * 1000.0f) << " requests/ms" << endl;
+		return numFound[1] == numFound[0] ? 0 : 2;
+	}
+
+} // namespace gen
+
+using namespace gen;
+
+
+int main(int argc, char* argv[])
+{
+	if (argc > 2 && string(argv[1]) == "-replay")
+	{
+		TUInt32 fromTick = (argc > 3) ? atoi(argv[3]) : 0;
+		TUInt32 toTick = (argc > 4) ? atoi(argv[4]) : 0xffffffff;
+		return ReplayBattle(argv[2], fromTick, toTick);
+	}
+	if (argc > 1 && string(argv[1]) == "-messenger")
+	{
+		TUInt32 messagesPerFrame = (argc > 2) ? atoi(argv[2]) : 100000;
+		TUInt32 numFrames = (argc > 3) ? atoi(argv[3]) : 20;
+		return TestMessenger(Max(messagesPerFrame, 1u), Max(numFrames, 1u));
+	}
+	if (argc > 1 && string(argv[1]) == "-soak")
+	{
+		TUInt32 numFrames = (argc > 2) ? atoi(argv[2]) : 1000000;
+		return SoakTestMessenger(Max(numFrames, 1u));
+	}
+	if (argc > 1 && string(argv[1]) == "-navgrid")
+	{
+		TUInt32 numSearches = (argc > 2) ? atoi(argv[2]) : 1000;
+		return TestNavGrid(Max(numSearches, 1u));
+	}
+
+	TUInt32 numTicks = (argc > 1) ? atoi(argv[1]) : 3600;
+	TFloat32 tickRate = (argc > 2) ? static_cast<TFloat32>(atof(argv[2])) : 60.0f;
+	string levelFile = (argc > 3) ? argv[3] : "Entities.xml";
+	TUInt32 numBattles = (argc > 4) ? atoi(argv[4]) : 1;
+	TUInt32 numThreads = (argc > 5) ? atoi(argv[5]) : thread::hardware_concurrency();
+	TUInt32 seed = (argc > 6) ? atoi(argv[6]) : 1;
+	string replayFile = (argc > 7) ? argv[7] : "";
+	if (numTicks == 0 || tickRate <= 0.0f || numBattles == 0)
+	{
+		cout << "Usage: BattleSim [ticks] [tick rate] [level file] [battles] [threads] [seed] [replay file]" << endl;
+		cout << "       BattleSim -replay <replay file> [from tick] [to tick]" << endl;
+		cout << "       BattleSim -messenger [messages per frame] [frames]" << endl;
+		return 1;
+	}
+	TFloat32 tickTime = 1.0f / tickRate;
+
+	// Many battles - run them across the cores and report the totals
+	if (numBattles > 1)
+	{
+		CBattleRunner runner(levelFile, numTicks, tickRate);
+		if (!runner.Run(numBattles, Max(numThreads, 1u), seed))
+		{
+			cout << "Failed to load level " << levelFile << endl;
+			return 1;
+		}
+		runner.WriteReport(cout);
+		return 0;
+	}
+
+	CTimer timer;
+	if (!SimulationSetup(levelFile, seed))
+	{
+		cout << "Failed to load level " << levelFile << endl;
+		return 1;
+	}
+	TFloat32 setupTime = timer.GetLapTime();
+
+	CReplayRecorder recorder;
+	if (!replayFile.empty())
+	{
+		if (!recorder.Open(replayFile, levelFile, seed))
+		{
+			cout << "Failed to create replay " << replayFile << endl;
+			return 1;
+		}
+		SimulationRecord(&recorder);
+	}
+
+	// Note the teams at the start, tanks are destroyed during the battle
+	vector<STeamResult> teams;
+	CountTeams(teams);
+	vector<TUInt32> startTanks(teams.size());
+	for (TUInt32 team = 0; team < teams.size(); ++team)
+	{
+		startTanks[team] = teams[team].tanks;
+	}
+
+	// Run the battle, starting the tanks with a command so it is recorded
+	SSimCommand start = { Command_Start, 0, CVector3::kOrigin };
+	SimulationCommand(start);
+	SSimPhaseTimes phaseTimes;
+	for (TUInt32 phase = 0; phase < NumSimPhases; ++phase)
+	{
+		phaseTimes.time[phase] = 0.0f;
+	}
+	STankProfileStats startProfile = TankProfiler.GetTotals();
+	timer.GetLapTime();
+	for (TUInt32 tick = 0; tick < numTicks; ++tick)
+	{
+		SimulationStep(tickTime, kBattleFocus, &phaseTimes);
+	}
+	TFloat32 runTime = timer.GetLapTime();
+
+	// Throughput
+	cout << fixed << setprecision(2);
+	cout << "Level:      " << levelFile << endl;
+	cout << "Ticks:      " << numTicks << " at " << tickRate << " ticks/s (" << numTicks * tickTime << "s of battle)" << endl;
+	cout << "Setup:      " << setupTime * 1000.0f << "ms" << endl;
+	cout << "Run:        " << runTime * 1000.0f << "ms, " << numTicks / runTime << " ticks/s, "
+	     << numTicks * tickTime / runTime << "x real time" << endl << endl;
+
+	// Time in each phase and tank behaviour zone
+	PrintPhaseTimes(phaseTimes, numTicks);
+	PrintTankProfile(startProfile, numTicks);
+
+	// Outcome - the battle is won if only one team has tanks left
+	CountTeams(teams);
+	TUInt32 teamsLeft = 0;
+	TUInt32 winner = 0;
+	for (TUInt32 team = 0; team < teams.size(); ++team)
+	{
+		if (startTanks[team] == 0)
+		{
+			continue;
+		}
+		cout << "Team " << team << ": " << teams[team].liveTanks << " of " << startTanks[team]
+		     << " tanks left, " << teams[team].liveHP << " HP" << endl;
+		if (teams[team].liveTanks > 0)
+		{
+			++teamsLeft;
+			winner = team;
+		}
+	}
+	if (teamsLeft == 1)
+	{
+		cout << "Outcome:    Team " << winner << " wins" << endl;
+	}
+	else if (teamsLeft == 0)
+	{
+		cout << "Outcome:    No tanks left" << endl;
+	}
+	else
+	{
+		cout << "Outcome:    Undecided, " << teamsLeft << " teams have tanks left" << endl;
+	}
+
+	SimulationRecord(0);
+	recorder.Close();
+	SimulationShutdown();
+	return 0;
+}
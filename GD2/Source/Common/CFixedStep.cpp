@@ -0,0 +1,93 @@
+/*******************************************
+	
+	CFixedStep.cpp
+
+	Fixed time step scheduler implementation
+
+********************************************/
+
+#include "CFixedStep.h"
+
+//////////////////////////////
+// Constructor
+
+// Pass the number of steps per second and the most steps to run in one frame
+CFixedStep::CFixedStep( float tickRate /*= 60.0f*/, int maxSteps /*= 5*/ )
+{
+	SetTickRate( tickRate );
+	SetMaxSteps( maxSteps );
+	Reset();
+}
+
+
+//////////////////////////////
+// Settings
+
+// Set / get the number of steps per second
+void CFixedStep::SetTickRate( float tickRate )
+{
+	m_StepTime = 1.0f / tickRate;
+}
+
+float CFixedStep::GetTickRate()
+{
+	return 1.0f / m_StepTime;
+}
+
+// Get the length of one step (seconds)
+float CFixedStep::GetStepTime()
+{
+	return m_StepTime;
+}
+
+// Set the most steps to run in one frame
+void CFixedStep::SetMaxSteps( int maxSteps )
+{
+	m_MaxSteps = (maxSteps > 0) ? maxSteps : 1;
+}
+
+
+//////////////////////////////
+// Stepping
+
+// Clear the accumulated and dropped time
+void CFixedStep::Reset()
+{
+	m_Accumulator = 0.0f;
+	m_DroppedTime = 0.0f;
+}
+
+// Add the time passed since the last frame and return the number of steps to run now
+int CFixedStep::Advance( float frameTime )
+{
+	m_Accumulator += frameTime;
+
+	int numSteps = static_cast<int>(m_Accumulator / m_StepTime);
+	m_Accumulator -= numSteps * m_StepTime;
+	if (m_Accumulator < 0.0f)
+	{
+		m_Accumulator = 0.0f; // Rounding error
+	}
+
+	if (numSteps > m_MaxSteps)
+	{
+		// Too far behind (e.g. after a long stall) - run the maximum and drop the whole steps
+		// beyond it, keeping the fraction so interpolation stays smooth
+		m_DroppedTime += (numSteps - m_MaxSteps) * m_StepTime;
+		numSteps = m_MaxSteps;
+	}
+	return numSteps;
+}
+
+// Get the time left over after the last Advance as a fraction of a step (0 to 1)
+float CFixedStep::GetAlpha()
+{
+	float alpha = m_Accumulator / m_StepTime;
+	return (alpha < 1.0f) ? alpha : 1.0f;
+}
+
+// Get the total time dropped because the maximum number of steps was reached (seconds)
+float CFixedStep::GetDroppedTime()
+{
+	return m_DroppedTime;
+}
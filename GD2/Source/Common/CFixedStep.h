@@ -0,0 +1,68 @@
+/*******************************************
+	
+	CFixedStep.h
+
+	Fixed time step scheduler declarations
+
+********************************************/
+
+#pragma once
+
+
+// Fixed time step scheduler. Variable frame times are added to an accumulator, which is spent in
+// whole steps of a fixed length so the simulation behaves the same whatever the frame rate. The
+// time left over is returned as a fraction of a step, for interpolating between the previous and
+// current simulation state when rendering
+class CFixedStep
+{
+public:
+
+	//////////////////////////////
+	// Constructor
+
+	// Pass the number of steps per second and the most steps to run in one frame
+	CFixedStep( float tickRate = 60.0f, int maxSteps = 5 );
+
+
+	//////////////////////////////
+	// Settings
+
+	// Set / get the number of steps per second
+	void SetTickRate( float tickRate );
+	float GetTickRate();
+
+	// Get the length of one step (seconds)
+	float GetStepTime();
+
+	// Set the most steps to run in one frame. If the simulation falls further behind than this,
+	// the extra time is dropped rather than running ever more steps each frame
+	void SetMaxSteps( int maxSteps );
+
+
+	//////////////////////////////
+	// Stepping
+
+	// Clear the accumulated and dropped time
+	void Reset();
+
+	// Add the time passed since the last frame and return the number of steps to run now
+	int Advance( float frameTime );
+
+	// Get the time left over after the last Advance as a fraction of a step (0 to 1). Use to
+	// interpolate rendered state between the previous and current step
+	float GetAlpha();
+
+	// Get the total time dropped because the maximum number of steps was reached (seconds)
+	float GetDroppedTime();
+
+
+private:
+	float m_StepTime;
+	int   m_MaxSteps;
+
+	// Time passed but not yet simulated
+	float m_Accumulator;
+
+	// Time discarded when falling behind
+	float m_DroppedTime;
+};
@@ -15,6 +15,7 @@
 #include "Defines.h"
 #include "Input.h"
 #include "CTimer.h"
+#include "CFixedStep.h"
 #include "TankAssignment.h"
 
 namespace gen
@@ -64,6 +65,12 @@ namespace gen
 	// Game timer
 	CTimer Timer;
 
+	// The scene is updated in fixed steps at this rate whatever the frame rate, and rendered
+	// interpolated between the last two steps. After a long frame at most MaxCatchUpSteps are run
+	const float SimulationTickRate = 60.0f;
+	const int MaxCatchUpSteps = 5;
+	CFixedStep SimulationStep(SimulationTickRate, MaxCatchUpSteps);
+
 
 
 	//-----------------------------------------------------------------------------
@@ -264,6 +271,7 @@ INT WINAPI WinMain(HINSTANCE hInst, HINSTANCE, LPSTR, INT)
 
 			// Reset the timer for a timed game loop
 			gen::Timer.Reset();
+			gen::SimulationStep.Reset();
 
 			// Enter the message loop
 			MSG msg;
@@ -277,10 +285,16 @@ INT WINAPI WinMain(HINSTANCE hInst, HINSTANCE, LPSTR, INT)
 				}
 				else
 				{
-					// Render and update the scene - using variable timing
-					float updateTime = gen::Timer.GetLapTime();
-					gen::RenderScene(updateTime);
-					gen::UpdateScene(updateTime);
+					// Update the scene in fixed steps to catch up with the time passed, then move the
+					// camera and render the scene using variable timing
+					float frameTime = gen::Timer.GetLapTime();
+					int numSteps = gen::SimulationStep.Advance(frameTime);
+					for (int step = 0; step < numSteps; ++step)
+					{
+						gen::UpdateScene(gen::SimulationStep.GetStepTime());
+					}
+					gen::UpdateCamera(frameTime, gen::SimulationStep.GetAlpha());
+					gen::RenderScene(frameTime, gen::SimulationStep.GetAlpha());
 
 					// Toggle fullscreen / windowed
 					if (gen::KeyHit(gen::Key_F1))
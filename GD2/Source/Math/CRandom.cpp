@@ -0,0 +1,105 @@
+/**************************************************************************************************
+	Module:       CRandom.cpp
+
+	Implementation of the concrete class CRandom, a PCG32 random number generator
+**************************************************************************************************/
+
+#include "CRandom.h"
+
+namespace gen
+{
+
+	/*-----------------------------------------------------------------------------------------
+		Seeding
+	-----------------------------------------------------------------------------------------*/
+
+	// Restart the generator with the given seed and stream number
+	void CRandom::Seed
+	(
+		const TUInt64 seed,
+		const TUInt64 stream /*= 0*/
+	)
+	{
+		m_Seed = seed;
+		m_Increment = (stream << 1) | 1;
+		m_State = 0;
+		Next();
+		m_State += seed;
+		Next();
+	}
+
+
+	/*-----------------------------------------------------------------------------------------
+		Random numbers
+	-----------------------------------------------------------------------------------------*/
+
+	// Fill an array with the next count random 32-bit values in the sequence. Gives the same values
+	// as calling Next count times. Each step depends on the last, so rather than one step at a time
+	// four interleaved lanes are each advanced four steps at once, letting the CPU work on the four
+	// multiplies together
+	void CRandom::Fill
+	(
+		TUInt32*      values,
+		const TUInt32 count
+	)
+	{
+		// Four steps of the LCG combined: state * multiplier^4 + increment * (1 + m + m^2 + m^3)
+		const TUInt64 mult2 = kMultiplier * kMultiplier;
+		const TUInt64 mult4 = mult2 * mult2;
+		const TUInt64 inc4 = m_Increment * (1 + kMultiplier + mult2 + mult2 * kMultiplier);
+
+		TUInt32 value = 0;
+		if (count >= 4)
+		{
+			TUInt64 state0 = m_State;
+			TUInt64 state1 = state0 * kMultiplier + m_Increment;
+			TUInt64 state2 = state1 * kMultiplier + m_Increment;
+			TUInt64 state3 = state2 * kMultiplier + m_Increment;
+			for (; value + 4 <= count; value += 4)
+			{
+				values[value]     = Output(state0);
+				values[value + 1] = Output(state1);
+				values[value + 2] = Output(state2);
+				values[value + 3] = Output(state3);
+				state0 = state0 * mult4 + inc4;
+				state1 = state1 * mult4 + inc4;
+				state2 = state2 * mult4 + inc4;
+				state3 = state3 * mult4 + inc4;
+			}
+			m_State = state0;
+		}
+
+		// Remaining values one at a time
+		for (; value < count; ++value)
+		{
+			values[value] = Next();
+		}
+	}
+
+	// Fill an array with count random 32-bit floats from a up to (but not including) b. Gives the
+	// same values as calling Random(a, b) count times
+	void CRandom::Fill
+	(
+		TFloat32*      values,
+		const TUInt32  count,
+		const TFloat32 a,
+		const TFloat32 b
+	)
+	{
+		// Generate the integers in blocks on the stack, then convert them
+		const TUInt32 kBlockSize = 256;
+		TUInt32 block[kBlockSize];
+		TFloat32 range = b - a;
+		for (TUInt32 start = 0; start < count; start += kBlockSize)
+		{
+			TUInt32 blockCount = (count - start < kBlockSize) ? count - start : kBlockSize;
+			Fill(block, blockCount);
+			for (TUInt32 value = 0; value < blockCount; ++value)
+			{
+				values[start + value] = a + range * ToUnit(block[value]);
+			}
+		}
+	}
+
+
+} // namespace gen
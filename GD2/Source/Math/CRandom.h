@@ -0,0 +1,144 @@
+/**************************************************************************************************
+	Module:       CRandom.h
+
+	Definition of the concrete class CRandom, a PCG32 random number generator. Generators with
+	the same seed but different stream numbers give independent sequences, so each user of random
+	numbers can have a stream of its own and is unaffected by calls made elsewhere. The sequence
+	depends only on the seed and stream - not on the compiler, platform or thread
+**************************************************************************************************/
+
+#ifndef GEN_C_RANDOM_H_INCLUDED
+#define GEN_C_RANDOM_H_INCLUDED
+
+#include "Defines.h"
+
+namespace gen
+{
+
+	class CRandom
+	{
+		GEN_CLASS(CRandom);
+
+		// Concrete class - public access
+	public:
+
+		/*-----------------------------------------------------------------------------------------
+			Constructors/Destructors
+		-----------------------------------------------------------------------------------------*/
+
+		// Construct with a seed and stream number
+		explicit CRandom
+		(
+			const TUInt64 seed = 0,
+			const TUInt64 stream = 0
+		)
+		{
+			Seed(seed, stream);
+		}
+
+		// Copy constructor and assignment operator are the defaults - a copy continues the same
+		// sequence from the same point
+
+
+		/*-----------------------------------------------------------------------------------------
+			Seeding
+		-----------------------------------------------------------------------------------------*/
+
+		// Restart the generator with the given seed and stream number
+		void Seed
+		(
+			const TUInt64 seed,
+			const TUInt64 stream = 0
+		);
+
+		// Return a new generator with the same seed as this one but the given stream number
+		CRandom Stream(const TUInt64 stream) const
+		{
+			return CRandom(m_Seed, stream);
+		}
+
+
+		/*-----------------------------------------------------------------------------------------
+			Random numbers
+		-----------------------------------------------------------------------------------------*/
+
+		// Return the next random 32-bit value in the sequence
+		TUInt32 Next()
+		{
+			TUInt64 oldState = m_State;
+			m_State = oldState * kMultiplier + m_Increment;
+			return Output(oldState);
+		}
+
+		// Return random integer from a to b (inclusive)
+		TInt32 Random
+		(
+			const TInt32 a,
+			const TInt32 b
+		)
+		{
+			TUInt64 range = static_cast<TUInt64>(static_cast<TInt64>(b) - a + 1);
+			return a + static_cast<TInt32>((Next() * range) >> 32);
+		}
+
+		// Return random 32-bit float from a up to (but not including) b
+		TFloat32 Random
+		(
+			const TFloat32 a,
+			const TFloat32 b
+		)
+		{
+			return a + (b - a) * ToUnit(Next());
+		}
+
+		// Fill an array with the next count random 32-bit values in the sequence. Gives the same
+		// values as calling Next count times, but several steps are worked out at once
+		void Fill
+		(
+			TUInt32*      values,
+			const TUInt32 count
+		);
+
+		// Fill an array with count random 32-bit floats from a up to (but not including) b. Gives
+		// the same values as calling Random(a, b) count times
+		void Fill
+		(
+			TFloat32*      values,
+			const TUInt32  count,
+			const TFloat32 a,
+			const TFloat32 b
+		);
+
+
+		/*-----------------------------------------------------------------------------------------
+			Private interface
+		-----------------------------------------------------------------------------------------*/
+	private:
+
+		// LCG multiplier for the state
+		static const TUInt64 kMultiplier = 6364136223846793005ull;
+
+		// Permute a state into a 32-bit output value (PCG XSH RR)
+		static TUInt32 Output(const TUInt64 state)
+		{
+			TUInt32 xorShifted = static_cast<TUInt32>(((state >> 18) ^ state) >> 27);
+			TUInt32 rotate = static_cast<TUInt32>(state >> 59);
+			return (xorShifted >> rotate) | (xorShifted << ((0u - rotate) & 31));
+		}
+
+		// Convert a 32-bit value to a float from 0 up to (but not including) 1, using the top 24
+		// bits so every result is exact
+		static TFloat32 ToUnit(const TUInt32 value)
+		{
+			return static_cast<TFloat32>(value >> 8) * (1.0f / 16777216.0f);
+		}
+
+		TUInt64 m_State;
+		TUInt64 m_Increment; // Stream selector, always odd
+		TUInt64 m_Seed;
+	};
+
+
+} // namespace gen
+
+#endif // GEN_C_RANDOM_H_INCLUDED
@@ -20,10 +20,11 @@ namespace gen
 	---------------------------------------------------------------------------------------------*/
 
 	// Constructor initialises state variables
-	CParseLevel::CParseLevel(CEntityManager* entityManager)
+	CParseLevel::CParseLevel(CEntityManager* entityManager, CRandom* random)
 	{
 		// Take copy of entity manager for creation
 		m_EntityManager = entityManager;
+		m_Random = random;
 
 		// File state
 		m_CurrentSection = None;
@@ -64,6 +65,7 @@ namespace gen
 		else if (eltName == "Entities")
 		{
 			m_CurrentSection = Entities;
+			m_GeneratedTanks.clear();
 		}
 
 		// Different parsing depending on section currently being read
@@ -203,19 +205,30 @@ namespace gen
 			float m_TemplateMaxY = GetAttributeFloat(attrs, "MaxY");
 			float m_TemplateMaxZ = GetAttributeFloat(attrs, "MaxZ");
 
+			// Scatter positions for all the entities generated together
+			vector<TFloat32> xPositions(Max(m_TemplateAmount, 0));
+			vector<TFloat32> zPositions(Max(m_TemplateAmount, 0));
+			if (m_TemplateAmount > 0)
+			{
+				m_Random->Fill(&xPositions[0], m_TemplateAmount, m_TemplateX, m_TemplateMaxX);
+				m_Random->Fill(&zPositions[0], m_TemplateAmount, m_TemplateZ, m_TemplateMaxZ);
+			}
+
 			for (int i = 0; i < m_TemplateAmount; i++)
 			{
-				float m_XPos, m_YPos, m_ZPos;
 				TEntityUID entityUID = m_EntityManager->CreateEntity(m_TemplateType, m_TemplateName);
 				m_Entity = m_EntityManager->GetEntity(entityUID);
 
-				m_Pos.x = Random(m_TemplateX, m_TemplateMaxX);
-				//m_YPos = Random(m_TemplateY, m_TemplateMaxY);
-				m_Pos.z = Random(m_TemplateZ, m_TemplateMaxZ);
+				m_Pos.x = xPositions[i];
+				m_Pos.z = zPositions[i];
 				m_Entity->Matrix().MakeAffineEuler(m_Pos, m_Rot, kZXY, m_Scale);
 
 			}
 		}
+		else if (eltName == "TankLoop")
+		{
+			GenerateTanks(attrs);
+		}
 		// Started reading an entity position - get X,Y,Z
 		else if (eltName == "Position")
 		{
@@ -263,9 +276,9 @@ namespace gen
 			float randomX = GetAttributeFloat(attrs, "X") * 0.5f;
 			float randomY = GetAttributeFloat(attrs, "Y") * 0.5f;
 			float randomZ = GetAttributeFloat(attrs, "Z") * 0.5f;
-			m_Pos.x += Random(-randomX, randomX);
-			m_Pos.y += Random(-randomY, randomY);
-			m_Pos.z += Random(-randomZ, randomZ);
+			m_Pos.x += m_Random->Random(-randomX, randomX);
+			m_Pos.y += m_Random->Random(-randomY, randomY);
+			m_Pos.z += m_Random->Random(-randomZ, randomZ);
 		}
 
 		// Component to add to entity
@@ -289,6 +302,148 @@ namespace gen
 
 	}
 
+	/*---------------------------------------------------------------------------------------------
+		Level Generation
+	---------------------------------------------------------------------------------------------*/
+
+	// Called for a TankLoop element - generates teams of tanks with patrol routes and scatters
+	// buildings over an area, for battles far larger than can be placed by hand. Attributes:
+	//   Types          - Tank templates, comma separated. Each team's tanks use them in turn
+	//   Amount         - Number of tanks, shared out between the teams
+	//   Teams          - Number of teams (2 by default)
+	//   X, Z, MaxX, MaxZ - Area of the battle
+	//   PatrolPoints   - Points on each team's patrol route (4 by default)
+	//   Buildings      - Number of buildings to scatter over the area (none by default)
+	//   BuildingType   - Template for the buildings ("Building" by default)
+	//   Seed           - Optional, gives the same layout whatever the level's seed
+	// Team bases are spaced evenly on a circle around the middle of the area and each team's tanks
+	// start around its base, facing the middle. A team's patrol route is a ring passing near its
+	// base and the middle, so the routes of all the teams meet there. Tanks start at different
+	// points on their team's route so they spread round it
+	void CParseLevel::GenerateTanks(SAttribute* attrs)
+	{
+		// Tank templates, ignoring any that aren't tanks
+		vector<string> types;
+		string typeList = GetAttribute(attrs, "Types");
+		string::size_type start = 0;
+		while (start < typeList.length())
+		{
+			string::size_type end = typeList.find(',', start);
+			if (end == string::npos)
+			{
+				end = typeList.length();
+			}
+			string type = typeList.substr(start, end - start);
+			CEntityTemplate* tankTemplate = m_EntityManager->GetTemplate(type);
+			if (tankTemplate != 0 && tankTemplate->GetType() == "Tank")
+			{
+				types.push_back(type);
+			}
+			start = end + 1;
+		}
+
+		int amount = GetAttributeInt(attrs, "Amount");
+		int numTeams = GetAttributeInt(attrs, "Teams", 2);
+		int numPatrolPoints = Max(GetAttributeInt(attrs, "PatrolPoints", 4), 1);
+		int numBuildings = GetAttributeInt(attrs, "Buildings");
+		string buildingType = GetAttribute(attrs, "BuildingType", "Building");
+		float minX = GetAttributeFloat(attrs, "X");
+		float minZ = GetAttributeFloat(attrs, "Z");
+		float maxX = GetAttributeFloat(attrs, "MaxX");
+		float maxZ = GetAttributeFloat(attrs, "MaxZ");
+		if (types.empty() || amount <= 0 || numTeams <= 0 || maxX <= minX || maxZ <= minZ)
+		{
+			return;
+		}
+
+		// Layout random numbers, from the level's generator unless the element has a seed of its own
+		CRandom ownRandom(GetAttributeInt(attrs, "Seed"));
+		CRandom* random = (GetAttribute(attrs, "Seed") != "") ? &ownRandom : m_Random;
+
+		// Team bases and patrol routes. A single team has its base and route in the middle
+		CVector3 middle((minX + maxX) * 0.5f, 0.0f, (minZ + maxZ) * 0.5f);
+		float areaRadius = 0.5f * Min(maxX - minX, maxZ - minZ);
+		float baseDistance = (numTeams > 1) ? areaRadius * 0.6f : 0.0f;
+		float baseRadius = areaRadius * 0.3f;
+		vector<CVector3> bases(numTeams);
+		vector< vector<CVector3> > routes(numTeams);
+		for (int team = 0; team < numTeams; ++team)
+		{
+			float baseAngle = 2.0f * kfPi * team / numTeams;
+			bases[team] = middle + CVector3(Sin(baseAngle), 0.0f, Cos(baseAngle)) * baseDistance;
+
+			CVector3 routeCentre = (bases[team] + middle) * 0.5f;
+			float routeRadius = Max(baseDistance * 0.5f, baseRadius);
+			for (int point = 0; point < numPatrolPoints; ++point)
+			{
+				float pointAngle = baseAngle + 2.0f * kfPi * point / numPatrolPoints;
+				float pointRadius = routeRadius * random->Random(0.8f, 1.2f);
+				CVector3 patrolPoint = routeCentre + CVector3(Sin(pointAngle), 0.0f, Cos(pointAngle)) * pointRadius;
+				patrolPoint.y = 0.5f;
+				routes[team].push_back(patrolPoint);
+			}
+		}
+
+		// Scatter the tanks around their bases - tank i is on team i % Teams
+		vector<TFloat32> angles(amount);
+		vector<TFloat32> distances(amount);
+		random->Fill(&angles[0], amount, 0.0f, 2.0f * kfPi);
+		random->Fill(&distances[0], amount, 0.0f, 1.0f);
+		vector<CVector3> patrolPoints(numPatrolPoints);
+		m_GeneratedTanks.reserve(m_GeneratedTanks.size() + amount);
+		for (int i = 0; i < amount; ++i)
+		{
+			int team = i % numTeams;
+			int teamIndex = i / numTeams;
+
+			// Uniform over the base's disc
+			float distance = baseRadius * Sqrt(distances[i]);
+			CVector3 position = bases[team] + CVector3(Sin(angles[i]), 0.0f, Cos(angles[i])) * distance;
+			position.y = 0.5f;
+			CVector3 toMiddle = middle - position;
+			CVector3 rotation(0.0f, ATan(toMiddle.x, toMiddle.z), 0.0f);
+
+			// The team's route, starting from a different point for each tank
+			for (int point = 0; point < numPatrolPoints; ++point)
+			{
+				patrolPoints[point] = routes[team][(point + teamIndex) % numPatrolPoints];
+			}
+
+			string name = "T" + to_string(team) + "-" + to_string(teamIndex + 1);
+			TEntityUID entityUID = m_EntityManager->CreateTank(types[teamIndex % types.size()], team, name,
+			                                                   patrolPoints, position, rotation);
+			m_GeneratedTanks.push_back(entityUID);
+		}
+
+		// Scatter the buildings, keeping them off the team bases
+		if (m_EntityManager->GetTemplate(buildingType) == 0)
+		{
+			return;
+		}
+		const int kMaxTries = 8;
+		for (int building = 0; building < numBuildings; ++building)
+		{
+			CVector3 position;
+			for (int attempt = 0; attempt < kMaxTries; ++attempt)
+			{
+				position = CVector3(random->Random(minX, maxX), 0.0f, random->Random(minZ, maxZ));
+				bool onBase = false;
+				for (int team = 0; team < numTeams && !onBase; ++team)
+				{
+					onBase = (Distance(position, bases[team]) < baseRadius);
+				}
+				if (!onBase)
+				{
+					break;
+				}
+			}
+			// Quarter turns only, so the line of sight and navigation boxes stay tight
+			CVector3 rotation(0.0f, random->Random(0, 3) * kfPi * 0.5f, 0.0f);
+			m_EntityManager->CreateEntity(buildingType, buildingType, position, rotation);
+		}
+	}
+
+
 	//****************************************************************************/
 	//  Component Code
 	//****************************************************************************/
@@ -17,6 +17,7 @@ using namespace std;
 #include "CVector3.h"
 #include "EntityManager.h"
 #include "ParseXML.h"
+#include "CRandom.h"
 
 namespace gen
 {
@@ -37,8 +38,22 @@ namespace gen
 			Constructors / Destructors
 		---------------------------------------------------------------------------------------------*/
 	public:
-		// Constructor gets a pointer to the entity manager and initialises state variables
-		CParseLevel(CEntityManager* entityManager);
+		// Constructor gets a pointer to the entity manager and the random number generator used to
+		// scatter entities, and initialises state variables
+		CParseLevel(CEntityManager* entityManager, CRandom* random);
+
+
+		/*-----------------------------------------------------------------------------------------
+			Public interface
+		-----------------------------------------------------------------------------------------*/
+	public:
+
+		// Return the tanks generated by TankLoop elements in the last level parsed. They have their
+		// own patrol routes rather than following the level's patrol quads
+		const vector<TEntityUID>& GetGeneratedTanks()
+		{
+			return m_GeneratedTanks;
+		}
 
 
 		/*-----------------------------------------------------------------------------------------
@@ -93,6 +108,15 @@ namespace gen
 		void ComponentsStartElt(const string& typeName, SAttribute* attrs);
 
 
+		/*---------------------------------------------------------------------------------------------
+			Level Generation
+		---------------------------------------------------------------------------------------------*/
+
+		// Called for a TankLoop element - generates teams of tanks with patrol routes and scatters
+		// buildings over an area. See the function for the attributes
+		void GenerateTanks(SAttribute* attrs);
+
+
 		/*---------------------------------------------------------------------------------------------
 			Data
 		---------------------------------------------------------------------------------------------*/
@@ -101,6 +125,12 @@ namespace gen
 		// entities as they are parsed
 		CEntityManager* m_EntityManager;
 
+		// Random numbers for Loop, TankLoop and Randomise elements
+		CRandom* m_Random;
+
+		// Tanks created by TankLoop elements
+		vector<TEntityUID> m_GeneratedTanks;
+
 		// File state
 		EFileSection m_CurrentSection;
 
@@ -0,0 +1,197 @@
+/*******************************************
+	NullMesh.cpp
+
+	Mesh class implementation without any
+	rendering, for the headless simulator
+********************************************/
+
+// Used in place of Mesh.cpp (and RenderMethod.cpp) by the headless battle simulator. Meshes load
+// only their node hierarchy and bounds, which is all the simulation uses. No geometry, materials
+// or textures are kept, no D3D device is needed and rendering does nothing. X-files are still read
+// with CImportXFile, which uses D3DX's file parser but not a device
+
+#include "Mesh.h"
+#include "CImportXFile.h"
+
+namespace gen
+{
+
+// Folder for all texture and mesh files, normally defined with the render methods
+extern const string MediaFolder = "Media\\";
+
+
+//-----------------------------------------------------------------------------
+// Constructor / destructor
+//-----------------------------------------------------------------------------
+
+// Model constructor
+CMesh::CMesh()
+{
+	// Initialise member variables
+	m_HasGeometry = false;
+
+	m_NumNodes = 0;
+	m_Nodes = 0;
+
+	m_NumSubMeshes = 0;
+	m_SubMeshes = 0;
+	m_SubMeshesDX = 0;
+
+	m_NumMaterials = 0;
+	m_Materials = 0;
+}
+
+// Model destructor
+CMesh::~CMesh()
+{
+	ReleaseResources();
+}
+
+
+// Release the nodes, there are no sub-meshes or materials
+void CMesh::ReleaseResources()
+{
+	delete[] m_Nodes;
+	m_Nodes = 0;
+	m_NumNodes = 0;
+
+	m_HasGeometry = false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Geometry access / enumeration
+//-----------------------------------------------------------------------------
+
+// No geometry is kept so there are no triangles or vertices to enumerate
+
+TUInt32 CMesh::GetNumTriangles()
+{
+	return 0;
+}
+
+void CMesh::BeginEnumTriangles()
+{
+}
+
+bool CMesh::GetTriangle( CVector3* pVertex1, CVector3* pVertex2, CVector3* pVertex3 )
+{
+	return false;
+}
+
+TUInt32 CMesh::GetNumVertices()
+{
+	return 0;
+}
+
+void CMesh::BeginEnumVertices()
+{
+}
+
+bool CMesh::GetVertex( CVector3* pVertex )
+{
+	return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Creation
+//-----------------------------------------------------------------------------
+
+// Load the node hierarchy and bounds from an X-File, returns true on success
+bool CMesh::Load( const string& fileName )
+{
+	// Create a X-File import helper class
+	CImportXFile importFile;
+
+	// Add media folder path
+	string fullFileName = MediaFolder + fileName;
+
+	// Check that the given file is an X-file
+	if (!importFile.IsXFile( fullFileName ))
+	{
+		return false;
+	}
+
+	// Import the file, return on failure
+	if (importFile.ImportFile( fullFileName ) != kSuccess)
+	{
+		return false;
+	}
+
+	// Release any existing data
+	if (m_HasGeometry)
+	{
+		ReleaseResources();
+	}
+
+	// Get node data from import class
+	m_NumNodes = importFile.GetNumNodes();
+	m_Nodes = new SMeshNode[m_NumNodes];
+	for (TUInt32 node = 0; node < m_NumNodes; ++node)
+	{
+		importFile.GetNode( node, &m_Nodes[node] );
+	}
+
+	// Calculate the bounds from the sub-mesh vertices, then discard them. Rejects the mesh if it
+	// has no sub-meshes or any empty sub-meshes, as the full mesh class does
+	TUInt32 numSubMeshes = importFile.GetNumSubMeshes();
+	if (numSubMeshes == 0)
+	{
+		ReleaseResources();
+		return false;
+	}
+	bool firstVertex = true;
+	for (TUInt32 subMesh = 0; subMesh < numSubMeshes; ++subMesh)
+	{
+		SSubMesh importSubMesh;
+		importFile.GetSubMesh( subMesh, &importSubMesh );
+		if (importSubMesh.numVertices == 0)
+		{
+			delete[] importSubMesh.vertices;
+			delete[] importSubMesh.faces;
+			ReleaseResources();
+			return false;
+		}
+
+		// Assuming first three floats of each vertex are the coord x,y & z, see Mesh.cpp
+		TUInt8* pVertex = importSubMesh.vertices;
+		for (TUInt32 vert = 0; vert < importSubMesh.numVertices; ++vert)
+		{
+			TFloat32* pVertexCoord = reinterpret_cast<TFloat32*>(pVertex);
+			CVector3 vertex( pVertexCoord[0], pVertexCoord[1], pVertexCoord[2] );
+			if (firstVertex)
+			{
+				m_MinBounds = m_MaxBounds = vertex;
+				m_BoundingRadius = vertex.Length();
+				firstVertex = false;
+			}
+			else
+			{
+				m_MinBounds = CVector3( Min( m_MinBounds.x, vertex.x ), Min( m_MinBounds.y, vertex.y ), Min( m_MinBounds.z, vertex.z ) );
+				m_MaxBounds = CVector3( Max( m_MaxBounds.x, vertex.x ), Max( m_MaxBounds.y, vertex.y ), Max( m_MaxBounds.z, vertex.z ) );
+				m_BoundingRadius = Max( m_BoundingRadius, vertex.Length() );
+			}
+			pVertex += importSubMesh.vertexSize;
+		}
+
+		delete[] importSubMesh.vertices;
+		delete[] importSubMesh.faces;
+	}
+
+	m_HasGeometry = true;
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Rendering
+//-----------------------------------------------------------------------------
+
+// Nothing is rendered
+void CMesh::Render( CMatrix4x4* matrices )
+{
+}
+
+
+} // namespace gen
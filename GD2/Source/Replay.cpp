@@ -0,0 +1,449 @@
+/*******************************************
+	Replay.cpp
+
+	Recording and replaying battles step by
+	step from a compact binary log
+********************************************/
+
+#include <cstring>
+using namespace std;
+
+#include "ThinkScheduler.h"
+#include "Replay.h"
+
+namespace gen
+{
+	// Think scheduler of the world being replayed, from Simulation.cpp
+	extern thread_local CThinkScheduler ThinkScheduler;
+
+
+	//-----------------------------------------------------------------------------
+	// File format
+	//-----------------------------------------------------------------------------
+
+	// Header: magic, version, seed, keyframe interval, level file name length, level file name
+	const char    kReplayMagic[4] = { 'T', 'K', 'R', 'P' };
+	const TUInt32 kReplayVersion = 1;
+
+	// Footer after the keyframe index: number of keyframes, number of steps, index offset, magic
+	const char    kIndexMagic[4] = { 'T', 'K', 'R', 'I' };
+	const TUInt32 kFooterSize = 16;
+
+	// Flags at the start of a step record saying which values follow
+	const TUInt8 kStepUpdateTime = 1;
+	const TUInt8 kStepFocus      = 2;
+	const TUInt8 kStepThinkLimit = 4;
+	const TUInt8 kStepCommands   = 8;
+
+
+	//-----------------------------------------------------------------------------
+	// Recorder
+	//-----------------------------------------------------------------------------
+
+	CReplayRecorder::CReplayRecorder()
+	{
+		m_File = 0;
+		m_Offset = 0;
+		m_Tick = 0;
+		m_KeyframeInterval = 0;
+		m_HaveLast = false;
+	}
+
+	// Start recording to the given file, passing the level and seed the world was set up with and
+	// the number of steps between keyframes. Returns false if the file couldn't be opened
+	bool CReplayRecorder::Open(const string& fileName, const string& levelFile, TUInt32 seed,
+	                           TUInt32 keyframeInterval /*= 600*/)
+	{
+		Close();
+		m_File = fopen(fileName.c_str(), "wb");
+		if (!m_File)
+		{
+			return false;
+		}
+		m_Offset = 0;
+		m_Tick = 0;
+		m_KeyframeInterval = Max(keyframeInterval, 1u);
+		m_Keyframes.clear();
+
+		TUInt32 levelLength = static_cast<TUInt32>(levelFile.length());
+		Write(kReplayMagic, sizeof(kReplayMagic));
+		Write(&kReplayVersion, sizeof(kReplayVersion));
+		Write(&seed, sizeof(seed));
+		Write(&m_KeyframeInterval, sizeof(m_KeyframeInterval));
+		Write(&levelLength, sizeof(levelLength));
+		Write(levelFile.c_str(), levelLength);
+
+		// Keyframe for the world as set up
+		AddKeyframe();
+		return true;
+	}
+
+	// Write the keyframe index and close the file
+	void CReplayRecorder::Close()
+	{
+		if (!m_File)
+		{
+			return;
+		}
+
+		// Keyframe for the end of the recording
+		if (m_Keyframes.back().tick != m_Tick)
+		{
+			AddKeyframe();
+		}
+
+		TUInt32 indexOffset = m_Offset;
+		TUInt32 numKeyframes = static_cast<TUInt32>(m_Keyframes.size());
+		Write(&m_Keyframes[0], numKeyframes * sizeof(SReplayKeyframe));
+		Write(&numKeyframes, sizeof(numKeyframes));
+		Write(&m_Tick, sizeof(m_Tick));
+		Write(&indexOffset, sizeof(indexOffset));
+		Write(kIndexMagic, sizeof(kIndexMagic));
+
+		fclose(m_File);
+		m_File = 0;
+	}
+
+	// Record a step, called by SimulationStep after running it
+	void CReplayRecorder::RecordStep(TFloat32 updateTime, const CVector3& focus, TUInt32 thinkLimit,
+	                                 const vector<SSimCommand>& commands)
+	{
+		if (!m_File)
+		{
+			return;
+		}
+
+		// Only values that have changed are written, all of them after a keyframe
+		TUInt8 flags = 0;
+		if (!m_HaveLast || updateTime != m_LastUpdateTime)
+		{
+			flags |= kStepUpdateTime;
+		}
+		if (!m_HaveLast || focus != m_LastFocus)
+		{
+			flags |= kStepFocus;
+		}
+		if (!m_HaveLast || thinkLimit != m_LastThinkLimit)
+		{
+			flags |= kStepThinkLimit;
+		}
+		if (!commands.empty())
+		{
+			flags |= kStepCommands;
+		}
+
+		Write(&flags, sizeof(flags));
+		if (flags & kStepUpdateTime)
+		{
+			Write(&updateTime, sizeof(updateTime));
+		}
+		if (flags & kStepFocus)
+		{
+			Write(&focus.x, 3 * sizeof(TFloat32));
+		}
+		if (flags & kStepThinkLimit)
+		{
+			Write(&thinkLimit, sizeof(thinkLimit));
+		}
+		if (flags & kStepCommands)
+		{
+			TUInt16 numCommands = static_cast<TUInt16>(commands.size());
+			Write(&numCommands, sizeof(numCommands));
+			for (TUInt32 command = 0; command < numCommands; ++command)
+			{
+				TUInt8 type = static_cast<TUInt8>(commands[command].type);
+				Write(&type, sizeof(type));
+				Write(&commands[command].uid, sizeof(TEntityUID));
+				Write(&commands[command].position.x, 3 * sizeof(TFloat32));
+			}
+		}
+
+		m_HaveLast = true;
+		m_LastUpdateTime = updateTime;
+		m_LastFocus = focus;
+		m_LastThinkLimit = thinkLimit;
+
+		++m_Tick;
+		if (m_Tick % m_KeyframeInterval == 0)
+		{
+			AddKeyframe();
+		}
+	}
+
+	// Add a keyframe for the world as it is now
+	void CReplayRecorder::AddKeyframe()
+	{
+		SReplayKeyframe keyframe = { m_Tick, m_Offset, SimulationChecksum() };
+		m_Keyframes.push_back(keyframe);
+		m_HaveLast = false;
+	}
+
+
+	//-----------------------------------------------------------------------------
+	// Player
+	//-----------------------------------------------------------------------------
+
+	CReplayPlayer::CReplayPlayer()
+	{
+		m_File = INVALID_HANDLE_VALUE;
+		m_Mapping = 0;
+		m_Data = 0;
+		m_Size = 0;
+		m_Seed = 0;
+		m_StepsStart = m_StepsEnd = 0;
+		m_NumTicks = 0;
+		m_Read = 0;
+		m_Tick = 0;
+		m_NextKeyframe = 0;
+		m_NumMismatches = 0;
+		m_FirstMismatchTick = 0;
+	}
+
+	// Map the given replay file and read its header and keyframes. If the recording was not closed
+	// properly (e.g. the game crashed) the steps are still read, but there are no keyframes to
+	// check. Returns false if the file can't be opened or isn't a replay
+	bool CReplayPlayer::Open(const string& fileName)
+	{
+		Close();
+		m_File = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+		                     FILE_ATTRIBUTE_NORMAL, 0);
+		if (m_File == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(m_File, &fileSize) || fileSize.QuadPart == 0 || fileSize.QuadPart > 0xffffffff)
+		{
+			Close();
+			return false;
+		}
+		m_Size = static_cast<TUInt32>(fileSize.QuadPart);
+		m_Mapping = CreateFileMappingA(m_File, 0, PAGE_READONLY, 0, 0, 0);
+		if (m_Mapping != 0)
+		{
+			m_Data = static_cast<const TUInt8*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+		}
+		if (m_Data == 0)
+		{
+			Close();
+			return false;
+		}
+
+		// Header, read as if it were steps
+		m_Read = 0;
+		m_StepsEnd = m_Size;
+		char magic[4];
+		TUInt32 version, keyframeInterval, levelLength;
+		if (!Read(magic, sizeof(magic)) || memcmp(magic, kReplayMagic, sizeof(magic)) != 0 ||
+		    !Read(&version, sizeof(version)) || version != kReplayVersion ||
+		    !Read(&m_Seed, sizeof(m_Seed)) || !Read(&keyframeInterval, sizeof(keyframeInterval)) ||
+		    !Read(&levelLength, sizeof(levelLength)) || levelLength > m_Size - m_Read)
+		{
+			Close();
+			return false;
+		}
+		m_LevelFile.assign(reinterpret_cast<const char*>(m_Data + m_Read), levelLength);
+		m_StepsStart = m_Read + levelLength;
+
+		// Keyframe index from the footer
+		m_Keyframes.clear();
+		m_NumTicks = 0;
+		bool haveIndex = false;
+		if (m_Size >= m_StepsStart + kFooterSize &&
+		    memcmp(m_Data + m_Size - sizeof(kIndexMagic), kIndexMagic, sizeof(kIndexMagic)) == 0)
+		{
+			TUInt32 footer[3];
+			memcpy(footer, m_Data + m_Size - kFooterSize, sizeof(footer));
+			TUInt32 numKeyframes = footer[0];
+			TUInt32 indexOffset = footer[2];
+			if (indexOffset >= m_StepsStart &&
+			    indexOffset + numKeyframes * sizeof(SReplayKeyframe) + kFooterSize == m_Size)
+			{
+				m_Keyframes.resize(numKeyframes);
+				if (numKeyframes > 0)
+				{
+					memcpy(&m_Keyframes[0], m_Data + indexOffset, numKeyframes * sizeof(SReplayKeyframe));
+				}
+				m_NumTicks = footer[1];
+				m_StepsEnd = indexOffset;
+				haveIndex = true;
+			}
+		}
+
+		// No index - count the steps that were written
+		if (!haveIndex)
+		{
+			m_StepsEnd = m_Size;
+			m_Read = m_StepsStart;
+			while (ReadStep())
+			{
+				++m_NumTicks;
+			}
+		}
+
+		m_Read = m_StepsStart;
+		m_Tick = 0;
+		return true;
+	}
+
+	// Unmap the file, leaves the world as it is
+	void CReplayPlayer::Close()
+	{
+		if (m_Data)
+		{
+			UnmapViewOfFile(m_Data);
+			m_Data = 0;
+		}
+		if (m_Mapping)
+		{
+			CloseHandle(m_Mapping);
+			m_Mapping = 0;
+		}
+		if (m_File != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(m_File);
+			m_File = INVALID_HANDLE_VALUE;
+		}
+		m_Size = 0;
+	}
+
+	// Set up the world for the recorded level and seed. The world can't be restarted in place, so
+	// call once on a thread with no world set up
+	bool CReplayPlayer::Start()
+	{
+		if (!m_Data || !SimulationSetup(m_LevelFile, m_Seed))
+		{
+			return false;
+		}
+
+		m_Read = m_StepsStart;
+		m_Tick = 0;
+		m_NextKeyframe = 0;
+		m_NumMismatches = 0;
+		m_FirstMismatchTick = 0;
+		CheckKeyframe();
+		return true;
+	}
+
+	// Run the next recorded step, adding the time spent in each phase to the phase times if passed.
+	// Returns false if there are no more steps
+	bool CReplayPlayer::Step(SSimPhaseTimes* phaseTimes /*= 0*/)
+	{
+		if (!m_Data || !ReadStep())
+		{
+			return false;
+		}
+
+		// Same commands and the same thinks as when recorded
+		for (TUInt32 command = 0; command < m_Commands.size(); ++command)
+		{
+			SimulationCommand(m_Commands[command]);
+		}
+		ThinkScheduler.SetThinkLimit(m_ThinkLimit);
+		SimulationStep(m_UpdateTime, m_Focus, phaseTimes);
+
+		++m_Tick;
+		CheckKeyframe();
+		return true;
+	}
+
+	// Run the steps up to the given tick. The world can't go back, so returns false if it is
+	// already past the tick, or if the replay ends first
+	bool CReplayPlayer::SeekTo(TUInt32 tick)
+	{
+		while (m_Tick < tick)
+		{
+			if (!Step())
+			{
+				return false;
+			}
+		}
+		return m_Tick == tick;
+	}
+
+	// Copy data from the current read position, returns false if it runs past the end of the steps
+	bool CReplayPlayer::Read(void* data, TUInt32 size)
+	{
+		if (m_Read + size > m_StepsEnd)
+		{
+			return false;
+		}
+		memcpy(data, m_Data + m_Read, size);
+		m_Read += size;
+		return true;
+	}
+
+	// Read the next step record into the current values, returns false if there isn't one
+	bool CReplayPlayer::ReadStep()
+	{
+		TUInt8 flags;
+		if (!Read(&flags, sizeof(flags)))
+		{
+			return false;
+		}
+		if ((flags & kStepUpdateTime) && !Read(&m_UpdateTime, sizeof(m_UpdateTime)))
+		{
+			return false;
+		}
+		if ((flags & kStepFocus) && !Read(&m_Focus.x, 3 * sizeof(TFloat32)))
+		{
+			return false;
+		}
+		if ((flags & kStepThinkLimit) && !Read(&m_ThinkLimit, sizeof(m_ThinkLimit)))
+		{
+			return false;
+		}
+
+		m_Commands.clear();
+		if (flags & kStepCommands)
+		{
+			TUInt16 numCommands;
+			if (!Read(&numCommands, sizeof(numCommands)))
+			{
+				return false;
+			}
+			m_Commands.resize(numCommands);
+			for (TUInt32 command = 0; command < numCommands; ++command)
+			{
+				TUInt8 type;
+				SSimCommand& simCommand = m_Commands[command];
+				if (!Read(&type, sizeof(type)) || type >= NumSimCommandTypes ||
+				    !Read(&simCommand.uid, sizeof(TEntityUID)) ||
+				    !Read(&simCommand.position.x, 3 * sizeof(TFloat32)))
+				{
+					return false;
+				}
+				simCommand.type = static_cast<ESimCommandType>(type);
+			}
+		}
+		return true;
+	}
+
+	// Check the world against the keyframe at the current tick, if there is one. The keyframe's
+	// offset is where the next record starts, reading carries on from there
+	void CReplayPlayer::CheckKeyframe()
+	{
+		while (m_NextKeyframe < m_Keyframes.size() && m_Keyframes[m_NextKeyframe].tick < m_Tick)
+		{
+			++m_NextKeyframe;
+		}
+		if (m_NextKeyframe == m_Keyframes.size() || m_Keyframes[m_NextKeyframe].tick != m_Tick)
+		{
+			return;
+		}
+
+		const SReplayKeyframe& keyframe = m_Keyframes[m_NextKeyframe];
+		if (keyframe.checksum != SimulationChecksum())
+		{
+			if (m_NumMismatches == 0)
+			{
+				m_FirstMismatchTick = m_Tick;
+			}
+			++m_NumMismatches;
+		}
+		m_Read = keyframe.offset;
+		++m_NextKeyframe;
+	}
+
+
+} // namespace gen
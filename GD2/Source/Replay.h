@@ -0,0 +1,246 @@
+/*******************************************
+	Replay.h
+
+	Recording and replaying battles step by
+	step from a compact binary log
+********************************************/
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <windows.h>
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "Simulation.h"
+
+namespace gen
+{
+
+	// Replay files hold a header (level file and seed), then one record for each step, then an index
+	// of keyframes. A step record holds the step's update time, think scheduler focus, think limit
+	// and player commands - the only inputs to a step beyond the seeded world. Each record starts with
+	// a flags byte saying which values changed since the last record and only those follow, so a step
+	// with the same update time and focus and no commands is a single byte
+	// Keyframes are placed every few hundred steps. Each holds the position of the next record in the
+	// file and a checksum of the world after the steps before it. The records after a keyframe store
+	// all their values, so reading can start at any keyframe. Replaying compares each keyframe's
+	// checksum with the replayed world's to find where a replay goes wrong
+
+
+	// A keyframe, placed after the given number of steps
+	struct SReplayKeyframe
+	{
+		TUInt32 tick;     // Steps before the keyframe
+		TUInt32 offset;   // Position of the next step's record in the file
+		TUInt32 checksum; // World checksum after the steps
+	};
+
+
+	/*---------------------------------------------------------------------------------------------
+		CReplayRecorder class
+	---------------------------------------------------------------------------------------------*/
+	// Writes a replay file. Open it straight after the world is set up and pass it to
+	// SimulationRecord, then every step is recorded until it is closed
+	class CReplayRecorder
+	{
+		/////////////////////////////////////
+		//	Constructors/Destructors
+	public:
+		CReplayRecorder();
+
+		// Destructor closes any open file
+		~CReplayRecorder()
+		{
+			Close();
+		}
+
+	private:
+		// Disallow use of copy constructor and assignment operator (private and not defined)
+		CReplayRecorder(const CReplayRecorder&);
+		CReplayRecorder& operator=(const CReplayRecorder&);
+
+
+		/////////////////////////////////////
+		//	Public interface
+	public:
+
+		// Start recording to the given file, passing the level and seed the world was set up with and
+		// the number of steps between keyframes. Returns false if the file couldn't be opened
+		bool Open(const string& fileName, const string& levelFile, TUInt32 seed,
+		          TUInt32 keyframeInterval = 600);
+
+		// Write the keyframe index and close the file
+		void Close();
+
+		bool IsRecording()
+		{
+			return m_File != 0;
+		}
+
+		// Record a step, called by SimulationStep after running it
+		void RecordStep(TFloat32 updateTime, const CVector3& focus, TUInt32 thinkLimit,
+		                const vector<SSimCommand>& commands);
+
+
+		/////////////////////////////////////
+		//	Private interface
+	private:
+
+		// Add a keyframe for the world as it is now
+		void AddKeyframe();
+
+		void Write(const void* data, TUInt32 size)
+		{
+			fwrite(data, size, 1, m_File);
+			m_Offset += size;
+		}
+
+		FILE*   m_File;
+		TUInt32 m_Offset; // Bytes written so far
+		TUInt32 m_Tick;   // Steps recorded so far
+
+		// Values in the last record. Keyframes mark them unknown so the next record has all values
+		TUInt32  m_KeyframeInterval;
+		bool     m_HaveLast;
+		TFloat32 m_LastUpdateTime;
+		CVector3 m_LastFocus;
+		TUInt32  m_LastThinkLimit;
+
+		vector<SReplayKeyframe> m_Keyframes;
+	};
+
+
+	/*---------------------------------------------------------------------------------------------
+		CReplayPlayer class
+	---------------------------------------------------------------------------------------------*/
+	// Replays a recorded battle. The file is memory mapped and the records read from it in place.
+	// Start sets up the world with the recorded level and seed, then each Step runs the next recorded
+	// step with the same inputs, giving the same battle as long as the simulation code hasn't changed
+	// its behaviour. A world can't be restored from a keyframe, so seeking runs the steps up to it -
+	// the world runs many times faster than real time without rendering
+	class CReplayPlayer
+	{
+		/////////////////////////////////////
+		//	Constructors/Destructors
+	public:
+		CReplayPlayer();
+
+		// Destructor closes any open file
+		~CReplayPlayer()
+		{
+			Close();
+		}
+
+	private:
+		// Disallow use of copy constructor and assignment operator (private and not defined)
+		CReplayPlayer(const CReplayPlayer&);
+		CReplayPlayer& operator=(const CReplayPlayer&);
+
+
+		/////////////////////////////////////
+		//	Public interface
+	public:
+
+		// Map the given replay file and read its header and keyframes. If the recording was not
+		// closed properly (e.g. the game crashed) the steps are still read, but there are no
+		// keyframes to check. Returns false if the file can't be opened or isn't a replay
+		bool Open(const string& fileName);
+
+		// Unmap the file, leaves the world as it is
+		void Close();
+
+		const string& GetLevelFile()
+		{
+			return m_LevelFile;
+		}
+		TUInt32 GetSeed()
+		{
+			return m_Seed;
+		}
+		TUInt32 GetNumTicks()
+		{
+			return m_NumTicks;
+		}
+		const vector<SReplayKeyframe>& GetKeyframes()
+		{
+			return m_Keyframes;
+		}
+
+		// Return the number of steps replayed since Start
+		TUInt32 GetTick()
+		{
+			return m_Tick;
+		}
+
+		// Return the number of keyframes passed since Start whose checksum didn't match the world,
+		// and the first of them (the replay went wrong in the steps before it)
+		TUInt32 GetNumMismatches()
+		{
+			return m_NumMismatches;
+		}
+		TUInt32 GetFirstMismatchTick()
+		{
+			return m_FirstMismatchTick;
+		}
+
+		// Set up the world for the recorded level and seed. The world can't be restarted in place, so
+		// call once on a thread with no world set up. Returns false if the level couldn't be loaded
+		bool Start();
+
+		// Run the next recorded step, adding the time spent in each phase to the phase times if
+		// passed. Returns false if there are no more steps
+		bool Step(SSimPhaseTimes* phaseTimes = 0);
+
+		// Run the steps up to the given tick. The world can't go back, so returns false if it is
+		// already past the tick, or if the replay ends first
+		bool SeekTo(TUInt32 tick);
+
+
+		/////////////////////////////////////
+		//	Private interface
+	private:
+
+		// Copy data from the current read position, returns false if it runs past the end of the steps
+		bool Read(void* data, TUInt32 size);
+
+		// Read the next step record into the current values, returns false if there isn't one
+		bool ReadStep();
+
+		// Check the world against the keyframe at the current tick, if there is one
+		void CheckKeyframe();
+
+
+		// Mapped file
+		HANDLE        m_File;
+		HANDLE        m_Mapping;
+		const TUInt8* m_Data;
+		TUInt32       m_Size;
+
+		// Header and index
+		string  m_LevelFile;
+		TUInt32 m_Seed;
+		TUInt32 m_StepsStart; // Offset of the first step record
+		TUInt32 m_StepsEnd;   // Offset after the last step record
+		TUInt32 m_NumTicks;
+		vector<SReplayKeyframe> m_Keyframes;
+
+		// Replay position and the current step's values
+		TUInt32  m_Read;
+		TUInt32  m_Tick;
+		TUInt32  m_NextKeyframe;
+		TFloat32 m_UpdateTime;
+		CVector3 m_Focus;
+		TUInt32  m_ThinkLimit;
+		vector<SSimCommand> m_Commands;
+
+		TUInt32 m_NumMismatches;
+		TUInt32 m_FirstMismatchTick;
+	};
+
+
+} // namespace gen
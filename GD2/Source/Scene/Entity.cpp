@@ -5,6 +5,7 @@
 ********************************************/
 
 #include "Entity.h"
+#include "CQuatTransform.h"
 
 namespace gen
 {
@@ -34,6 +35,7 @@ CEntity::CEntity
 	// Allocate space for matrices
 	TUInt32 numNodes = m_Template->Mesh()->GetNumNodes();
 	m_RelMatrices = new CMatrix4x4[numNodes];
+	m_PrevRelMatrices = new CMatrix4x4[numNodes];
 	m_Matrices = new CMatrix4x4[numNodes];
 
 	// Set initial matrices from mesh defaults
@@ -44,21 +46,62 @@ CEntity::CEntity
 
 	// Override root matrix with constructor parameters
 	m_RelMatrices[0] = CMatrix4x4( position, rotation, kZXY, scale );
+	SavePrevious();
 }
 
 
-// Render the model
-void CEntity::Render()
+// Position at the given fraction (0 to 1) of the way from the previous update to the current one
+CVector3 CEntity::InterpolatedPosition( TFloat32 alpha )
+{
+	const CVector3& prev = m_PrevRelMatrices[0].Position();
+	return prev + (m_RelMatrices[0].Position() - prev) * alpha;
+}
+
+
+// Store the current matrices as the previous state, called before each update
+void CEntity::SavePrevious()
+{
+	TUInt32 numNodes = m_Template->Mesh()->GetNumNodes();
+	for (TUInt32 node = 0; node < numNodes; ++node)
+	{
+		m_PrevRelMatrices[node] = m_RelMatrices[node];
+	}
+}
+
+
+// Render the model, interpolated the given fraction (0 to 1) of the way from the previous update
+// to the current one
+void CEntity::Render( TFloat32 alpha /*= 1.0f*/ )
 {
 	// Get pointer to mesh to simplify code
 	CMesh* Mesh = m_Template->Mesh();
 
-	// Calculate absolute matrices from relative node matrices & node heirarchy
-	m_Matrices[0] = m_RelMatrices[0];
+	// Calculate absolute matrices from relative node matrices & node heirarchy. Nodes that moved
+	// in the last update are blended from their previous matrix - slerp for rotation and lerp for
+	// position and scale
 	TUInt32 numNodes = Mesh->GetNumNodes();
-	for (TUInt32 node = 1; node < numNodes; ++node)
+	for (TUInt32 node = 0; node < numNodes; ++node)
 	{
-		m_Matrices[node] = m_RelMatrices[node] * m_Matrices[Mesh->GetNode( node ).parent];
+		CMatrix4x4 relMatrix;
+		if (alpha >= 1.0f || m_PrevRelMatrices[node] == m_RelMatrices[node])
+		{
+			relMatrix = m_RelMatrices[node];
+		}
+		else
+		{
+			CQuatTransform blend;
+			Slerp( CQuatTransform( m_PrevRelMatrices[node] ), CQuatTransform( m_RelMatrices[node] ), alpha, blend );
+			blend.GetMatrix( relMatrix );
+		}
+
+		if (node == 0)
+		{
+			m_Matrices[0] = relMatrix;
+		}
+		else
+		{
+			m_Matrices[node] = relMatrix * m_Matrices[Mesh->GetNode( node ).parent];
+		}
 	}
 	// Incorporate any bone<->mesh offsets (only relevant for skinning)
 	// Don't need this step for this exercise
@@ -136,6 +136,7 @@ public:
 	virtual ~CEntity()
 	{
 		delete[] m_Matrices;
+		delete[] m_PrevRelMatrices;
 		delete[] m_RelMatrices;
 	}
 
@@ -182,6 +183,11 @@ public:
 	}
 
 
+	// Position at the given fraction (0 to 1) of the way from the previous update to the current
+	// one - use for anything that follows the entity at the render rate, e.g. a chase camera
+	CVector3 InterpolatedPosition( TFloat32 alpha );
+
+
 	/////////////////////////////////////
 	// Update / Render
 
@@ -189,9 +195,13 @@ public:
 	// Return false if the entity is to be destroyed
 	// Virtual function, base version does nothing
 	virtual bool Update( TFloat32 updateTime ) { return true; }
+
+	// Store the current matrices as the previous state, called before each update
+	void SavePrevious();
 	
-	// Render the entity
-	void Render();
+	// Render the entity, interpolated the given fraction (0 to 1) of the way from the previous
+	// update to the current one
+	void Render( TFloat32 alpha = 1.0f );
 
 
 /////////////////////////////////////
@@ -205,8 +215,10 @@ private:
 	TEntityUID  m_UID;
 	string      m_Name;
 
-	// Relative and absolute world matrices for each node in the template's mesh
+	// Relative and absolute world matrices for each node in the template's mesh, and the relative
+	// matrices before the last update for render interpolation
 	CMatrix4x4* m_RelMatrices; // Dynamically allocated arrays
+	CMatrix4x4* m_PrevRelMatrices;
 	CMatrix4x4* m_Matrices;
 };
 
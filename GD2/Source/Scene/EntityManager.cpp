@@ -6,10 +6,14 @@
 ********************************************/
 
 #include "EntityManager.h"
+#include "Messenger.h"
 
 namespace gen
 {
 
+// Messenger class for sending messages to and between entities
+extern thread_local CMessenger Messenger;
+
 /////////////////////////////////////
 // Constructors/Destructors
 
@@ -126,6 +130,9 @@ TEntityUID CEntityManager::CreateEntity
 
 	// Add mapping from UID to entity index into hash map
 	m_EntityUIDMap->SetKeyValue( m_NextUID, entityIndex );
+
+	// Open a mailbox so the entity can receive messages
+	Messenger.OpenMailbox( m_NextUID );
 	
 	m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
 
@@ -161,6 +168,9 @@ TEntityUID CEntityManager::CreateTank
 	// Add mapping from UID to entity index into hash map
 	m_EntityUIDMap->SetKeyValue(m_NextUID, entityIndex);
 
+	// Open a mailbox so the entity can receive messages
+	Messenger.OpenMailbox(m_NextUID);
+
 	m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
 
 							 // Return UID of new entity then increase it ready for next entity
@@ -168,11 +178,15 @@ TEntityUID CEntityManager::CreateTank
 }
 
 
-// Create a shell, requires a shell template name, may supply entity name and position
+// Create a shell, requires a shell template name, the UID and team of the tank that fired it and
+// the damage it causes, may supply entity name and position
 // Returns the UID of the new entity
 TEntityUID CEntityManager::CreateShell
 (
 	const string&   templateName,
+	TEntityUID      shooter,
+	TUInt32         team,
+	TInt32          damage,
 	const string&   name /*= ""*/,
 	const CVector3& position /*= CVector3::kOrigin*/,
 	const CVector3& rotation /*= CVector3( 0.0f, 0.0f, 0.0f )*/,
@@ -183,7 +197,7 @@ TEntityUID CEntityManager::CreateShell
 	CEntityTemplate* entityTemplate = GetTemplate(templateName);
 
 	// Create new tank entity with next UID
-	CEntity* newEntity = new CShellEntity(entityTemplate, m_NextUID,
+	CEntity* newEntity = new CShellEntity(entityTemplate, m_NextUID, shooter, team, damage,
 		name, position, rotation, scale);
 
 	// Get vector index for new entity and add it to vector
@@ -193,6 +207,9 @@ TEntityUID CEntityManager::CreateShell
 	// Add mapping from UID to entity index into hash map
 	m_EntityUIDMap->SetKeyValue(m_NextUID, entityIndex);
 
+	// Open a mailbox so the entity can receive messages
+	Messenger.OpenMailbox(m_NextUID);
+
 	m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
 
 							 // Return UID of new entity then increase it ready for next entity
@@ -222,6 +239,9 @@ TEntityUID CEntityManager::CreateAmmoCreate
 	// Add mapping from UID to entity index into hash map
 	m_EntityUIDMap->SetKeyValue(m_NextUID, entityIndex);
 
+	// Open a mailbox so the entity can receive messages
+	Messenger.OpenMailbox(m_NextUID);
+
 	m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
 
 							 // Return UID of new entity then increase it ready for next entity
@@ -251,6 +271,9 @@ TEntityUID CEntityManager::CreateHealthCreate
 	// Add mapping from UID to entity index into hash map
 	m_EntityUIDMap->SetKeyValue(m_NextUID, entityIndex);
 
+	// Open a mailbox so the entity can receive messages
+	Messenger.OpenMailbox(m_NextUID);
+
 	m_IsEnumerating = false; // Cancel any entity enumeration (entity list has changed)
 
 							 // Return UID of new entity then increase it ready for next entity
@@ -273,6 +296,9 @@ bool CEntityManager::DestroyEntity( TEntityUID UID )
 	delete m_Entities[entityIndex];
 	m_EntityUIDMap->RemoveKey( UID );
 
+	// Free any messages waiting for the entity and reject any sent to it from now on
+	Messenger.CloseMailbox( UID );
+
 	// If not removing last entity...
 	if (entityIndex != m_Entities.size() - 1)
 	{
@@ -293,6 +319,7 @@ void CEntityManager::DestroyAllEntities()
 	m_EntityUIDMap->RemoveAllKeys();
 	while (m_Entities.size())
 	{
+		Messenger.CloseMailbox( m_Entities.back()->GetUID() );
 		delete m_Entities.back();
 		m_Entities.pop_back();
 	}
@@ -310,7 +337,9 @@ void CEntityManager::UpdateAllEntities( float updateTime )
 	TUInt32 entity = 0;
 	while (entity < m_Entities.size())
 	{
-		// Update entity, if it returns false, then destroy it
+		// Update entity, if it returns false, then destroy it. Keep its state before the update for
+		// interpolated rendering
+		m_Entities[entity]->SavePrevious();
 		if (!m_Entities[entity]->Update( updateTime ))
 		{
 			DestroyEntity(m_Entities[entity]->GetUID());
@@ -323,12 +352,12 @@ void CEntityManager::UpdateAllEntities( float updateTime )
 }
 
 // Render all entities
-void CEntityManager::RenderAllEntities()
+void CEntityManager::RenderAllEntities( TFloat32 alpha /*= 1.0f*/ )
 {
 	TEntityIter entity = m_Entities.begin();
 	while (entity != m_Entities.end())
 	{
-		(*entity)->Render();
+		(*entity)->Render( alpha );
 		++entity;
 	}
 }
@@ -95,11 +95,15 @@ public:
 		const CVector3& scale = CVector3(1.0f, 1.0f, 1.0f)
 	);
 
-	// Create a shell, requires a shell template name, may supply entity name and position
+	// Create a shell, requires a shell template name, the UID and team of the tank that fired
+	// it and the damage it causes, may supply entity name and position
 	// Returns the UID of the new entity
 	TEntityUID CreateShell
 	(
 		const string&   templateName,
+		TEntityUID      shooter,
+		TUInt32         team,
+		TInt32          damage,
 		const string&   name = "",
 		const CVector3& position = CVector3::kOrigin,
 		const CVector3& rotation = CVector3(0.0f, 0.0f, 0.0f),
@@ -247,8 +251,9 @@ public:
 	// Pass the time since last update
 	void UpdateAllEntities( float updateTime );
 
-	// Render all entities - not the ideal method, OK for this example
-	void RenderAllEntities();
+	// Render all entities - not the ideal method, OK for this example. Pass the fraction (0 to 1)
+	// of the way from the previous update to the current one to interpolate entity positions
+	void RenderAllEntities( TFloat32 alpha = 1.0f );
 
 		
 /////////////////////////////////////
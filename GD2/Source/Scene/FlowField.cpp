@@ -0,0 +1,207 @@
+/*******************************************
+	FlowField.cpp
+
+	Shared flow fields towards goals
+********************************************/
+
+#include <algorithm>
+
+#include "FlowField.h"
+#include "NavGrid.h"
+
+namespace gen
+{
+
+// Navigation grid the fields are built on
+extern thread_local CNavGrid NavGrid;
+
+// Steps to the eight neighbouring cells. Step (i + 4) % 8 is the reverse of step i
+const TInt32 kStepX[8] = { 1, 1, 0, -1, -1, -1,  0,  1 };
+const TInt32 kStepZ[8] = { 0, 1, 1,  1,  0, -1, -1, -1 };
+
+// Special direction values
+const TUInt8 kAtGoal = 8;
+const TUInt8 kUnreached = 0xFF;
+
+// Cost of cells not yet reached
+const TFloat32 kUnreachedCost = 1e30f;
+
+// Cost of a diagonal step between cells, a straight step costs 1
+const TFloat32 kDiagonalStepCost = 1.41421356f;
+
+
+// Constructor takes the number of cells to process per frame over all fields and the number of
+// frames a field is kept without being read
+CFlowFields::CFlowFields( TUInt32 cellsPerFrame /*= 32768*/, TUInt32 fieldLifetime /*= 300*/ )
+{
+	m_CellsPerFrame = cellsPerFrame;
+	m_FieldLifetime = fieldLifetime;
+	m_Frame = 0;
+	m_GridGeneration = 0;
+	m_FrameCells = 0;
+	m_NumBuilds = 0;
+}
+
+// Destructor releases the fields
+CFlowFields::~CFlowFields()
+{
+	for (TFlowFieldIter field = m_Fields.begin(); field != m_Fields.end(); ++field)
+	{
+		delete field->second;
+	}
+}
+
+
+// Call once per frame before the entity updates - discards unused fields and extends the fields
+// still being built. Fields are restarted if the navigation grid has changed
+void CFlowFields::Update()
+{
+	++m_Frame;
+	bool gridChanged = (NavGrid.GetGeneration() != m_GridGeneration);
+	m_GridGeneration = NavGrid.GetGeneration();
+
+	TFlowFieldIter field = m_Fields.begin();
+	while (field != m_Fields.end())
+	{
+		if (m_Frame - field->second->lastUsed > m_FieldLifetime)
+		{
+			delete field->second;
+			m_Fields.erase( field++ );
+		}
+		else
+		{
+			if (gridChanged)
+			{
+				Restart( field->second, field->second->goalCell );
+			}
+			++field;
+		}
+	}
+
+	// Share the cell budget between the fields still being built, in order
+	m_FrameCells = 0;
+	for (field = m_Fields.begin(); field != m_Fields.end() && m_FrameCells < m_CellsPerFrame; ++field)
+	{
+		m_FrameCells += Extend( field->second, m_CellsPerFrame - m_FrameCells );
+	}
+}
+
+
+// Get the direction (unit vector on the XZ plane) to move from the given position towards a goal
+bool CFlowFields::GetDirection( TUInt32 goalKey, const CVector3& goal, const CVector3& position,
+                                CVector3& direction )
+{
+	TInt32 goalCell = NavGrid.CellFromPoint( goal );
+
+	// Find the goal's field, starting a new one if needed or restarting it if the goal has moved
+	SFlowField* field;
+	TFlowFieldIter found = m_Fields.find( goalKey );
+	if (found == m_Fields.end())
+	{
+		field = new SFlowField;
+		m_Fields[goalKey] = field;
+		Restart( field, goalCell );
+	}
+	else
+	{
+		field = found->second;
+		if (field->goalCell != goalCell)
+		{
+			Restart( field, goalCell );
+		}
+	}
+	field->lastUsed = m_Frame;
+
+	TInt32 cell = NavGrid.CellFromPoint( position );
+	if (cell < 0 || field->directions.empty())
+	{
+		return false;
+	}
+	TUInt8 step = field->directions[cell];
+	if (step == kUnreached || step == kAtGoal)
+	{
+		return false;
+	}
+	direction = CVector3( static_cast<TFloat32>(kStepX[step]), 0.0f, static_cast<TFloat32>(kStepZ[step]) );
+	direction.Normalise();
+	return true;
+}
+
+
+// Start building a field outwards from its goal cell
+void CFlowFields::Restart( SFlowField* field, TInt32 goalCell )
+{
+	++m_NumBuilds;
+	field->goalCell = goalCell;
+	field->open.clear();
+
+	TUInt32 numCells = NavGrid.GetNumCellsX() * NavGrid.GetNumCellsZ();
+	field->cost.assign( numCells, kUnreachedCost );
+	field->directions.assign( numCells, kUnreached );
+	if (goalCell >= 0 && !NavGrid.IsCellBlocked( goalCell ))
+	{
+		field->cost[goalCell] = 0.0f;
+		field->directions[goalCell] = kAtGoal;
+		SOpenCell start = { 0.0f, static_cast<TUInt32>(goalCell) };
+		field->open.push_back( start );
+	}
+}
+
+// Expand up to the given number of cells of a field, returns the number expanded. Cells are
+// expanded cheapest first (Dijkstra's algorithm), each neighbour reached more cheaply records the
+// step back towards the cell it was reached from. Diagonal steps may not cut the corner of a
+// blocked cell, as for path finding
+TUInt32 CFlowFields::Extend( SFlowField* field, TUInt32 maxCells )
+{
+	TInt32 numCellsX = static_cast<TInt32>(NavGrid.GetNumCellsX());
+	TInt32 numCellsZ = static_cast<TInt32>(NavGrid.GetNumCellsZ());
+
+	TUInt32 numExpanded = 0;
+	while (!field->open.empty() && numExpanded < maxCells)
+	{
+		pop_heap( field->open.begin(), field->open.end() );
+		SOpenCell current = field->open.back();
+		field->open.pop_back();
+		if (current.cost > field->cost[current.cell])
+		{
+			continue; // Already reached more cheaply
+		}
+		++numExpanded;
+
+		TInt32 cellX = current.cell % numCellsX;
+		TInt32 cellZ = current.cell / numCellsX;
+		for (TUInt32 step = 0; step < 8; ++step)
+		{
+			TInt32 x = cellX + kStepX[step];
+			TInt32 z = cellZ + kStepZ[step];
+			if (x < 0 || z < 0 || x >= numCellsX || z >= numCellsZ)
+			{
+				continue;
+			}
+			TUInt32 next = z * numCellsX + x;
+			if (NavGrid.IsCellBlocked( next ))
+			{
+				continue;
+			}
+			bool diagonal = (step & 1) != 0;
+			if (diagonal && (NavGrid.IsCellBlocked( cellZ * numCellsX + x ) || NavGrid.IsCellBlocked( z * numCellsX + cellX )))
+			{
+				continue;
+			}
+
+			TFloat32 cost = current.cost + (diagonal ? kDiagonalStepCost : 1.0f);
+			if (cost < field->cost[next])
+			{
+				field->cost[next] = cost;
+				field->directions[next] = static_cast<TUInt8>((step + 4) & 7);
+				SOpenCell open = { cost, next };
+				field->open.push_back( open );
+				push_heap( field->open.begin(), field->open.end() );
+			}
+		}
+	}
+	return numExpanded;
+}
+
+
+} // namespace gen
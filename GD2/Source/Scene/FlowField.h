@@ -0,0 +1,122 @@
+/*******************************************
+FlowField.h
+
+Shared flow fields towards goals
+********************************************/
+
+#pragma once
+
+#include <vector>
+#include <map>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+
+namespace gen
+{
+
+	// Flow fields on the navigation grid. Each goal (a crate, a patrol point) has one field
+	// holding, for every cell, the direction of the cheapest route to the goal. Any number of tanks
+	// heading to the same goal read their direction from the field in constant time instead of
+	// each finding a path. A field is built outward from the goal over several frames, within a
+	// per-frame budget of cells, and is only rebuilt when its goal moves to another cell. Fields
+	// that haven't been read for a while are discarded
+	class CFlowFields
+	{
+		/////////////////////////////////////
+		//	Constructors/Destructors
+	public:
+		// Constructor takes the number of cells to process per frame over all fields and the
+		// number of frames a field is kept without being read
+		CFlowFields(TUInt32 cellsPerFrame = 32768, TUInt32 fieldLifetime = 300);
+
+		// Destructor releases the fields
+		~CFlowFields();
+
+	private:
+		// Disallow use of copy constructor and assignment operator (private and not defined)
+		CFlowFields(const CFlowFields&);
+		CFlowFields& operator=(const CFlowFields&);
+
+
+		/////////////////////////////////////
+		//	Public interface
+	public:
+
+		// Call once per frame before the entity updates - discards unused fields and extends the
+		// fields still being built. Fields are restarted if the navigation grid has changed
+		void Update();
+
+		// Get the direction (unit vector on the XZ plane) to move from the given position towards
+		// a goal. The goal is identified by a key chosen by the caller (e.g. the crate's UID) so
+		// its field can be found again after the goal moves. Returns false if the field hasn't
+		// reached the position yet, the position is at the goal, or the goal can't be reached
+		bool GetDirection(TUInt32 goalKey, const CVector3& goal, const CVector3& position,
+		                  CVector3& direction);
+
+		// Return the number of fields held / the number of cells processed last frame
+		TUInt32 GetNumFields()
+		{
+			return static_cast<TUInt32>(m_Fields.size());
+		}
+		TUInt32 GetFrameCells()
+		{
+			return m_FrameCells;
+		}
+
+		// Return the number of times a field has been (re)started since creation
+		TUInt32 GetNumBuilds()
+		{
+			return m_NumBuilds;
+		}
+
+
+		/////////////////////////////////////
+		//	Private interface
+	private:
+
+		// Cell on the open list of a field being built
+		struct SOpenCell
+		{
+			TFloat32 cost;
+			TUInt32  cell;
+			bool operator<(const SOpenCell& other) const
+			{
+				return cost > other.cost; // Lowest cost at the top of the heap
+			}
+		};
+
+		// Flow field for one goal
+		struct SFlowField
+		{
+			TInt32            goalCell;   // Cell the field leads to, -1 if the goal is off the grid
+			vector<TFloat32>  cost;       // Cost to reach the goal from each cell
+			vector<TUInt8>    directions; // Step towards the goal from each cell, kUnreached if not yet reached
+			vector<SOpenCell> open;       // Cells waiting to be expanded, empty when the field is complete
+			TUInt32           lastUsed;   // Frame the field was last read
+		};
+		typedef map<TUInt32, SFlowField*> TFlowFields;
+		typedef TFlowFields::iterator TFlowFieldIter;
+
+		// Start building a field outwards from its goal cell
+		void Restart(SFlowField* field, TInt32 goalCell);
+
+		// Expand up to the given number of cells of a field, returns the number expanded
+		TUInt32 Extend(SFlowField* field, TUInt32 maxCells);
+
+
+		TFlowFields m_Fields;
+
+		TUInt32 m_CellsPerFrame;
+		TUInt32 m_FieldLifetime;
+		TUInt32 m_Frame;
+		TUInt32 m_GridGeneration; // Navigation grid generation the fields were built for
+
+		// Statistics
+		TUInt32 m_FrameCells;
+		TUInt32 m_NumBuilds;
+	};
+
+
+} // namespace gen
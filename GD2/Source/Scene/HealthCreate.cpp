@@ -6,15 +6,15 @@
 namespace gen
 {
 
-	// Reference to entity manager from TankAssignment.cpp, allows look up of entities by name, UID etc.
+	// Reference to entity manager from Simulation.cpp, allows look up of entities by name, UID etc.
 	// Can then access other entity's data. See the CEntityManager.h file for functions. Example:
 	//    CVector3 targetPos = EntityManager.GetEntity( targetUID )->GetMatrix().Position();
-	extern CEntityManager EntityManager;
+	extern thread_local CEntityManager EntityManager;
 
 	// Messenger class for sending messages to and between entities
-	extern CMessenger Messenger;
+	extern thread_local CMessenger Messenger;
 
-	// Helper function made available from TankAssignment.cpp - gets UID of tank A (team 0) or B (team 1).
+	// Helper function made available from Simulation.cpp - gets UID of tank A (team 0) or B (team 1).
 	// Will be needed to implement the required shell behaviour in the Update function below
 	extern TEntityUID GetTankUID(int team);
 
@@ -46,6 +46,16 @@ namespace gen
 
 	bool HealthCreate::Update(TFloat32 updateTime)
 	{
+		/* The crate is removed when the expiry message it sent itself on landing arrives */
+		SMessage msg;
+		while (Messenger.FetchMessage(GetUID(), &msg))
+		{
+			if (msg.type == Msg_Expire)
+			{
+				return false;
+			}
+		}
+
 		if (PickedUp != true)
 		{
 			Matrix().RotateLocalY(2 * updateTime);
@@ -55,10 +65,18 @@ namespace gen
 			}
 			else
 			{
-				Grounded = true;
+				if (Grounded == false)
+				{
+					msg.type = Msg_Expire;
+					msg.from = GetUID();
+					Messenger.SendMessageAfter(GetUID(), msg, DeathTimer);
+					Grounded = true;
+				}
 				if (Grounded == true)
 				{
 					SMessage msg;
+					SPickupPayload pickup;
+					pickup.pickup = GetUID();
 					EntityManager.BeginEnumEntities("", "", "Tank");
 					CEntity* entity = EntityManager.EnumEntity();
 					while (entity != 0)
@@ -67,19 +85,11 @@ namespace gen
 						//TanksUIDs[i] = UID;
 						msg.type = Msg_Health;
 						msg.from = SystemUID;
+						msg.SetPayload(pickup);
 						Messenger.SendMessage(UID, msg);
 						entity = EntityManager.EnumEntity();
 					}
 					EntityManager.EndEnumEntities();
-
-					if (DeathTimer < 0)
-					{
-						return false;
-					}
-					else
-					{
-						DeathTimer -= updateTime;
-					}
 				}
 			}
 		}
@@ -46,7 +46,7 @@ namespace gen
 		// Return false if the entity is to be destroyed
 		// Keep as a virtual function in case of further derivation
 		virtual bool Update(TFloat32 updateTime);
-		float DeathTimer = 5.0f;
+		float DeathTimer = 5.0f; // Time on the ground before the crate expires
 		bool PickedUp = false;
 		bool Grounded = false;
 		/////////////////////////////////////
@@ -0,0 +1,176 @@
+/*******************************************
+	LineOfSight.cpp
+
+	Line of sight tests against scenery
+	occluders
+********************************************/
+
+#include <xmmintrin.h> // SSE intrinsics
+
+#include "LineOfSight.h"
+#include "EntityManager.h"
+
+namespace gen
+{
+
+// Entity manager holding the occluder entities
+extern thread_local CEntityManager EntityManager;
+
+// Coordinate used for the padding boxes - far enough away that no segment can reach them
+const TFloat32 kUnreachable = 1e30f;
+
+
+/////////////////////////////////////
+// Occluders
+
+// Build the occluder set from all entities using the given template (e.g. "Building"). Each
+// occluder's box is its mesh bounds transformed into world space
+void CLineOfSight::BuildOccluders( const string& templateName )
+{
+	m_OccluderUIDs.clear();
+	EntityManager.BeginEnumEntities( "", templateName );
+	CEntity* entity = EntityManager.EnumEntity();
+	while (entity != 0)
+	{
+		m_OccluderUIDs.push_back( entity->GetUID() );
+		entity = EntityManager.EnumEntity();
+	}
+	EntityManager.EndEnumEntities();
+
+	// Round box arrays up to a multiple of four, filling with unreachable boxes
+	TUInt32 numBoxes = (static_cast<TUInt32>(m_OccluderUIDs.size()) + 3) & ~3u;
+	m_MinX.assign( numBoxes, kUnreachable );
+	m_MinY.assign( numBoxes, kUnreachable );
+	m_MinZ.assign( numBoxes, kUnreachable );
+	m_MaxX.assign( numBoxes, kUnreachable );
+	m_MaxY.assign( numBoxes, kUnreachable );
+	m_MaxZ.assign( numBoxes, kUnreachable );
+
+	for (TUInt32 occluder = 0; occluder < m_OccluderUIDs.size(); ++occluder)
+	{
+		SetOccluderBox( occluder, EntityManager.GetEntity( m_OccluderUIDs[occluder] ) );
+	}
+	++m_Generation;
+}
+
+// Update the box for the given entity after it has moved. Does nothing if the entity is not an
+// occluder
+void CLineOfSight::OccluderMoved( TEntityUID uid )
+{
+	for (TUInt32 occluder = 0; occluder < m_OccluderUIDs.size(); ++occluder)
+	{
+		if (m_OccluderUIDs[occluder] == uid)
+		{
+			SetOccluderBox( occluder, EntityManager.GetEntity( uid ) );
+			++m_Generation;
+			return;
+		}
+	}
+}
+
+// Set the box at the given index from the given entity's mesh bounds and world matrix
+void CLineOfSight::SetOccluderBox( TUInt32 occluder, CEntity* entity )
+{
+	if (!entity)
+	{
+		// Entity has gone, leave an unreachable box in its place
+		m_MinX[occluder] = m_MinY[occluder] = m_MinZ[occluder] = kUnreachable;
+		m_MaxX[occluder] = m_MaxY[occluder] = m_MaxZ[occluder] = kUnreachable;
+		return;
+	}
+
+	// Transform the eight corners of the mesh bounds into world space and take their extent
+	const CVector3& meshMin = entity->Template()->Mesh()->MinBounds();
+	const CVector3& meshMax = entity->Template()->Mesh()->MaxBounds();
+	CVector3 worldMin, worldMax;
+	for (TUInt32 corner = 0; corner < 8; ++corner)
+	{
+		CVector3 point( (corner & 1) ? meshMax.x : meshMin.x,
+		                (corner & 2) ? meshMax.y : meshMin.y,
+		                (corner & 4) ? meshMax.z : meshMin.z );
+		point = entity->Matrix().TransformPoint( point );
+		if (corner == 0)
+		{
+			worldMin = worldMax = point;
+		}
+		else
+		{
+			worldMin = CVector3( Min( worldMin.x, point.x ), Min( worldMin.y, point.y ), Min( worldMin.z, point.z ) );
+			worldMax = CVector3( Max( worldMax.x, point.x ), Max( worldMax.y, point.y ), Max( worldMax.z, point.z ) );
+		}
+	}
+
+	m_MinX[occluder] = worldMin.x;
+	m_MinY[occluder] = worldMin.y;
+	m_MinZ[occluder] = worldMin.z;
+	m_MaxX[occluder] = worldMax.x;
+	m_MaxY[occluder] = worldMax.y;
+	m_MaxZ[occluder] = worldMax.z;
+}
+
+
+/////////////////////////////////////
+// Queries
+
+// Return true if the segment between the two points is blocked by an occluder
+bool CLineOfSight::IsBlocked( const CVector3& from, const CVector3& to )
+{
+	return SegmentBlocked( from, to );
+}
+
+// Test a batch of segments, setting the result in each query
+void CLineOfSight::TestSegments( SSightQuery* queries, TUInt32 numQueries )
+{
+	for (TUInt32 query = 0; query < numQueries; ++query)
+	{
+		queries[query].blocked = SegmentBlocked( queries[query].from, queries[query].to );
+	}
+}
+
+// Test one segment against all boxes, four at a time. Uses the slab test: on each axis find the
+// range of the segment parameter t (0 to 1) lying between the box's two planes. The segment hits
+// the box if the ranges for all three axes overlap
+bool CLineOfSight::SegmentBlocked( const CVector3& from, const CVector3& to )
+{
+	// Reciprocal of segment direction. Zero components are replaced by a tiny value so the
+	// division gives a huge (but finite) result rather than infinity, which could produce NaNs
+	CVector3 dir = to - from;
+	const TFloat32 kTiny = 1e-30f;
+	__m128 invDirX = _mm_set1_ps( 1.0f / (dir.x != 0.0f ? dir.x : kTiny) );
+	__m128 invDirY = _mm_set1_ps( 1.0f / (dir.y != 0.0f ? dir.y : kTiny) );
+	__m128 invDirZ = _mm_set1_ps( 1.0f / (dir.z != 0.0f ? dir.z : kTiny) );
+	__m128 fromX = _mm_set1_ps( from.x );
+	__m128 fromY = _mm_set1_ps( from.y );
+	__m128 fromZ = _mm_set1_ps( from.z );
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps( 1.0f );
+
+	TUInt32 numBoxes = static_cast<TUInt32>(m_MinX.size());
+	for (TUInt32 box = 0; box < numBoxes; box += 4)
+	{
+		__m128 t1 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( &m_MinX[box] ), fromX ), invDirX );
+		__m128 t2 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( &m_MaxX[box] ), fromX ), invDirX );
+		__m128 tNear = _mm_max_ps( zero, _mm_min_ps( t1, t2 ) );
+		__m128 tFar  = _mm_min_ps( one,  _mm_max_ps( t1, t2 ) );
+
+		t1 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( &m_MinY[box] ), fromY ), invDirY );
+		t2 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( &m_MaxY[box] ), fromY ), invDirY );
+		tNear = _mm_max_ps( tNear, _mm_min_ps( t1, t2 ) );
+		tFar  = _mm_min_ps( tFar,  _mm_max_ps( t1, t2 ) );
+
+		t1 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( &m_MinZ[box] ), fromZ ), invDirZ );
+		t2 = _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( &m_MaxZ[box] ), fromZ ), invDirZ );
+		tNear = _mm_max_ps( tNear, _mm_min_ps( t1, t2 ) );
+		tFar  = _mm_min_ps( tFar,  _mm_max_ps( t1, t2 ) );
+
+		// Any of the four boxes hit?
+		if (_mm_movemask_ps( _mm_cmple_ps( tNear, tFar ) ))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+} // namespace gen
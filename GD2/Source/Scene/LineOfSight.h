@@ -0,0 +1,115 @@
+/*******************************************
+LineOfSight.h
+
+Line of sight tests against scenery occluders
+********************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "Entity.h"
+
+namespace gen
+{
+
+	// A line of sight query, a segment between two points. The result is filled in by the query
+	struct SSightQuery
+	{
+		CVector3 from;
+		CVector3 to;
+		bool     blocked; // Result - true if an occluder blocks the segment
+	};
+
+
+	// Line of sight service. Holds an axis aligned box for each occluder (e.g. building) in the
+	// scene, built once from the occluders' mesh bounds, and tests segments against them. The
+	// boxes are stored as separate arrays of each coordinate (structure of arrays) so four boxes
+	// can be tested against a segment at once with SSE
+	class CLineOfSight
+	{
+		/////////////////////////////////////
+		//	Constructors/Destructors
+	public:
+		// Default constructor, no occluders
+		CLineOfSight()
+		{
+			m_Generation = 0;
+		}
+
+		// No destructor needed
+
+	private:
+		// Disallow use of copy constructor and assignment operator (private and not defined)
+		CLineOfSight(const CLineOfSight&);
+		CLineOfSight& operator=(const CLineOfSight&);
+
+
+		/////////////////////////////////////
+		//	Public interface
+	public:
+
+		/////////////////////////////////////
+		// Occluders
+
+		// Build the occluder set from all entities using the given template (e.g. "Building").
+		// Each occluder's box is its mesh bounds transformed into world space
+		void BuildOccluders(const string& templateName);
+
+		// Update the box for the given entity after it has moved. Does nothing if the entity is
+		// not an occluder
+		void OccluderMoved(TEntityUID uid);
+
+		// Return the number of occluders
+		TUInt32 GetNumOccluders()
+		{
+			return static_cast<TUInt32>(m_OccluderUIDs.size());
+		}
+
+		// Return a counter that changes whenever the occluders change, so cached results can be
+		// checked for validity
+		TUInt32 GetGeneration()
+		{
+			return m_Generation;
+		}
+
+
+		/////////////////////////////////////
+		// Queries
+
+		// Return true if the segment between the two points is blocked by an occluder
+		bool IsBlocked(const CVector3& from, const CVector3& to);
+
+		// Test a batch of segments, setting the result in each query
+		void TestSegments(SSightQuery* queries, TUInt32 numQueries);
+
+
+		/////////////////////////////////////
+		//	Private interface
+	private:
+
+		// Set the box at the given index from the given entity's mesh bounds and world matrix
+		void SetOccluderBox(TUInt32 occluder, CEntity* entity);
+
+		// Test one segment against all boxes, four at a time
+		bool SegmentBlocked(const CVector3& from, const CVector3& to);
+
+
+		// Entity UID for each occluder, box arrays are in the same order
+		vector<TEntityUID> m_OccluderUIDs;
+
+		// Box minimum and maximum coordinates. Padded to a multiple of four with boxes that can't
+		// be hit so the SSE loop needs no special case for the remainder
+		vector<TFloat32> m_MinX, m_MinY, m_MinZ;
+		vector<TFloat32> m_MaxX, m_MaxY, m_MaxZ;
+
+		// Incremented each time the occluders change
+		TUInt32 m_Generation;
+	};
+
+
+} // namespace gen
@@ -4,6 +4,9 @@
 	Entity messenger class implementation
 ********************************************/
 
+#include <algorithm>
+using namespace std;
+
 #include "Messenger.h"
 
 namespace gen
@@ -12,19 +15,160 @@ namespace gen
 /////////////////////////////////////
 // Global variables
 
-// Define a single messenger object for the program
-CMessenger Messenger;
+// Length of a timing wheel tick, the resolution of timed message delivery
+const TFloat32 CMessenger::kTimerTickLength = 0.01f;
+
+// Message type names used for the statistics file columns, in EMessageType order
+static const char* kMessageTypeNames[NumMessageTypes] =
+{
+	"Go", "Start", "Hit", "Ammo", "Health", "Help", "Stop", "Expire"
+};
+
+
+/////////////////////////////////////
+// Constructors/Destructors
+
+// Default constructor, sets the default coalescing policy for each message type
+CMessenger::CMessenger()
+{
+	for (TUInt32 type = 0; type < NumMessageTypes; ++type)
+	{
+		m_Policies[type] = Policy_Queue;
+	}
+
+	// Crates resend their pick-up message to every tank each frame and a tank only needs to
+	// know the most recent one. Hits from the same shooter can be combined into one message
+	m_Policies[Msg_Ammo] = Policy_LatestWins;
+	m_Policies[Msg_Health] = Policy_LatestWins;
+	m_Policies[Msg_Help] = Policy_LatestWins;
+	m_Policies[Msg_Hit] = Policy_CountMerge;
+
+	m_NumSuppressed = 0;
+
+	// Initialise list of mailboxes and UID hash map
+	m_Mailboxes.reserve( 1024 );
+	m_MailboxUIDMap = new CHashTable<TEntityUID, TUInt32>( 2048, JOneAtATimeHash );
+	m_NumRejected = 0;
+
+	// Send queue starts with just the stub node
+	m_QueueStub.next.store( 0, memory_order_relaxed );
+	m_QueueHead.store( &m_QueueStub, memory_order_relaxed );
+	m_QueueTail = &m_QueueStub;
+
+	// Pool blocks are allocated as they are first needed
+	for (TUInt32 block = 0; block < kMaxNodeBlocks; ++block)
+	{
+		m_NodeBlocks[block].store( 0, memory_order_relaxed );
+	}
+	m_NumPoolNodes.store( 0, memory_order_relaxed );
+
+	m_CurrentTick = 0;
+	m_TickTime = 0.0f;
+
+	// No statistics yet
+	memset( &m_Stats, 0, sizeof(m_Stats) );
+	memset( &m_CurrentStats, 0, sizeof(m_CurrentStats) );
+	for (TUInt32 type = 0; type < NumMessageTypes; ++type)
+	{
+		m_SentCounts[type].store( 0, memory_order_relaxed );
+	}
+	m_Frame.store( 0, memory_order_relaxed );
+	m_LatencyTotal = 0;
+	m_NumTimedPending = 0;
+	m_StatsFile = 0;
+}
+
+// Destructor frees any messages still queued or in mailboxes
+CMessenger::~CMessenger()
+{
+	SQueuedMessage* node;
+	while ((node = PopQueued()) != 0)
+	{
+		if (!node->pooled)
+		{
+			delete node;
+		}
+	}
+	for (TUInt32 block = 0; block < kMaxNodeBlocks; ++block)
+	{
+		delete[] m_NodeBlocks[block].load( memory_order_relaxed );
+	}
+	delete m_MailboxUIDMap;
+	CloseStatsFile();
+}
 
 
 /////////////////////////////////////
 // Message sending/receiving
 
-// Send the given message to a particular UID, does not check if the UID exists
+// Send the given message to a particular UID. Safe to call from any thread with a pointer to this
+// messenger, the message is queued with an atomic add to take a pooled node and a single atomic
+// exchange. If the UID has no open mailbox when the message is delivered, the message is rejected
+// (dropped)
 void CMessenger::SendMessage( TEntityUID to, const SMessage& msg )
 {
-	// Simply insert the UID/message pair into the message map. It will be inserted next
-	// to any other pairs with the same UID
-	m_Messages.insert( UIDMsgPair( to, msg ) );
+	SQueuedMessage* node = GetPoolNode( ClaimPoolNodes( 1 ) );
+	node->to = to;
+	node->msg = msg;
+	node->sendFrame = m_Frame.load( memory_order_relaxed );
+	m_SentCounts[msg.type].fetch_add( 1, memory_order_relaxed );
+	node->deliverTick = 0;
+	PushQueued( node );
+}
+
+// Send the given message to a particular UID, to be delivered once the messenger's clock (see
+// Update) has moved on by the given delay in seconds. Safe to call from any thread with a pointer
+// to this messenger, but not while Update is running
+void CMessenger::SendMessageAfter( TEntityUID to, const SMessage& msg, TFloat32 delay )
+{
+	SQueuedMessage* node = GetPoolNode( ClaimPoolNodes( 1 ) );
+	node->to = to;
+	node->msg = msg;
+	node->sendFrame = m_Frame.load( memory_order_relaxed );
+	m_SentCounts[msg.type].fetch_add( 1, memory_order_relaxed );
+
+	// Count ticks from the start of the current one, rounding up so the message is never
+	// delivered early
+	TFloat32 ticks = ceil( (m_TickTime + delay) / kTimerTickLength );
+	node->deliverTick = ticks > 0.0f ? m_CurrentTick + static_cast<TUInt32>(ticks) : 0;
+	PushQueued( node );
+}
+
+// Send a batch of messages, message i going to UID to[i]. The nodes are taken from the pool with
+// one atomic add, linked up and added to the send queue with a single atomic exchange. Safe to
+// call from any thread with a pointer to this messenger
+void CMessenger::SendMessageBatch( const TEntityUID* to, const SMessage* msgs, TUInt32 numMessages )
+{
+	if (numMessages == 0)
+	{
+		return;
+	}
+
+	TUInt32 frame = m_Frame.load( memory_order_relaxed );
+	TUInt32 firstNode = ClaimPoolNodes( numMessages );
+	SQueuedMessage* first = 0;
+	SQueuedMessage* last = 0;
+	for (TUInt32 message = 0; message < numMessages; ++message)
+	{
+		SQueuedMessage* node = GetPoolNode( firstNode + message );
+		node->next.store( 0, memory_order_relaxed );
+		node->to = to[message];
+		node->msg = msgs[message];
+		node->deliverTick = 0;
+		node->sendFrame = frame;
+		m_SentCounts[msgs[message].type].fetch_add( 1, memory_order_relaxed );
+
+		if (last)
+		{
+			last->next.store( node, memory_order_relaxed );
+		}
+		else
+		{
+			first = node;
+		}
+		last = node;
+	}
+	PushQueuedChain( first, last );
 }
 
 
@@ -32,22 +176,551 @@ void CMessenger::SendMessage( TEntityUID to, const SMessage& msg )
 // pointer. Returns false if there are no messages for this UID
 bool CMessenger::FetchMessage( TEntityUID to, SMessage* msg )
 {
-	// Find the first message for this UID in the message map
-	TMessageIter itMessage = m_Messages.find( to );
+	// Find the mailbox for this UID
+	TUInt32 mailboxIndex;
+	if (!m_MailboxUIDMap->LookUpKey( to, &mailboxIndex ))
+	{
+		return false;
+	}
 
 	// See if no messages for this UID
-	if (itMessage == m_Messages.end())
+	SMailbox& mailbox = m_Mailboxes[mailboxIndex];
+	if (mailbox.next == mailbox.messages.size())
 	{
 		return false;
 	}
 
-	// Return message, then delete it
-	*msg = itMessage->second;
-	m_Messages.erase( itMessage );
+	// Return message, emptying the mailbox once the last message has been fetched
+	*msg = mailbox.messages[mailbox.next];
+	RecordFetches( msg, &mailbox.frames[mailbox.next], 1 );
+	++mailbox.next;
+	if (mailbox.next == mailbox.messages.size())
+	{
+		mailbox.messages.clear();
+		mailbox.frames.clear();
+		mailbox.next = 0;
+	}
+
+	return true;
+}
+
+// Fetch all messages waiting for the given UID as one contiguous batch. Returns a pointer to the
+// first message and the number of messages through the given pointer (0 if none). The messages
+// are released from the mailbox in one go, the batch stays valid until the next Update or until
+// the UID's mailbox is closed
+const SMessage* CMessenger::FetchAll( TEntityUID to, TUInt32* numMessages )
+{
+	*numMessages = 0;
+
+	// Find the mailbox for this UID
+	TUInt32 mailboxIndex;
+	if (!m_MailboxUIDMap->LookUpKey( to, &mailboxIndex ))
+	{
+		return 0;
+	}
+
+	// Hand over everything from the next message on and mark it all as fetched. The storage is
+	// only reused when the next messages are stored, which happens in Update
+	SMailbox& mailbox = m_Mailboxes[mailboxIndex];
+	TUInt32 numWaiting = static_cast<TUInt32>(mailbox.messages.size()) - mailbox.next;
+	if (numWaiting == 0)
+	{
+		return 0;
+	}
+	const SMessage* batch = &mailbox.messages[mailbox.next];
+	RecordFetches( batch, &mailbox.frames[mailbox.next], numWaiting );
+	mailbox.next = static_cast<TUInt32>(mailbox.messages.size());
+	*numMessages = numWaiting;
+	return batch;
+}
+
+
+// Sort predicate for collected messages - by recipient, then by sender
+bool CMessenger::QueuedMessageLess( const SQueuedMessage* a, const SQueuedMessage* b )
+{
+	if (a->to != b->to)
+	{
+		return a->to < b->to;
+	}
+	return a->msg.from < b->msg.from;
+}
+
+// Move all messages queued by SendMessage into the recipients' mailboxes, applying the
+// coalescing policies. Messages are ordered by recipient then sender, with each sender's
+// messages kept in the order they were sent, so the result doesn't depend on the order the
+// senders ran in
+void CMessenger::CollectMessages()
+{
+	SQueuedMessage* node;
+	while ((node = PopQueued()) != 0)
+	{
+		m_Collected.push_back( node );
+	}
+
+	// The queue is FIFO per sender, a stable sort keeps that order within each sender
+	stable_sort( m_Collected.begin(), m_Collected.end(), QueuedMessageLess );
+
+	for (TUInt32 collected = 0; collected < m_Collected.size(); ++collected)
+	{
+		node = m_Collected[collected];
+		if (node->deliverTick <= m_CurrentTick)
+		{
+			StoreMessage( node->to, node->msg, node->sendFrame );
+		}
+		else
+		{
+			STimedMessage timed;
+			timed.deliverTick = node->deliverTick;
+			timed.to = node->to;
+			timed.msg = node->msg;
+			AddTimedMessage( timed );
+		}
+		if (!node->pooled)
+		{
+			delete node;
+		}
+	}
+	m_Collected.clear();
+
+	// Every node has been taken off the queue (only the stub is left in it), so the pool can be
+	// reused from the start. No thread is sending while messages are collected
+	if (m_QueueTail == &m_QueueStub && m_QueueHead.load( memory_order_acquire ) == &m_QueueStub)
+	{
+		m_NumPoolNodes.store( 0, memory_order_relaxed );
+	}
+}
+
+
+/////////////////////////////////////
+// Timing
+
+// Start a new frame: deliver all messages sent during the last frame, then advance the
+// messenger's clock by the given time and deliver any timed messages that have become due
+// Call once per frame from the world's thread, when no other thread is sending
+void CMessenger::Update( TFloat32 updateTime )
+{
+	// Close off the statistics for the frame just finished
+	EndStatsFrame();
+
+	// Deliver last frame's messages - timed ones are put into the wheel before it moves
+	CollectMessages();
+
+	m_TickTime += updateTime;
+	while (m_TickTime >= kTimerTickLength)
+	{
+		m_TickTime -= kTimerTickLength;
+		AdvanceTick();
+	}
+
+	MeasureMailboxes();
+}
+
+// Add a timed message to the wheel, or store it immediately if it is already due
+void CMessenger::AddTimedMessage( const STimedMessage& timed )
+{
+	if (timed.deliverTick <= m_CurrentTick)
+	{
+		StoreMessage( timed.to, timed.msg, m_Frame.load( memory_order_relaxed ) );
+		return;
+	}
+
+	// Find the lowest level whose ring reaches the delivery tick. Messages further away than
+	// the top level can reach wait in its furthest slot and are re-placed when cascaded
+	TUInt32 delta = timed.deliverTick - m_CurrentTick;
+	TUInt32 level = 0;
+	while (level < kTimerLevels - 1 && delta >= (1u << (kTimerSlotBits * (level + 1))))
+	{
+		++level;
+	}
+	TUInt32 tick = timed.deliverTick;
+	if (level == kTimerLevels - 1 && delta >= (1u << (kTimerSlotBits * kTimerLevels)) - 1)
+	{
+		tick = m_CurrentTick + (1u << (kTimerSlotBits * kTimerLevels)) - 1;
+	}
+	TUInt32 slot = (tick >> (kTimerSlotBits * level)) & (kTimerSlots - 1);
+	m_TimerWheel[level][slot].push_back( timed );
+	++m_NumTimedPending;
+}
+
+// Move the wheel on one tick, delivering messages that become due
+void CMessenger::AdvanceTick()
+{
+	++m_CurrentTick;
+
+	// Each time a ring completes a revolution, move the next slot of the ring above down into
+	// the lower levels. Continue upwards while the rings above also complete a revolution
+	for (TUInt32 level = 1; level < kTimerLevels; ++level)
+	{
+		TUInt32 lowerBits = kTimerSlotBits * level;
+		if ((m_CurrentTick & ((1u << lowerBits) - 1)) != 0)
+		{
+			break;
+		}
+
+		TTimerSlot cascade;
+		cascade.swap( m_TimerWheel[level][(m_CurrentTick >> lowerBits) & (kTimerSlots - 1)] );
+		m_NumTimedPending -= static_cast<TUInt32>(cascade.size());
+		for (TUInt32 timed = 0; timed < cascade.size(); ++timed)
+		{
+			AddTimedMessage( cascade[timed] );
+		}
+	}
+
+	// Deliver everything in the current slot of the lowest ring
+	TTimerSlot& due = m_TimerWheel[0][m_CurrentTick & (kTimerSlots - 1)];
+	TUInt32 frame = m_Frame.load( memory_order_relaxed );
+	for (TUInt32 timed = 0; timed < due.size(); ++timed)
+	{
+		StoreMessage( due[timed].to, due[timed].msg, frame );
+	}
+	m_NumTimedPending -= static_cast<TUInt32>(due.size());
+	due.clear();
+}
+
+
+/////////////////////////////////////
+// Send queue
+
+// Claim the given number of nodes from the pool, returning the index of the first - any sending
+// thread. Each node is then found with GetPoolNode
+TUInt32 CMessenger::ClaimPoolNodes( TUInt32 numNodes )
+{
+	return m_NumPoolNodes.fetch_add( numNodes, memory_order_relaxed );
+}
+
+// Return the node with the given pool index, allocating its block if it is the first use. Two
+// threads may race to allocate the same block, the one that loses frees its own
+CMessenger::SQueuedMessage* CMessenger::GetPoolNode( TUInt32 index )
+{
+	TUInt32 block = index >> kNodeBlockBits;
+	if (block >= kMaxNodeBlocks)
+	{
+		SQueuedMessage* node = new SQueuedMessage;
+		node->pooled = false;
+		return node;
+	}
+
+	SQueuedMessage* nodes = m_NodeBlocks[block].load( memory_order_acquire );
+	if (nodes == 0)
+	{
+		SQueuedMessage* newNodes = new SQueuedMessage[kNodeBlockSize];
+		for (TUInt32 node = 0; node < kNodeBlockSize; ++node)
+		{
+			newNodes[node].pooled = true;
+		}
+		if (m_NodeBlocks[block].compare_exchange_strong( nodes, newNodes, memory_order_acq_rel ))
+		{
+			nodes = newNodes;
+		}
+		else
+		{
+			delete[] newNodes;
+		}
+	}
+	return &nodes[index & (kNodeBlockSize - 1)];
+}
+
+// Add a node to the send queue - a single atomic exchange, can be called by any sending thread
+void CMessenger::PushQueued( SQueuedMessage* node )
+{
+	// Swap the node in as the new head, then link the previous head to it. Between these two
+	// steps the consumer sees the queue end at the previous head and waits for the link
+	node->next.store( 0, memory_order_relaxed );
+	SQueuedMessage* prev = m_QueueHead.exchange( node, memory_order_acq_rel );
+	prev->next.store( node, memory_order_release );
+}
+
+// Add a chain of nodes, already linked from first to last, to the send queue in one step. The
+// release store that links the chain in also publishes the links within the chain
+void CMessenger::PushQueuedChain( SQueuedMessage* first, SQueuedMessage* last )
+{
+	last->next.store( 0, memory_order_relaxed );
+	SQueuedMessage* prev = m_QueueHead.exchange( last, memory_order_acq_rel );
+	prev->next.store( first, memory_order_release );
+}
+
+// Take the oldest node from the send queue, consumer thread only. Returns 0 if the queue is
+// empty or the next node is still being linked in by another thread
+CMessenger::SQueuedMessage* CMessenger::PopQueued()
+{
+	SQueuedMessage* tail = m_QueueTail;
+	SQueuedMessage* next = tail->next.load( memory_order_acquire );
+
+	// Skip over the stub node
+	if (tail == &m_QueueStub)
+	{
+		if (next == 0)
+		{
+			return 0;
+		}
+		m_QueueTail = next;
+		tail = next;
+		next = next->next.load( memory_order_acquire );
+	}
+
+	// More than one node in the queue, take the tail
+	if (next != 0)
+	{
+		m_QueueTail = next;
+		return tail;
+	}
+
+	// Tail is the last node linked so far. If it isn't the head, a producer is part way through
+	// a push - leave the rest for the next collection
+	if (tail != m_QueueHead.load( memory_order_acquire ))
+	{
+		return 0;
+	}
+
+	// Put the stub back behind the last node so the last node can be taken
+	PushQueued( &m_QueueStub );
+	next = tail->next.load( memory_order_acquire );
+	if (next != 0)
+	{
+		m_QueueTail = next;
+		return tail;
+	}
+	return 0;
+}
+
+
+/////////////////////////////////////
+// Mailboxes
+
+// Open a mailbox for the given UID so it can receive messages. Called by the entity manager as
+// each entity is created
+void CMessenger::OpenMailbox( TEntityUID uid )
+{
+	TUInt32 mailboxIndex;
+	if (m_MailboxUIDMap->LookUpKey( uid, &mailboxIndex ))
+	{
+		return; // Already open
+	}
+
+	// Add mailbox to the vector and map from UID to its index
+	mailboxIndex = static_cast<TUInt32>(m_Mailboxes.size());
+	m_Mailboxes.push_back( SMailbox() );
+	m_Mailboxes.back().uid = uid;
+	m_Mailboxes.back().next = 0;
+	m_MailboxUIDMap->SetKeyValue( uid, mailboxIndex );
+}
+
+// Close the mailbox for the given UID, freeing any messages still waiting in it. Messages sent
+// to the UID afterwards are rejected. Called by the entity manager as each entity is destroyed
+void CMessenger::CloseMailbox( TEntityUID uid )
+{
+	// Find the vector index of the given UID
+	TUInt32 mailboxIndex;
+	if (!m_MailboxUIDMap->LookUpKey( uid, &mailboxIndex ))
+	{
+		return;
+	}
+	m_MailboxUIDMap->RemoveKey( uid );
+
+	// If not removing the last mailbox, move the last one into this slot and update UID map.
+	// Swapping hands this mailbox's messages to the last slot, freed by the pop_back below
+	if (mailboxIndex != m_Mailboxes.size() - 1)
+	{
+		m_Mailboxes[mailboxIndex].messages.swap( m_Mailboxes.back().messages );
+		m_Mailboxes[mailboxIndex].frames.swap( m_Mailboxes.back().frames );
+		m_Mailboxes[mailboxIndex].uid = m_Mailboxes.back().uid;
+		m_Mailboxes[mailboxIndex].next = m_Mailboxes.back().next;
+		m_MailboxUIDMap->SetKeyValue( m_Mailboxes[mailboxIndex].uid, mailboxIndex );
+	}
+	m_Mailboxes.pop_back();
+}
+
+// Store a message in the given UID's mailbox, merging it as the coalescing policy requires
+// Rejects the message if the UID has no open mailbox. The frame is when the message became
+// deliverable, used to measure delivery latency
+void CMessenger::StoreMessage( TEntityUID to, const SMessage& msg, TUInt32 frame )
+{
+	// Find the mailbox for this UID - recipient may have been destroyed since the message was sent
+	TUInt32 mailboxIndex;
+	if (!m_MailboxUIDMap->LookUpKey( to, &mailboxIndex ))
+	{
+		++m_NumRejected;
+		++m_CurrentStats.rejected;
+		return;
+	}
+	SMailbox& mailbox = m_Mailboxes[mailboxIndex];
+	SMessage newMsg = msg;
 
+	// Reuse the storage of a mailbox whose messages have all been fetched by FetchAll
+	if (mailbox.next != 0 && mailbox.next == mailbox.messages.size())
+	{
+		mailbox.messages.clear();
+		mailbox.frames.clear();
+		mailbox.next = 0;
+	}
+
+	// Look for a message waiting for this UID that the new one makes redundant
+	if (m_Policies[msg.type] != Policy_Queue)
+	{
+		for (TUInt32 waiting = mailbox.next; waiting < mailbox.messages.size(); ++waiting)
+		{
+			SMessage& oldMsg = mailbox.messages[waiting];
+			if (oldMsg.type == msg.type && oldMsg.from == msg.from)
+			{
+				if (m_Policies[msg.type] == Policy_CountMerge &&
+				    newMsg.HasPayload<SDamagePayload>() && oldMsg.HasPayload<SDamagePayload>())
+				{
+					SDamagePayload damage = newMsg.GetPayload<SDamagePayload>();
+					damage.damage += oldMsg.GetPayload<SDamagePayload>().damage;
+					newMsg.SetPayload( damage );
+				}
+
+				// Remove the old message, the new one is added after any others for this UID
+				// below so the order messages are fetched in still reflects the latest send
+				mailbox.messages.erase( mailbox.messages.begin() + waiting );
+				mailbox.frames.erase( mailbox.frames.begin() + waiting );
+				++m_NumSuppressed;
+				++m_CurrentStats.suppressed;
+				break;
+			}
+		}
+	}
+
+	mailbox.messages.push_back( newMsg );
+	mailbox.frames.push_back( frame );
+}
+
+
+/////////////////////////////////////
+// Statistics
+
+// Write the statistics for every frame to the given CSV file, one line per frame, until
+// CloseStatsFile is called. Returns false if the file could not be opened
+bool CMessenger::OpenStatsFile( const string& fileName )
+{
+	CloseStatsFile();
+	m_StatsFile = fopen( fileName.c_str(), "w" );
+	if (!m_StatsFile)
+	{
+		return false;
+	}
+
+	// Column headings
+	fprintf( m_StatsFile, "Frame" );
+	for (TUInt32 type = 0; type < NumMessageTypes; ++type)
+	{
+		fprintf( m_StatsFile, ",Sent%s", kMessageTypeNames[type] );
+	}
+	for (TUInt32 type = 0; type < NumMessageTypes; ++type)
+	{
+		fprintf( m_StatsFile, ",Fetched%s", kMessageTypeNames[type] );
+	}
+	fprintf( m_StatsFile, ",Mailboxes,PeakDepth,AverageDepth,Backlog,TimedPending,Rejected,Suppressed,"
+	                      "AverageLatency,PeakLatency\n" );
 	return true;
 }
 
+// Stop writing statistics to file
+void CMessenger::CloseStatsFile()
+{
+	if (m_StatsFile)
+	{
+		fclose( m_StatsFile );
+		m_StatsFile = 0;
+	}
+}
+
+// Return the number of send queue node blocks allocated so far. The pool grows to the busiest
+// frame's needs and then stays the same size
+TUInt32 CMessenger::GetNumPoolBlocks()
+{
+	TUInt32 numBlocks = 0;
+	while (numBlocks < kMaxNodeBlocks && m_NodeBlocks[numBlocks].load( memory_order_acquire ) != 0)
+	{
+		++numBlocks;
+	}
+	return numBlocks;
+}
+
+// Count fetched messages for the frame statistics
+void CMessenger::RecordFetches( const SMessage* messages, const TUInt32* frames, TUInt32 numMessages )
+{
+	TUInt32 frame = m_Frame.load( memory_order_relaxed );
+	for (TUInt32 message = 0; message < numMessages; ++message)
+	{
+		++m_CurrentStats.fetched[messages[message].type];
+
+		TUInt32 latency = frame - frames[message];
+		m_LatencyTotal += latency;
+		if (latency > m_CurrentStats.peakLatency)
+		{
+			m_CurrentStats.peakLatency = latency;
+		}
+	}
+}
+
+// Complete the statistics for the frame just finished, write them to file if required and start
+// the next frame's
+void CMessenger::EndStatsFrame()
+{
+	m_CurrentStats.frame = m_Frame.load( memory_order_relaxed );
+
+	TUInt32 numFetched = 0;
+	for (TUInt32 type = 0; type < NumMessageTypes; ++type)
+	{
+		m_CurrentStats.sent[type] = m_SentCounts[type].exchange( 0, memory_order_relaxed );
+		numFetched += m_CurrentStats.fetched[type];
+	}
+	m_CurrentStats.averageLatency = numFetched ? static_cast<TFloat32>(m_LatencyTotal) / numFetched : 0.0f;
+
+	// Anything not fetched by now is left over for the next frame
+	m_CurrentStats.backlog = 0;
+	for (TUInt32 mailbox = 0; mailbox < m_Mailboxes.size(); ++mailbox)
+	{
+		const SMailbox& box = m_Mailboxes[mailbox];
+		m_CurrentStats.backlog += static_cast<TUInt32>(box.messages.size()) - box.next;
+	}
+	m_CurrentStats.timedPending = m_NumTimedPending;
+
+	m_Stats = m_CurrentStats;
+	if (m_StatsFile)
+	{
+		fprintf( m_StatsFile, "%u", m_Stats.frame );
+		for (TUInt32 type = 0; type < NumMessageTypes; ++type)
+		{
+			fprintf( m_StatsFile, ",%u", m_Stats.sent[type] );
+		}
+		for (TUInt32 type = 0; type < NumMessageTypes; ++type)
+		{
+			fprintf( m_StatsFile, ",%u", m_Stats.fetched[type] );
+		}
+		fprintf( m_StatsFile, ",%u,%u,%.2f,%u,%u,%u,%u,%.2f,%u\n", m_Stats.numMailboxes, m_Stats.peakMailboxDepth,
+		         m_Stats.averageMailboxDepth, m_Stats.backlog, m_Stats.timedPending, m_Stats.rejected,
+		         m_Stats.suppressed, m_Stats.averageLatency, m_Stats.peakLatency );
+	}
+
+	// Start the next frame
+	memset( &m_CurrentStats, 0, sizeof(m_CurrentStats) );
+	m_LatencyTotal = 0;
+	m_Frame.store( m_Frame.load( memory_order_relaxed ) + 1, memory_order_relaxed );
+}
+
+// Measure the mailboxes after the frame's messages have been delivered
+void CMessenger::MeasureMailboxes()
+{
+	TUInt32 numWaiting = 0;
+	TUInt32 numNonEmpty = 0;
+	for (TUInt32 mailbox = 0; mailbox < m_Mailboxes.size(); ++mailbox)
+	{
+		TUInt32 depth = static_cast<TUInt32>(m_Mailboxes[mailbox].messages.size()) - m_Mailboxes[mailbox].next;
+		if (depth > 0)
+		{
+			numWaiting += depth;
+			++numNonEmpty;
+			if (depth > m_CurrentStats.peakMailboxDepth)
+			{
+				m_CurrentStats.peakMailboxDepth = depth;
+			}
+		}
+	}
+	m_CurrentStats.numMailboxes = static_cast<TUInt32>(m_Mailboxes.size());
+	m_CurrentStats.averageMailboxDepth = numNonEmpty ? static_cast<TFloat32>(numWaiting) / numNonEmpty : 0.0f;
+}
 
 
 } // namespace gen
@@ -6,10 +6,16 @@ Entity messenger class definitions
 
 #pragma once
 
-#include <map>
+#include <vector>
+#include <atomic>
+#include <type_traits>
+#include <string>
+#include <cstdio>
 using namespace std;
 
 #include "Defines.h"
+#include "Error.h"
+#include "CHashTable.h"
 #include "Entity.h"
 
 namespace gen
@@ -28,45 +34,155 @@ namespace gen
 		Msg_Health,
 		Msg_Help,
 		Msg_Stop, // Stop all action
+		Msg_Expire, // Lifetime is over - usually sent to self with a delivery time
+
+		NumMessageTypes // Not a message - the number of message types above
+	};
+
+	// Coalescing policy applied to a message type when it is sent. Redundant messages are merged
+	// into the one already waiting in the recipient's mailbox rather than being stored
+	enum EMessagePolicy
+	{
+		Policy_Queue,      // Store every message (default)
+		Policy_LatestWins, // Keep only the latest message of this type from each sender
+		Policy_CountMerge, // Merge with any waiting message of this type from the same sender,
+		                   // summing the damage carried (SDamagePayload)
+	};
+
+	// Kinds of extra data a message can carry, each matching one of the payload structures below
+	enum EMessagePayload
+	{
+		Payload_None,
+		Payload_Damage,    // SDamagePayload
+		Payload_Position,  // SPositionPayload
+		Payload_Intercept, // SInterceptPayload
+		Payload_Pickup,    // SPickupPayload
+	};
+
+	// Message payloads. Messages are copied as raw bytes, so payloads must be trivially copyable
+	// (plain data, no CVector3 members since it has its own copy constructor) and no larger than
+	// kMessagePayloadSize. Both are checked at compile time by SMessage::SetPayload. Each payload
+	// names its kind so the receiver can check it is reading the right one
+
+	// Damage caused to the recipient, e.g. by a shell hit
+	struct SDamagePayload
+	{
+		static const EMessagePayload kKind = Payload_Damage;
+		TInt32 damage;
+	};
+
+	// A position in the world, e.g. a target to move to
+	struct SPositionPayload
+	{
+		static const EMessagePayload kKind = Payload_Position;
+		TFloat32 position[3];
+	};
+
+	// A predicted intercept - the direction to fire in and the time until the intercept
+	struct SInterceptPayload
+	{
+		static const EMessagePayload kKind = Payload_Intercept;
+		TFloat32 direction[3];
+		TFloat32 time;
+	};
+
+	// A pickup (crate) that is ready to be collected
+	struct SPickupPayload
+	{
+		static const EMessagePayload kKind = Payload_Pickup;
+		TEntityUID pickup;
 	};
 
-	// A message contains a type and the UID that sent it.
-	// The message types for this exercise don't currently require extra data, but it is possible
-	// to use a union to add additional data for new message types (see the space game code)
+	// Space for the payload in each message - chosen so a whole message is 32 bytes
+	const TUInt32 kMessagePayloadSize = 20;
+
+
+	// A message contains a type, the UID that sent it and optionally one typed payload from those
+	// above. The payload is stored in place (no allocation) and the whole message is a fixed
+	// 32 bytes, two to a cache line
 	struct SMessage
 	{
-		// Need to provide copy constructor and assignment operator in case you later add a union to this structure
-		// The compiler does not know which of the union contents are in use so it cannot provide default versions
-		SMessage() {} // Need to explicitly write default constructor when other constructors are provided
-		SMessage(const SMessage& o)
+		SMessage() : payloadKind(Payload_None) {}
+
+		// Store the given payload in the message, replacing any previous payload
+		template <class TPayload>
+		void SetPayload(const TPayload& payload)
+		{
+			static_assert(is_trivially_copyable<TPayload>::value, "Message payloads must be trivially copyable");
+			static_assert(sizeof(TPayload) <= kMessagePayloadSize, "Message payload is too large");
+			payloadKind = TPayload::kKind;
+			memcpy(payloadData, &payload, sizeof(TPayload));
+		}
+
+		// Return true if the message carries a payload of the given type
+		template <class TPayload>
+		bool HasPayload() const
 		{
-			memcpy(this, &o, sizeof(SMessage)); // Use of memcpy is only safe if SMessage is a "POD" type - data
-												// only, no members that need construction. A fair restriction
-												// for messages, but does require programmer care.
+			return payloadKind == TPayload::kKind;
 		}
-		SMessage& operator=(const SMessage& o)
+
+		// Return the payload carried by the message, which must be of the given type
+		template <class TPayload>
+		TPayload GetPayload() const
 		{
-			memcpy(this, &o, sizeof(SMessage)); return *this;
+			GEN_ASSERT_OPT(payloadKind == TPayload::kKind, "Message does not carry this payload");
+			TPayload payload;
+			memcpy(&payload, payloadData, sizeof(TPayload));
+			return payload;
 		}
 
 
 		//*** Message data
-		EMessageType type;
-		TEntityUID   from;
-		int damage;
+		EMessageType    type;
+		TEntityUID      from;
+		EMessagePayload payloadKind;
+		TUInt8          payloadData[kMessagePayloadSize];
+	};
+	static_assert(sizeof(SMessage) == 32, "SMessage should be 32 bytes");
+	static_assert(is_trivially_copyable<SMessage>::value, "SMessage must be trivially copyable");
+
+
+	// Messenger statistics for one frame (the time between two calls to CMessenger::Update)
+	struct SMessengerStats
+	{
+		TUInt32  frame;                    // Frame number, counted by Update
+		TUInt32  sent[NumMessageTypes];    // Messages sent during the frame, by type
+		TUInt32  fetched[NumMessageTypes]; // Messages fetched during the frame, by type
+		TUInt32  numMailboxes;             // Open mailboxes
+		TUInt32  peakMailboxDepth;         // Most messages waiting in one mailbox after delivery
+		TFloat32 averageMailboxDepth;      // Average messages waiting in non-empty mailboxes after delivery
+		TUInt32  backlog;                  // Messages left unfetched in mailboxes at the end of the frame
+		TUInt32  timedPending;             // Timed messages waiting in the wheel at the end of the frame
+		TUInt32  rejected;                 // Messages rejected for having no open mailbox
+		TUInt32  suppressed;               // Messages merged by the coalescing policies
+		TFloat32 averageLatency;           // Average frames from send to fetch for messages fetched in
+		TUInt32  peakLatency;              // the frame, and the longest. Timed messages are measured
+		                                   // from the frame they came due
 	};
 
 
 	// Messenger class allows the sending and receipt of messages between entities - addressed by UID
+	// Each world owns one messenger (see GetWorldMessenger in Simulation.h). Messages may be sent to
+	// it from any thread given a pointer to it - the global Messenger is thread_local and names the
+	// calling thread's own world, so a thread helping with another world's step must send through
+	// that world's pointer. Sent messages are pushed onto a lock-free queue that any number of
+	// threads can push to and only the world's thread takes from, moving them into the recipients'
+	// mailboxes, so fetching and the coalescing settings below must only be used from that thread
+	// Queue nodes come from a pool that is emptied in one go as each frame's messages are delivered,
+	// so once the pool has grown to the busiest frame's needs sending does no allocation
+	// Delivery is double-buffered: the queue collects everything sent during a frame and it is
+	// all delivered together by Update at the start of the next frame. No entity sees a message
+	// in the frame it was sent, whatever order entities are updated in
 	class CMessenger
 	{
 		/////////////////////////////////////
 		//	Constructors/Destructors
 	public:
-		// Default constructor
-		CMessenger() {}
+		// Default constructor, sets the default coalescing policy for each message type
+		CMessenger();
 
-		// No destructor needed
+		// Destructor frees any messages still queued or in mailboxes
+		~CMessenger();
 
 	private:
 		// Disallow use of copy constructor and assignment operator (private and not defined)
@@ -81,28 +197,248 @@ namespace gen
 		/////////////////////////////////////
 		// Message sending/receiving
 
-		// Send the given message to a particular UID, does not check if the UID exists
+		// Send the given message to a particular UID. Safe to call from any thread with a pointer to
+		// this messenger, the message is queued with an atomic add to take a pooled node and a
+		// single atomic exchange. If the UID has no open mailbox when the message is delivered, the
+		// message is rejected (dropped)
 		void SendMessage(TEntityUID to, const SMessage& msg);
 
 		// Fetch the next available message for the given UID, returns the message through the given 
 		// pointer. Returns false if there are no messages for this UID
 		bool FetchMessage(TEntityUID to, SMessage* msg);
 
+		// Fetch all messages waiting for the given UID as one contiguous batch. Returns a pointer
+		// to the first message and the number of messages through the given pointer (0 if none).
+		// The messages are released from the mailbox in one go, the batch stays valid until the
+		// next Update or until the UID's mailbox is closed
+		const SMessage* FetchAll(TEntityUID to, TUInt32* numMessages);
+
+		// Send the given message to a particular UID, to be delivered once the messenger's clock
+		// (see Update) has moved on by the given delay in seconds. Safe to call from any thread with
+		// a pointer to this messenger, but not while Update is running
+		void SendMessageAfter(TEntityUID to, const SMessage& msg, TFloat32 delay);
+
+		// Send a batch of messages, message i going to UID to[i]. The nodes are taken from the pool
+		// with one atomic add, linked up and added to the send queue with a single atomic exchange.
+		// Safe to call from any thread with a pointer to this messenger
+		void SendMessageBatch(const TEntityUID* to, const SMessage* msgs, TUInt32 numMessages);
+
+
+		/////////////////////////////////////
+		// Mailboxes
+
+		// Open a mailbox for the given UID so it can receive messages. Called by the entity
+		// manager as each entity is created
+		void OpenMailbox(TEntityUID uid);
+
+		// Close the mailbox for the given UID, freeing any messages still waiting in it. Messages
+		// sent to the UID afterwards are rejected. Called by the entity manager as each entity is
+		// destroyed
+		void CloseMailbox(TEntityUID uid);
+
+		// Return the number of messages that have been rejected because their recipient had no
+		// open mailbox since the messenger was created
+		TUInt32 GetNumRejected()
+		{
+			return m_NumRejected;
+		}
+
+
+		/////////////////////////////////////
+		// Timing
+
+		// Start a new frame: deliver all messages sent during the last frame, then advance the
+		// messenger's clock by the given time and deliver any timed messages that have become due
+		// Call once per frame from the world's thread, when no other thread is sending
+		void Update(TFloat32 updateTime);
+
+
+		/////////////////////////////////////
+		// Statistics
+
+		// Return the statistics for the last complete frame
+		const SMessengerStats& GetStats()
+		{
+			return m_Stats;
+		}
+
+		// Write the statistics for every frame to the given CSV file, one line per frame, until
+		// CloseStatsFile is called. Returns false if the file could not be opened
+		bool OpenStatsFile(const string& fileName);
+
+		// Stop writing statistics to file
+		void CloseStatsFile();
+
+		// Return true if statistics are being written to file
+		bool IsWritingStats()
+		{
+			return m_StatsFile != 0;
+		}
+
+		// Return the number of send queue node blocks allocated so far. The pool grows to the
+		// busiest frame's needs and then stays the same size
+		TUInt32 GetNumPoolBlocks();
+
+
+		/////////////////////////////////////
+		// Coalescing
+
+		// Set the coalescing policy used when collecting messages of the given type
+		void SetPolicy(EMessageType type, EMessagePolicy policy)
+		{
+			m_Policies[type] = policy;
+		}
+
+		// Return the number of messages that have been merged into an existing message rather
+		// than stored since the messenger was created
+		TUInt32 GetNumSuppressed()
+		{
+			return m_NumSuppressed;
+		}
+
 
 		/////////////////////////////////////
 		//	Private interface
 	private:
 
-		// A multimap has properties similar to a hash map - mapping a key to a value. Here we
-		// have the key as an entity UID and the value as a message for that UID. The stored
-		// key/value pairs in a multimap are sorted by key, which means all the messages for a
-		// particular UID are together. Key look-up is somewhat slower than for a hash map though
-		// Define some types to make usage easier
-		typedef multimap<TEntityUID, SMessage> TMessages;
-		typedef TMessages::iterator TMessageIter;
-		typedef pair<TEntityUID, SMessage> UIDMsgPair; // The type stored by the multimap
+		// A message waiting in the send queue. The queue is an intrusive singly linked list where
+		// producers swap themselves in at the head and the consumer follows next pointers from the
+		// tail (see Dmitry Vyukov's MPSC queue). A dummy stub node keeps the list from emptying
+		struct SQueuedMessage
+		{
+			atomic<SQueuedMessage*> next;
+			TEntityUID              to;
+			SMessage                msg;
+			TUInt32                 deliverTick; // Delivered immediately if already reached
+			TUInt32                 sendFrame;   // Frame number when sent, for statistics
+			bool                    pooled;      // False if allocated because the pool was full
+		};
+
+		// Queue nodes are pooled in blocks. Senders claim nodes by adding to a shared count, and
+		// the count is reset once CollectMessages has taken every node off the queue. A block is
+		// allocated the first time a claim reaches it and then kept, so the claim is wait-free
+		// from then on. Nodes claimed beyond the last block are allocated one at a time instead
+		static const TUInt32 kNodeBlockBits = 12;
+		static const TUInt32 kNodeBlockSize = 1 << kNodeBlockBits;
+		static const TUInt32 kMaxNodeBlocks = 1024;
+
+		// A message waiting in the timing wheel for its delivery tick
+		struct STimedMessage
+		{
+			TUInt32    deliverTick;
+			TEntityUID to;
+			SMessage   msg;
+		};
+		typedef vector<STimedMessage> TTimerSlot;
+
+		// Timed messages are held in a hierarchical timing wheel. Each level is a ring of slots,
+		// a slot on level n covering 64^n ticks. Messages are placed on the lowest level that can
+		// reach their delivery tick and move down a level each time the ring below completes a
+		// revolution, so insertion and expiry are O(1) however many messages are pending
+		static const TUInt32  kTimerLevels = 4;
+		static const TUInt32  kTimerSlotBits = 6;
+		static const TUInt32  kTimerSlots = 1 << kTimerSlotBits;
+		static const TFloat32 kTimerTickLength; // Seconds per tick
+
+
+		// Add a timed message to the wheel, or store it immediately if it is already due
+		void AddTimedMessage(const STimedMessage& timed);
+
+		// Move the wheel on one tick, delivering messages that become due
+		void AdvanceTick();
+
+		// Move all messages queued by SendMessage into the recipients' mailboxes, applying the
+		// coalescing policies. Messages are ordered by recipient then sender, with each sender's
+		// messages kept in the order they were sent, so the result doesn't depend on the order
+		// the senders ran in
+		void CollectMessages();
+
+		// Sort predicate for collected messages - by recipient, then by sender
+		static bool QueuedMessageLess(const SQueuedMessage* a, const SQueuedMessage* b);
+
+		// Claim the given number of nodes from the pool, returning the index of the first - any
+		// sending thread. Each node is then found with GetPoolNode
+		TUInt32 ClaimPoolNodes(TUInt32 numNodes);
+
+		// Return the node with the given pool index, allocating its block if it is the first use
+		SQueuedMessage* GetPoolNode(TUInt32 index);
+
+		// Add a node to the send queue - a single atomic exchange, can be called by any sending
+		// thread
+		void PushQueued(SQueuedMessage* node);
+
+		// Add a chain of nodes, already linked from first to last, to the send queue in one step
+		void PushQueuedChain(SQueuedMessage* first, SQueuedMessage* last);
+
+		// Take the oldest node from the send queue, consumer thread only. Returns 0 if the queue is
+		// empty or the next node is still being linked in by another thread
+		SQueuedMessage* PopQueued();
+
+		// Store a message in the given UID's mailbox, merging it as the coalescing policy requires
+		// Rejects the message if the UID has no open mailbox. The frame is when the message became
+		// deliverable, used to measure delivery latency
+		void StoreMessage(TEntityUID to, const SMessage& msg, TUInt32 frame);
+
+		// Count fetched messages for the frame statistics
+		void RecordFetches(const SMessage* messages, const TUInt32* frames, TUInt32 numMessages);
+
+		// Complete the statistics for the frame just finished, write them to file if required and
+		// start the next frame's
+		void EndStatsFrame();
+
+		// Measure the mailboxes after the frame's messages have been delivered
+		void MeasureMailboxes();
+
+
+		// Send queue - producers push at the head, the consumer pops from the tail
+		atomic<SQueuedMessage*> m_QueueHead;
+		SQueuedMessage*         m_QueueTail;
+		SQueuedMessage          m_QueueStub;
+
+		// Messages taken from the queue by CollectMessages, kept to reuse its capacity
+		vector<SQueuedMessage*> m_Collected;
+
+		// Node pool - blocks of nodes and the number of nodes claimed since the last collection
+		atomic<SQueuedMessage*> m_NodeBlocks[kMaxNodeBlocks];
+		atomic<TUInt32>         m_NumPoolNodes;
+
+		// A mailbox holding the messages waiting for one UID. Messages are added at the back and
+		// fetched from the next index. Once all have been fetched the vector is emptied, keeping
+		// its capacity for the next messages
+		struct SMailbox
+		{
+			TEntityUID       uid;
+			vector<SMessage> messages;
+			vector<TUInt32>  frames; // Frame each message became deliverable, parallel to messages
+			TUInt32          next;   // Index of the next message to fetch
+		};
+
+		// Open mailboxes are held in a vector with a hash map from UID to vector index, in the same
+		// way as the entity manager holds entities. Closing a mailbox moves the last one into its
+		// place, so closing is O(pending messages) and a look-up for a closed UID simply fails
+		vector<SMailbox>                 m_Mailboxes;
+		CHashTable<TEntityUID, TUInt32>* m_MailboxUIDMap;
+		TUInt32                          m_NumRejected;
+
+		// Statistics for the last complete frame and the frame in progress. Sends can come from any
+		// thread so are counted atomically. m_Frame is only written by Update
+		SMessengerStats  m_Stats;
+		SMessengerStats  m_CurrentStats;
+		atomic<TUInt32>  m_SentCounts[NumMessageTypes];
+		atomic<TUInt32>  m_Frame;
+		TUInt64          m_LatencyTotal;
+		TUInt32          m_NumTimedPending;
+		FILE*            m_StatsFile;
+
+		// Timing wheel and the messenger's clock. The clock is kept as a whole number of ticks and
+		// the time into the current tick, so it doesn't lose precision however long it runs
+		TTimerSlot m_TimerWheel[kTimerLevels][kTimerSlots];
+		TUInt32    m_CurrentTick;
+		TFloat32   m_TickTime;
 
-		TMessages m_Messages;
+		// Coalescing policy for each message type and count of messages merged away by them
+		EMessagePolicy m_Policies[NumMessageTypes];
+		TUInt32        m_NumSuppressed;
 	};
 
 
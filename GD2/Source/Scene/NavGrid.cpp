@@ -0,0 +1,450 @@
+/*******************************************
+	NavGrid.cpp
+
+	Navigation grid and path finding
+********************************************/
+
+#include <algorithm>
+
+#include "NavGrid.h"
+#include "EntityManager.h"
+
+namespace gen
+{
+
+// Entity manager holding the ground and obstacle entities
+extern thread_local CEntityManager EntityManager;
+
+// Cost of a diagonal step between cells, a straight step costs 1
+const TFloat32 kDiagonalCost = 1.41421356f;
+
+// Scale on the A* distance estimate to break ties between equal cost paths
+const TFloat32 kTieBreak = 1.001f;
+
+// Largest number of cells on each side of the grid, limits the memory for the grid and each flow
+// field when the area is very large
+const TUInt32 kMaxCellsPerSide = 1024;
+
+
+// Calculate the world space box around an entity's mesh bounds
+static void EntityWorldBounds( CEntity* entity, CVector3& worldMin, CVector3& worldMax )
+{
+	const CVector3& meshMin = entity->Template()->Mesh()->MinBounds();
+	const CVector3& meshMax = entity->Template()->Mesh()->MaxBounds();
+	for (TUInt32 corner = 0; corner < 8; ++corner)
+	{
+		CVector3 point( (corner & 1) ? meshMax.x : meshMin.x,
+		                (corner & 2) ? meshMax.y : meshMin.y,
+		                (corner & 4) ? meshMax.z : meshMin.z );
+		point = entity->Matrix().TransformPoint( point );
+		if (corner == 0)
+		{
+			worldMin = worldMax = point;
+		}
+		else
+		{
+			worldMin = CVector3( Min( worldMin.x, point.x ), Min( worldMin.y, point.y ), Min( worldMin.z, point.z ) );
+			worldMax = CVector3( Max( worldMax.x, point.x ), Max( worldMax.y, point.y ), Max( worldMax.z, point.z ) );
+		}
+	}
+}
+
+
+// Constructor takes the number of A* searches allowed per frame and the most paths to cache
+CNavGrid::CNavGrid( TUInt32 searchesPerFrame /*= 4*/, TUInt32 maxCachedPaths /*= 256*/ )
+{
+	m_MinX = m_MinZ = 0.0f;
+	m_CellSize = 1.0f;
+	m_NumCellsX = m_NumCellsZ = 0;
+	m_NeedsRebuild = false;
+	m_Generation = 0;
+	m_SearchId = 0;
+	m_MaxCachedPaths = maxCachedPaths;
+	m_SearchesPerFrame = searchesPerFrame;
+	m_FrameSearches = 0;
+	m_CacheHits = 0;
+	m_Searches = 0;
+	m_SearchTime = 0.0f;
+}
+
+
+/////////////////////////////////////
+// Grid setup
+
+// Create an empty grid covering the given area on the XZ plane with square cells of the given
+// width. The cells are made wider if the area would need more than kMaxCellsPerSide on a side
+void CNavGrid::Create( const CVector3& areaMin, const CVector3& areaMax, TFloat32 cellSize )
+{
+	TFloat32 sizeX = areaMax.x - areaMin.x;
+	TFloat32 sizeZ = areaMax.z - areaMin.z;
+	m_MinX = areaMin.x;
+	m_MinZ = areaMin.z;
+	m_CellSize = Max( cellSize, Max( sizeX, sizeZ ) / kMaxCellsPerSide );
+	m_NumCellsX = Min( static_cast<TUInt32>(sizeX / m_CellSize) + 1, kMaxCellsPerSide );
+	m_NumCellsZ = Min( static_cast<TUInt32>(sizeZ / m_CellSize) + 1, kMaxCellsPerSide );
+
+	TUInt32 numCells = m_NumCellsX * m_NumCellsZ;
+	m_Blocked.assign( numCells, 0 );
+	m_Regions.assign( numCells, 1 );
+	m_Cost.resize( numCells );
+	m_Parent.resize( numCells );
+	m_SearchIds.assign( numCells, 0 );
+	m_Closed.resize( numCells );
+	m_SearchId = 0;
+
+	m_ObstacleTemplates.clear();
+	m_ObstacleClearances.clear();
+	m_ObstacleUIDs.clear();
+	m_PathCache.clear();
+	m_PathUse.clear();
+	++m_Generation;
+}
+
+// Block the cells under all entities using the given template (e.g. "Building"), expanded by the
+// clearance on each side
+void CNavGrid::AddObstacles( const string& templateName, TFloat32 clearance )
+{
+	m_ObstacleTemplates.push_back( templateName );
+	m_ObstacleClearances.push_back( clearance );
+
+	EntityManager.BeginEnumEntities( "", templateName );
+	CEntity* entity = EntityManager.EnumEntity();
+	while (entity != 0)
+	{
+		m_ObstacleUIDs.push_back( entity->GetUID() );
+		BlockEntity( entity, clearance );
+		entity = EntityManager.EnumEntity();
+	}
+	EntityManager.EndEnumEntities();
+	LabelRegions();
+	++m_Generation;
+	m_PathCache.clear();
+	m_PathUse.clear();
+}
+
+// Block the given cells directly (e.g. for benchmarking on a generated grid). They stay blocked
+// until the grid is rebuilt after an obstacle moves
+void CNavGrid::BlockCells( const vector<TUInt32>& cells )
+{
+	for (TUInt32 cell = 0; cell < cells.size(); ++cell)
+	{
+		m_Blocked[cells[cell]] = 1;
+	}
+	LabelRegions();
+	++m_Generation;
+	m_PathCache.clear();
+	m_PathUse.clear();
+}
+
+// Call when a scenery entity has moved. If it is an obstacle the grid is rebuilt at the start of
+// the next frame and cached paths are discarded
+void CNavGrid::ObstacleMoved( TEntityUID uid )
+{
+	if (find( m_ObstacleUIDs.begin(), m_ObstacleUIDs.end(), uid ) != m_ObstacleUIDs.end())
+	{
+		m_NeedsRebuild = true;
+	}
+}
+
+// Return true if the cell containing the given point is blocked or off the grid
+bool CNavGrid::IsBlocked( const CVector3& point )
+{
+	TInt32 cell = CellFromPoint( point );
+	return cell < 0 || m_Blocked[cell] != 0;
+}
+
+// Re-block all obstacle cells from the current positions of the obstacles
+void CNavGrid::Rebuild()
+{
+	m_Blocked.assign( m_Blocked.size(), 0 );
+	m_ObstacleUIDs.clear();
+	for (TUInt32 obstacles = 0; obstacles < m_ObstacleTemplates.size(); ++obstacles)
+	{
+		EntityManager.BeginEnumEntities( "", m_ObstacleTemplates[obstacles] );
+		CEntity* entity = EntityManager.EnumEntity();
+		while (entity != 0)
+		{
+			m_ObstacleUIDs.push_back( entity->GetUID() );
+			BlockEntity( entity, m_ObstacleClearances[obstacles] );
+			entity = EntityManager.EnumEntity();
+		}
+		EntityManager.EndEnumEntities();
+	}
+	LabelRegions();
+	++m_Generation;
+	m_PathCache.clear();
+	m_PathUse.clear();
+	m_NeedsRebuild = false;
+}
+
+// Block the cells under one entity
+void CNavGrid::BlockEntity( CEntity* entity, TFloat32 clearance )
+{
+	CVector3 worldMin, worldMax;
+	EntityWorldBounds( entity, worldMin, worldMax );
+
+	TInt32 minCellX = static_cast<TInt32>((worldMin.x - clearance - m_MinX) / m_CellSize);
+	TInt32 maxCellX = static_cast<TInt32>((worldMax.x + clearance - m_MinX) / m_CellSize);
+	TInt32 minCellZ = static_cast<TInt32>((worldMin.z - clearance - m_MinZ) / m_CellSize);
+	TInt32 maxCellZ = static_cast<TInt32>((worldMax.z + clearance - m_MinZ) / m_CellSize);
+	minCellX = Max( minCellX, 0 );
+	minCellZ = Max( minCellZ, 0 );
+	maxCellX = Min( maxCellX, static_cast<TInt32>(m_NumCellsX) - 1 );
+	maxCellZ = Min( maxCellZ, static_cast<TInt32>(m_NumCellsZ) - 1 );
+
+	for (TInt32 cellZ = minCellZ; cellZ <= maxCellZ; ++cellZ)
+	{
+		for (TInt32 cellX = minCellX; cellX <= maxCellX; ++cellX)
+		{
+			m_Blocked[cellZ * m_NumCellsX + cellX] = 1;
+		}
+	}
+}
+
+// Number the connected areas of open cells with a flood fill from each unlabelled open cell. As
+// diagonal steps can't cut corners, areas only connect through their edges
+void CNavGrid::LabelRegions()
+{
+	m_Regions.assign( m_Blocked.size(), 0 );
+	TUInt32 region = 0;
+	vector<TUInt32>& stack = m_PathCells;
+	for (TUInt32 seed = 0; seed < m_Blocked.size(); ++seed)
+	{
+		if (m_Blocked[seed] || m_Regions[seed])
+		{
+			continue;
+		}
+		++region;
+		m_Regions[seed] = region;
+		stack.clear();
+		stack.push_back( seed );
+		while (!stack.empty())
+		{
+			TUInt32 cell = stack.back();
+			stack.pop_back();
+			TUInt32 cellX = cell % m_NumCellsX;
+			TUInt32 cellZ = cell / m_NumCellsX;
+			TUInt32 neighbours[4];
+			TUInt32 numNeighbours = 0;
+			if (cellX > 0)               neighbours[numNeighbours++] = cell - 1;
+			if (cellX + 1 < m_NumCellsX) neighbours[numNeighbours++] = cell + 1;
+			if (cellZ > 0)               neighbours[numNeighbours++] = cell - m_NumCellsX;
+			if (cellZ + 1 < m_NumCellsZ) neighbours[numNeighbours++] = cell + m_NumCellsX;
+			for (TUInt32 i = 0; i < numNeighbours; ++i)
+			{
+				if (!m_Blocked[neighbours[i]] && !m_Regions[neighbours[i]])
+				{
+					m_Regions[neighbours[i]] = region;
+					stack.push_back( neighbours[i] );
+				}
+			}
+		}
+	}
+}
+
+// Return the cell index containing a point, or -1 if off the grid
+TInt32 CNavGrid::CellFromPoint( const CVector3& point )
+{
+	TFloat32 x = (point.x - m_MinX) / m_CellSize;
+	TFloat32 z = (point.z - m_MinZ) / m_CellSize;
+	if (x < 0.0f || z < 0.0f || x >= m_NumCellsX || z >= m_NumCellsZ)
+	{
+		return -1;
+	}
+	return static_cast<TInt32>(z) * m_NumCellsX + static_cast<TInt32>(x);
+}
+
+// Return the world position of the centre of a cell
+CVector3 CNavGrid::CellCentre( TUInt32 cell )
+{
+	return CVector3( m_MinX + ((cell % m_NumCellsX) + 0.5f) * m_CellSize, 0.5f,
+	                 m_MinZ + ((cell / m_NumCellsX) + 0.5f) * m_CellSize );
+}
+
+
+/////////////////////////////////////
+// Paths
+
+// Call once per frame before the entity updates - resets the search budget and rebuilds the grid
+// if an obstacle has moved
+void CNavGrid::Update()
+{
+	m_FrameSearches = 0;
+	if (m_NeedsRebuild)
+	{
+		Rebuild();
+	}
+
+	// Keep the cache to its limit by removing the paths that have gone unused longest
+	while (m_PathCache.size() > m_MaxCachedPaths)
+	{
+		m_PathCache.erase( m_PathUse.back() );
+		m_PathUse.pop_back();
+	}
+}
+
+// Find a path between two points. On Path_Found the waypoints are the centres of the cells where
+// the path changes direction, ending with the goal itself
+EPathResult CNavGrid::FindPath( const CVector3& start, const CVector3& goal, vector<CVector3>& waypoints )
+{
+	TInt32 startCell = CellFromPoint( start );
+	TInt32 goalCell = CellFromPoint( goal );
+	if (startCell < 0 || goalCell < 0 || m_Blocked[goalCell])
+	{
+		return Path_None;
+	}
+
+	// A tank may start inside an obstacle's clearance, in which case its area isn't known and the
+	// search decides
+	if (!m_Blocked[startCell] && m_Regions[startCell] != m_Regions[goalCell])
+	{
+		return Path_None;
+	}
+
+	TUInt64 key = (static_cast<TUInt64>(startCell) << 32) | static_cast<TUInt32>(goalCell);
+	TPathCacheIter cached = m_PathCache.find( key );
+	if (cached != m_PathCache.end())
+	{
+		++m_CacheHits;
+		m_PathUse.splice( m_PathUse.begin(), m_PathUse, cached->second.use );
+	}
+	else
+	{
+		if (m_FrameSearches >= m_SearchesPerFrame)
+		{
+			return Path_Pending;
+		}
+		++m_FrameSearches;
+		++m_Searches;
+
+		cached = m_PathCache.insert( TPathCache::value_type( key, SCachedPath() ) ).first;
+		m_PathUse.push_front( key );
+		cached->second.use = m_PathUse.begin();
+		m_SearchTimer.GetLapTime();
+		cached->second.found = Search( startCell, goalCell, cached->second.waypoints );
+		if (!cached->second.found)
+		{
+			cached->second.waypoints.clear();
+		}
+		m_SearchTime += m_SearchTimer.GetLapTime();
+	}
+
+	if (!cached->second.found)
+	{
+		return Path_None;
+	}
+	waypoints = cached->second.waypoints;
+	waypoints.push_back( goal );
+	return Path_Found;
+}
+
+// A* search between two cells, appends the path's turning points to the waypoints. Returns false
+// if there is no path
+bool CNavGrid::Search( TUInt32 startCell, TUInt32 goalCell, vector<CVector3>& waypoints )
+{
+	// Start a new search, clearing the per-cell data only when the id wraps around
+	if (++m_SearchId == 0)
+	{
+		m_SearchIds.assign( m_SearchIds.size(), 0 );
+		m_SearchId = 1;
+	}
+
+	TInt32 goalX = goalCell % m_NumCellsX;
+	TInt32 goalZ = goalCell / m_NumCellsX;
+
+	m_Open.clear();
+	m_SearchIds[startCell] = m_SearchId;
+	m_Cost[startCell] = 0.0f;
+	m_Parent[startCell] = -1;
+	m_Closed[startCell] = 0;
+	SOpenNode startNode = { 0.0f, startCell };
+	m_Open.push_back( startNode );
+
+	while (!m_Open.empty())
+	{
+		pop_heap( m_Open.begin(), m_Open.end() );
+		TUInt32 cell = m_Open.back().cell;
+		m_Open.pop_back();
+		if (m_Closed[cell])
+		{
+			continue; // Already reached more cheaply
+		}
+		m_Closed[cell] = 1;
+
+		if (cell == goalCell)
+		{
+			// Walk back from the goal, keeping the cells where the direction changes
+			m_PathCells.clear();
+			for (TInt32 pathCell = goalCell; pathCell >= 0; pathCell = m_Parent[pathCell])
+			{
+				m_PathCells.push_back( pathCell );
+			}
+			reverse( m_PathCells.begin(), m_PathCells.end() );
+			for (TUInt32 i = 1; i + 1 < m_PathCells.size(); ++i)
+			{
+				TInt32 stepIn = m_PathCells[i] - m_PathCells[i - 1];
+				TInt32 stepOut = m_PathCells[i + 1] - m_PathCells[i];
+				if (stepIn != stepOut)
+				{
+					waypoints.push_back( CellCentre( m_PathCells[i] ) );
+				}
+			}
+			return true;
+		}
+
+		// Visit the eight neighbours. Diagonal steps may not cut the corner of a blocked cell
+		TInt32 cellX = cell % m_NumCellsX;
+		TInt32 cellZ = cell / m_NumCellsX;
+		for (TInt32 dZ = -1; dZ <= 1; ++dZ)
+		{
+			for (TInt32 dX = -1; dX <= 1; ++dX)
+			{
+				TInt32 x = cellX + dX;
+				TInt32 z = cellZ + dZ;
+				if ((dX == 0 && dZ == 0) || x < 0 || z < 0 ||
+				    x >= static_cast<TInt32>(m_NumCellsX) || z >= static_cast<TInt32>(m_NumCellsZ))
+				{
+					continue;
+				}
+				TUInt32 next = z * m_NumCellsX + x;
+				if (m_Blocked[next])
+				{
+					continue;
+				}
+				bool diagonal = (dX != 0 && dZ != 0);
+				if (diagonal && (m_Blocked[cellZ * m_NumCellsX + x] || m_Blocked[z * m_NumCellsX + cellX]))
+				{
+					continue;
+				}
+
+				TFloat32 cost = m_Cost[cell] + (diagonal ? kDiagonalCost : 1.0f);
+				if (m_SearchIds[next] != m_SearchId)
+				{
+					m_SearchIds[next] = m_SearchId;
+					m_Closed[next] = 0;
+				}
+				else if (m_Closed[next] || cost >= m_Cost[next])
+				{
+					continue;
+				}
+				m_Cost[next] = cost;
+				m_Parent[next] = cell;
+
+				// Octile distance to the goal, scaled up very slightly so that among paths of equal
+				// cost those nearer the goal are tried first. This greatly reduces the cells visited
+				// on open ground, for paths at most 0.1% longer than the shortest
+				TInt32 toGoalX = abs( goalX - x );
+				TInt32 toGoalZ = abs( goalZ - z );
+				TFloat32 toGoal = Max( toGoalX, toGoalZ ) + (kDiagonalCost - 1.0f) * Min( toGoalX, toGoalZ );
+				TFloat32 estimate = cost + toGoal * kTieBreak;
+				SOpenNode node = { estimate, next };
+				m_Open.push_back( node );
+				push_heap( m_Open.begin(), m_Open.end() );
+			}
+		}
+	}
+	return false;
+}
+
+
+} // namespace gen
@@ -0,0 +1,226 @@
+/*******************************************
+NavGrid.h
+
+Navigation grid and path finding
+********************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "CTimer.h"
+#include "Entity.h"
+
+namespace gen
+{
+
+	// Result of a path request
+	enum EPathResult
+	{
+		Path_Found,   // Waypoints filled in
+		Path_Pending, // Out of search budget this frame, ask again next frame
+		Path_None,    // No route, or start / goal off the grid
+	};
+
+
+	// Navigation grid. The play area is divided into square cells on the XZ plane, and cells covered
+	// by obstacles (scenery bounds plus a clearance for the tank's size) are marked blocked. Paths
+	// between cells are found with A* and cached by (start cell, goal cell) so tanks asking for the
+	// same route share the result. Only a set number of searches are run each frame; further
+	// requests are told to try again next frame
+	class CNavGrid
+	{
+		/////////////////////////////////////
+		//	Constructors/Destructors
+	public:
+		// Constructor takes the number of A* searches allowed per frame and the most paths to cache
+		CNavGrid(TUInt32 searchesPerFrame = 4, TUInt32 maxCachedPaths = 256);
+
+		// No destructor needed
+
+	private:
+		// Disallow use of copy constructor and assignment operator (private and not defined)
+		CNavGrid(const CNavGrid&);
+		CNavGrid& operator=(const CNavGrid&);
+
+
+		/////////////////////////////////////
+		//	Public interface
+	public:
+
+		/////////////////////////////////////
+		// Grid setup
+
+		// Create an empty grid covering the given area on the XZ plane with square cells of the
+		// given width. The cells are made wider if the area would need more than 1024 cells on a
+		// side
+		void Create(const CVector3& areaMin, const CVector3& areaMax, TFloat32 cellSize);
+
+		// Block the cells under all entities using the given template (e.g. "Building"), expanded
+		// by the clearance on each side
+		void AddObstacles(const string& templateName, TFloat32 clearance);
+
+		// Block the given cells directly (e.g. for benchmarking on a generated grid). They stay
+		// blocked until the grid is rebuilt after an obstacle moves
+		void BlockCells(const vector<TUInt32>& cells);
+
+		// Call when a scenery entity has moved. If it is an obstacle the grid is rebuilt at the
+		// start of the next frame and cached paths are discarded
+		void ObstacleMoved(TEntityUID uid);
+
+		TUInt32 GetNumCellsX()
+		{
+			return m_NumCellsX;
+		}
+		TUInt32 GetNumCellsZ()
+		{
+			return m_NumCellsZ;
+		}
+
+		// Return true if the cell containing the given point is blocked or off the grid
+		bool IsBlocked(const CVector3& point);
+
+		// Return true if the given cell is blocked
+		bool IsCellBlocked(TUInt32 cell)
+		{
+			return m_Blocked[cell] != 0;
+		}
+
+		// Return the cell index containing a point, or -1 if off the grid
+		TInt32 CellFromPoint(const CVector3& point);
+
+		// Return the world position of the centre of a cell
+		CVector3 CellCentre(TUInt32 cell);
+
+		// Return a counter that changes whenever the blocked cells change, so data built from the
+		// grid can be checked for validity
+		TUInt32 GetGeneration()
+		{
+			return m_Generation;
+		}
+
+
+		/////////////////////////////////////
+		// Paths
+
+		// Call once per frame before the entity updates - resets the search budget and rebuilds
+		// the grid if an obstacle has moved
+		void Update();
+
+		// Find a path between two points. On Path_Found the waypoints are the centres of the cells
+		// where the path changes direction, ending with the goal itself
+		EPathResult FindPath(const CVector3& start, const CVector3& goal, vector<CVector3>& waypoints);
+
+
+		/////////////////////////////////////
+		// Statistics
+
+		// Number of path requests answered from the cache / by searching since the grid was made
+		TUInt32 GetCacheHits()
+		{
+			return m_CacheHits;
+		}
+		TUInt32 GetSearches()
+		{
+			return m_Searches;
+		}
+
+		// Average number of A* searches completed per millisecond of search time
+		TFloat32 GetSearchesPerMs()
+		{
+			return m_SearchTime > 0.0f ? m_Searches / (m_SearchTime * 1000.0f) : 0.0f;
+		}
+
+
+		/////////////////////////////////////
+		//	Private interface
+	private:
+
+		// Re-block all obstacle cells from the current positions of the obstacles
+		void Rebuild();
+
+		// Block the cells under one entity
+		void BlockEntity(CEntity* entity, TFloat32 clearance);
+
+		// Number the connected areas of open cells, so requests between areas that can't reach
+		// each other are refused without searching
+		void LabelRegions();
+
+		// A* search between two cells, appends the path's turning points to the waypoints.
+		// Returns false if there is no path
+		bool Search(TUInt32 startCell, TUInt32 goalCell, vector<CVector3>& waypoints);
+
+
+		// Grid extent and cells
+		TFloat32        m_MinX;
+		TFloat32        m_MinZ;
+		TFloat32        m_CellSize;
+		TUInt32         m_NumCellsX;
+		TUInt32         m_NumCellsZ;
+		vector<TUInt8>  m_Blocked;
+		vector<TUInt32> m_Regions; // Connected area for each open cell, 0 for blocked cells
+
+		// Obstacle templates and clearances, kept for rebuilding, and the obstacle entities
+		vector<string>     m_ObstacleTemplates;
+		vector<TFloat32>   m_ObstacleClearances;
+		vector<TEntityUID> m_ObstacleUIDs;
+		bool               m_NeedsRebuild;
+		TUInt32            m_Generation;
+
+		// A* working data per cell. Rather than clearing the arrays for each search, a cell's data
+		// is only valid if its search id matches the current search
+		vector<TFloat32> m_Cost;
+		vector<TInt32>   m_Parent;
+		vector<TUInt32>  m_SearchIds;
+		vector<TUInt8>   m_Closed;
+		TUInt32          m_SearchId;
+
+		// Open list, kept as a heap on estimated total cost
+		struct SOpenNode
+		{
+			TFloat32 estimate;
+			TUInt32  cell;
+			bool operator<(const SOpenNode& other) const
+			{
+				return estimate > other.estimate; // Lowest estimate at the top of the heap
+			}
+		};
+		vector<SOpenNode> m_Open;
+		vector<TUInt32>   m_PathCells;
+
+		// Cached paths keyed on start cell (high 32 bits) and goal cell. The keys are also kept in
+		// a list ordered by use, most recent first, so the path unused longest is removed in
+		// constant time when the cache is full
+		typedef list<TUInt64> TPathUseList;
+		typedef TPathUseList::iterator TPathUseIter;
+		struct SCachedPath
+		{
+			vector<CVector3> waypoints;
+			bool             found; // False if there is no route - a straight route has no waypoints
+			TPathUseIter     use;   // Position in the use list
+		};
+		typedef map<TUInt64, SCachedPath> TPathCache;
+		typedef TPathCache::iterator TPathCacheIter;
+		TPathCache   m_PathCache;
+		TPathUseList m_PathUse;
+		TUInt32      m_MaxCachedPaths;
+
+		// Per-frame search budget
+		TUInt32 m_SearchesPerFrame;
+		TUInt32 m_FrameSearches;
+
+		// Statistics
+		TUInt32  m_CacheHits;
+		TUInt32  m_Searches;
+		TFloat32 m_SearchTime;
+		CTimer   m_SearchTimer;
+	};
+
+
+} // namespace gen
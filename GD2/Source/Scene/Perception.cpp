@@ -0,0 +1,404 @@
+/*******************************************
+	Perception.cpp
+
+	Per-frame tank visibility
+********************************************/
+
+#include <algorithm>
+using namespace std;
+
+#include "Perception.h"
+#include "EntityManager.h"
+
+namespace gen
+{
+
+// Entity manager holding the tanks
+extern thread_local CEntityManager EntityManager;
+
+// Line of sight tests against the buildings
+extern thread_local CLineOfSight LineOfSight;
+
+
+// Largest number of cells on each side of the grid, limits memory use when tanks are far apart
+const TInt32 kMaxCellsPerSide = 256;
+
+
+/////////////////////////////////////
+// Constructors/Destructors
+
+// Constructor takes the half-angle of the turret cone in degrees and the distance beyond which
+// tanks can't see each other
+CPerception::CPerception( TFloat32 coneAngle /*= 15.0f*/, TFloat32 viewRange /*= 250.0f*/ )
+{
+	m_CosConeAngle = Cos( ToRadians( coneAngle ) );
+	m_ViewRange = viewRange;
+	m_CellSize = viewRange;
+	m_GridMinX = 0.0f;
+	m_GridMinZ = 0.0f;
+	m_NumCellsX = 0;
+	m_NumCellsZ = 0;
+
+	// Tanks move a few centimetres a frame, so line of sight is rarely worth recalculating
+	// before they have moved half a unit
+	m_CacheMoveDistance = 0.5f;
+	m_CacheTimeout = 0.5f;
+	m_Time = 0.0f;
+	m_Frame = 0;
+
+	m_CacheHits = 0;
+	m_CacheMisses = 0;
+	m_FrameCacheHits = 0;
+	m_FrameCacheMisses = 0;
+}
+
+
+/////////////////////////////////////
+// Public interface
+
+// Gather the live tanks and build the sighting lists. Call once per frame before the entity
+// updates, passing the time since the last update
+void CPerception::Update( TFloat32 updateTime )
+{
+	m_Time += updateTime;
+	++m_Frame;
+	m_FrameCacheHits = 0;
+	m_FrameCacheMisses = 0;
+
+	// Gather live tanks, sorted by UID for look-up
+	m_TankUIDs.clear();
+	EntityManager.BeginEnumEntities( "", "", "Tank" );
+	CEntity* entity = EntityManager.EnumEntity();
+	while (entity != 0)
+	{
+		CTankEntity* tank = static_cast<CTankEntity*>(entity);
+		if (tank->m_State != CTankEntity::Dead)
+		{
+			m_TankUIDs.push_back( tank->GetUID() );
+		}
+		entity = EntityManager.EnumEntity();
+	}
+	EntityManager.EndEnumEntities();
+	sort( m_TankUIDs.begin(), m_TankUIDs.end() );
+
+	TUInt32 numTanks = static_cast<TUInt32>(m_TankUIDs.size());
+	m_Teams.resize( numTanks );
+	m_Positions.resize( numTanks );
+	m_Facings.resize( numTanks );
+	for (TUInt32 tank = 0; tank < numTanks; ++tank)
+	{
+		CTankEntity* tankEntity = static_cast<CTankEntity*>(EntityManager.GetEntity( m_TankUIDs[tank] ));
+		CMatrix4x4 turretMatrix = tankEntity->Matrix( 2 ) * tankEntity->Matrix();
+		m_Teams[tank] = tankEntity->GetTeam();
+		m_Positions[tank] = turretMatrix.Position();
+		m_Facings[tank] = Normalise( turretMatrix.ZAxis() );
+	}
+	BinTanks();
+
+	// Line of sight look-up for each unordered pair of opponents in range - line of sight is the
+	// same in both directions. Cells are at least the view range wide, so any tank in range is
+	// in the same or a neighbouring cell
+	m_SightPairs.clear();
+	m_SightQueries.clear();
+	m_QueryObservers.clear();
+	m_QueryTargets.clear();
+	m_QueryEntries.clear();
+	m_FrameSights.clear();
+	TUInt32 generation = LineOfSight.GetGeneration();
+	TFloat32 moveDistanceSquared = m_CacheMoveDistance * m_CacheMoveDistance;
+	TFloat32 viewRangeSquared = m_ViewRange * m_ViewRange;
+	for (TUInt32 observer = 0; observer < numTanks; ++observer)
+	{
+		TInt32 observerCellX = m_TankCells[observer] % m_NumCellsX;
+		TInt32 observerCellZ = m_TankCells[observer] / m_NumCellsX;
+		for (TInt32 cellZ = Max( observerCellZ - 1, 0 ); cellZ <= Min( observerCellZ + 1, m_NumCellsZ - 1 ); ++cellZ)
+		{
+			for (TInt32 cellX = Max( observerCellX - 1, 0 ); cellX <= Min( observerCellX + 1, m_NumCellsX - 1 ); ++cellX)
+			{
+				TUInt32 cell = cellZ * m_NumCellsX + cellX;
+				for (TUInt32 cellTank = m_CellStart[cell]; cellTank < m_CellStart[cell + 1]; ++cellTank)
+				{
+					// Tank indices are sorted by UID so the observer has the lower UID here
+					TUInt32 target = m_CellTanks[cellTank];
+					if (target <= observer || m_Teams[observer] == m_Teams[target] ||
+					    DistanceSquared( m_Positions[observer], m_Positions[target] ) > viewRangeSquared)
+					{
+						continue;
+					}
+
+					// Reuse the cached result if it is still valid, carrying it over to this frame
+					TUInt64 key = (static_cast<TUInt64>(m_TankUIDs[observer]) << 32) | m_TankUIDs[target];
+					const SSightCacheEntry* cached = FindCachedSight( key );
+					if (cached != 0 && cached->generation == generation && m_Time - cached->time < m_CacheTimeout &&
+					    DistanceSquared( cached->from, m_Positions[observer] ) <= moveDistanceSquared &&
+					    DistanceSquared( cached->to, m_Positions[target] ) <= moveDistanceSquared)
+					{
+						++m_FrameCacheHits;
+						m_FrameSights.push_back( *cached );
+						if (!cached->blocked)
+						{
+							AddSightPair( observer, target );
+						}
+						continue;
+					}
+
+					// Otherwise queue a query and record the state it is for
+					++m_FrameCacheMisses;
+					SSightCacheEntry entry;
+					entry.key = key;
+					entry.from = m_Positions[observer];
+					entry.to = m_Positions[target];
+					entry.time = m_Time;
+					entry.generation = generation;
+					entry.blocked = false;
+					m_QueryEntries.push_back( static_cast<TUInt32>(m_FrameSights.size()) );
+					m_FrameSights.push_back( entry );
+
+					SSightQuery query;
+					query.from = m_Positions[observer];
+					query.to = m_Positions[target];
+					m_SightQueries.push_back( query );
+					m_QueryObservers.push_back( observer );
+					m_QueryTargets.push_back( target );
+				}
+			}
+		}
+	}
+
+	// All tank pair lines of sight in one batch
+	if (!m_SightQueries.empty())
+	{
+		LineOfSight.TestSegments( &m_SightQueries[0], static_cast<TUInt32>(m_SightQueries.size()) );
+	}
+	for (TUInt32 query = 0; query < m_SightQueries.size(); ++query)
+	{
+		m_FrameSights[m_QueryEntries[query]].blocked = m_SightQueries[query].blocked;
+		if (!m_SightQueries[query].blocked)
+		{
+			AddSightPair( m_QueryObservers[query], m_QueryTargets[query] );
+		}
+	}
+
+	// Share the pairs out into each observer's sightings - count them, then fill each observer's
+	// range and sort it by target for look-up
+	m_FirstSighting.assign( numTanks + 1, 0 );
+	for (TUInt32 pair = 0; pair < m_SightPairs.size(); ++pair)
+	{
+		++m_FirstSighting[m_SightPairs[pair].first + 1];
+		++m_FirstSighting[m_SightPairs[pair].second + 1];
+	}
+	for (TUInt32 tank = 0; tank < numTanks; ++tank)
+	{
+		m_FirstSighting[tank + 1] += m_FirstSighting[tank];
+	}
+	m_CellFill.assign( m_FirstSighting.begin(), m_FirstSighting.end() - 1 );
+	m_Sightings.resize( m_FirstSighting[numTanks] );
+	for (TUInt32 pair = 0; pair < m_SightPairs.size(); ++pair)
+	{
+		const SSightPair& sightPair = m_SightPairs[pair];
+		SSighting& firstSighting = m_Sightings[m_CellFill[sightPair.first]++];
+		firstSighting.target = m_TankUIDs[sightPair.second];
+		firstSighting.inCone = sightPair.firstSeesSecond;
+		SSighting& secondSighting = m_Sightings[m_CellFill[sightPair.second]++];
+		secondSighting.target = m_TankUIDs[sightPair.first];
+		secondSighting.inCone = sightPair.secondSeesFirst;
+	}
+	for (TUInt32 tank = 0; tank < numTanks; ++tank)
+	{
+		sort( m_Sightings.begin() + m_FirstSighting[tank], m_Sightings.begin() + m_FirstSighting[tank + 1], SightingLess );
+	}
+
+	StoreCachedSights();
+
+	m_CacheHits += m_FrameCacheHits;
+	m_CacheMisses += m_FrameCacheMisses;
+}
+
+// Return true if the line of sight between the two tanks was clear at the start of the frame
+// False if either tank is not a live tank, they are on the same team or they are out of view range
+bool CPerception::HasLineOfSight( TEntityUID observer, TEntityUID target )
+{
+	return FindSighting( observer, target ) != 0;
+}
+
+// Return true if the target was within the observer's turret cone at the start of the frame
+// Only known for targets the observer has a clear line of sight to, false for any other
+bool CPerception::IsInCone( TEntityUID observer, TEntityUID target )
+{
+	const SSighting* sighting = FindSighting( observer, target );
+	return sighting != 0 && sighting->inCone;
+}
+
+// Return the enemies the given observer had a clear line of sight to at the start of the frame,
+// sorted by UID, and their number through the given pointer (0 if none). The sightings stay valid
+// until the next Update
+const CPerception::SSighting* CPerception::GetSightings( TEntityUID observer, TUInt32* numSightings )
+{
+	*numSightings = 0;
+	TInt32 observerIndex = TankIndex( observer );
+	if (observerIndex < 0)
+	{
+		return 0;
+	}
+	*numSightings = m_FirstSighting[observerIndex + 1] - m_FirstSighting[observerIndex];
+	return *numSightings ? &m_Sightings[m_FirstSighting[observerIndex]] : 0;
+}
+
+
+/////////////////////////////////////
+// Private interface
+
+// Return the index of the given tank in this frame's tank list, or -1 if it isn't there
+TInt32 CPerception::TankIndex( TEntityUID uid )
+{
+	vector<TEntityUID>::iterator tank = lower_bound( m_TankUIDs.begin(), m_TankUIDs.end(), uid );
+	if (tank == m_TankUIDs.end() || *tank != uid)
+	{
+		return -1;
+	}
+	return static_cast<TInt32>(tank - m_TankUIDs.begin());
+}
+
+// Sort the tanks into grid cells. The grid is sized to the extent of the tanks, with cells grown
+// beyond the view range if there would otherwise be too many
+void CPerception::BinTanks()
+{
+	TUInt32 numTanks = static_cast<TUInt32>(m_TankUIDs.size());
+	m_TankCells.resize( numTanks );
+	if (numTanks == 0)
+	{
+		m_NumCellsX = m_NumCellsZ = 0;
+		m_CellStart.assign( 1, 0 );
+		return;
+	}
+
+	TFloat32 minX = m_Positions[0].x, maxX = minX;
+	TFloat32 minZ = m_Positions[0].z, maxZ = minZ;
+	for (TUInt32 tank = 1; tank < numTanks; ++tank)
+	{
+		minX = Min( minX, m_Positions[tank].x );
+		maxX = Max( maxX, m_Positions[tank].x );
+		minZ = Min( minZ, m_Positions[tank].z );
+		maxZ = Max( maxZ, m_Positions[tank].z );
+	}
+	m_GridMinX = minX;
+	m_GridMinZ = minZ;
+	m_CellSize = Max( m_ViewRange, Max( maxX - minX, maxZ - minZ ) / kMaxCellsPerSide );
+	m_NumCellsX = Min( static_cast<TInt32>((maxX - minX) / m_CellSize) + 1, kMaxCellsPerSide );
+	m_NumCellsZ = Min( static_cast<TInt32>((maxZ - minZ) / m_CellSize) + 1, kMaxCellsPerSide );
+
+	// Counting sort of the tanks by cell so each cell's tanks are contiguous
+	TUInt32 numCells = m_NumCellsX * m_NumCellsZ;
+	m_CellStart.assign( numCells + 1, 0 );
+	for (TUInt32 tank = 0; tank < numTanks; ++tank)
+	{
+		TInt32 cellX = Min( static_cast<TInt32>((m_Positions[tank].x - minX) / m_CellSize), m_NumCellsX - 1 );
+		TInt32 cellZ = Min( static_cast<TInt32>((m_Positions[tank].z - minZ) / m_CellSize), m_NumCellsZ - 1 );
+		m_TankCells[tank] = cellZ * m_NumCellsX + cellX;
+		++m_CellStart[m_TankCells[tank] + 1];
+	}
+	for (TUInt32 cell = 0; cell < numCells; ++cell)
+	{
+		m_CellStart[cell + 1] += m_CellStart[cell];
+	}
+	m_CellFill.assign( m_CellStart.begin(), m_CellStart.end() - 1 );
+	m_CellTanks.resize( numTanks );
+	for (TUInt32 tank = 0; tank < numTanks; ++tank)
+	{
+		m_CellTanks[m_CellFill[m_TankCells[tank]]++] = tank;
+	}
+}
+
+// Find the given observer's sighting of the given target, or 0 if it has no clear line of sight
+// to it
+const CPerception::SSighting* CPerception::FindSighting( TEntityUID observer, TEntityUID target )
+{
+	TInt32 observerIndex = TankIndex( observer );
+	if (observerIndex < 0)
+	{
+		return 0;
+	}
+
+	SSighting key;
+	key.target = target;
+	vector<SSighting>::const_iterator first = m_Sightings.begin() + m_FirstSighting[observerIndex];
+	vector<SSighting>::const_iterator last = m_Sightings.begin() + m_FirstSighting[observerIndex + 1];
+	vector<SSighting>::const_iterator sighting = lower_bound( first, last, key, SightingLess );
+	if (sighting == last || sighting->target != key.target)
+	{
+		return 0;
+	}
+	return &*sighting;
+}
+
+// Find the given pair in the cache written last frame, or return 0 if it isn't there
+const CPerception::SSightCacheEntry* CPerception::FindCachedSight( TUInt64 key )
+{
+	vector<SSightCacheEntry>& table = m_SightCaches[(m_Frame - 1) & 1];
+	TUInt32 tableSize = static_cast<TUInt32>(table.size());
+	if (tableSize == 0)
+	{
+		return 0;
+	}
+
+	// Probe until a slot not written last frame, which ends the run of slots the key could be in
+	TUInt32 slot = CacheSlot( key, tableSize );
+	while (table[slot].frame == m_Frame - 1)
+	{
+		if (table[slot].key == key)
+		{
+			return &table[slot];
+		}
+		slot = (slot + 1) & (tableSize - 1);
+	}
+	return 0;
+}
+
+// Store this frame's pairs in the cache, to be looked up next frame. The table is kept at most
+// half full. Slots stamped with an earlier frame count as empty
+void CPerception::StoreCachedSights()
+{
+	vector<SSightCacheEntry>& table = m_SightCaches[m_Frame & 1];
+	TUInt32 numSights = static_cast<TUInt32>(m_FrameSights.size());
+	TUInt32 tableSize = 64;
+	while (tableSize < numSights * 2)
+	{
+		tableSize *= 2;
+	}
+	if (table.size() < tableSize)
+	{
+		SSightCacheEntry empty;
+		empty.key = 0;
+		empty.frame = 0;
+		table.assign( tableSize, empty );
+	}
+	tableSize = static_cast<TUInt32>(table.size());
+
+	for (TUInt32 sight = 0; sight < numSights; ++sight)
+	{
+		TUInt32 slot = CacheSlot( m_FrameSights[sight].key, tableSize );
+		while (table[slot].frame == m_Frame)
+		{
+			slot = (slot + 1) & (tableSize - 1);
+		}
+		table[slot] = m_FrameSights[sight];
+		table[slot].frame = m_Frame;
+	}
+}
+
+// Add a pair with a clear line of sight, checking the cone in each direction
+void CPerception::AddSightPair( TUInt32 first, TUInt32 second )
+{
+	CVector3 toSecond = m_Positions[second] - m_Positions[first];
+	TFloat32 distance = toSecond.Length();
+
+	SSightPair pair;
+	pair.first = first;
+	pair.second = second;
+	pair.firstSeesSecond = InCone( first, toSecond, distance );
+	pair.secondSeesFirst = InCone( second, -toSecond, distance );
+	m_SightPairs.push_back( pair );
+}
+
+
+} // namespace gen
@@ -0,0 +1,231 @@
+/*******************************************
+Perception.h
+
+Per-frame tank visibility
+********************************************/
+
+#pragma once
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "Entity.h"
+#include "LineOfSight.h"
+
+namespace gen
+{
+
+	// Perception stage, run once per frame before the entities are updated. Works out for every
+	// pair of live tanks on opposing teams within view range of each other whether the line of
+	// sight between them is clear and whether the target is within the observer's turret cone.
+	// The tanks are binned into a uniform grid with cells at least the view range wide, so only
+	// the tanks in neighbouring cells are considered. Each observer gets a list of the enemies it
+	// has a clear line of sight to, so tanks can read them rather than querying the world
+	// Line of sight results are cached per pair and reused until either tank moves more than a
+	// set distance, a timeout passes or an occluder changes
+	class CPerception
+	{
+		/////////////////////////////////////
+		//	Constructors/Destructors
+	public:
+		// Constructor takes the half-angle of the turret cone in degrees and the distance beyond
+		// which tanks can't see each other
+		CPerception(TFloat32 coneAngle = 15.0f, TFloat32 viewRange = 250.0f);
+
+		// No destructor needed
+
+	private:
+		// Disallow use of copy constructor and assignment operator (private and not defined)
+		CPerception(const CPerception&);
+		CPerception& operator=(const CPerception&);
+
+
+		/////////////////////////////////////
+		//	Public interface
+	public:
+
+		// An enemy an observer has a clear line of sight to, and whether it is within the
+		// observer's turret cone
+		struct SSighting
+		{
+			TEntityUID target;
+			bool       inCone;
+		};
+
+		// Gather the live tanks and build the sighting lists. Call once per frame before the entity
+		// updates, passing the time since the last update
+		void Update(TFloat32 updateTime);
+
+		// Set how far either tank in a pair can move, and how long can pass, before the pair's
+		// cached line of sight is recalculated
+		void SetCacheLimits(TFloat32 moveDistance, TFloat32 timeout)
+		{
+			m_CacheMoveDistance = moveDistance;
+			m_CacheTimeout = timeout;
+		}
+
+		// Return the number of line of sight look-ups answered from the cache / recalculated
+		// since the perception stage was created
+		TUInt32 GetCacheHits()
+		{
+			return m_CacheHits;
+		}
+		TUInt32 GetCacheMisses()
+		{
+			return m_CacheMisses;
+		}
+
+		// Return the fraction of line of sight look-ups answered from the cache last frame
+		TFloat32 GetFrameCacheHitRate()
+		{
+			TUInt32 lookUps = m_FrameCacheHits + m_FrameCacheMisses;
+			return lookUps ? static_cast<TFloat32>(m_FrameCacheHits) / lookUps : 0.0f;
+		}
+
+		// Return true if the line of sight between the two tanks was clear at the start of the
+		// frame. False if either tank is not a live tank, they are on the same team or they are
+		// out of view range
+		bool HasLineOfSight(TEntityUID observer, TEntityUID target);
+
+		// Return true if the target was within the observer's turret cone at the start of the frame
+		// Only known for targets the observer has a clear line of sight to, false for any other
+		bool IsInCone(TEntityUID observer, TEntityUID target);
+
+		// Return true if the observer can see the target - clear line of sight and in its cone. The
+		// cone is only recorded for targets in sight, so this is the same as IsInCone
+		bool CanSee(TEntityUID observer, TEntityUID target)
+		{
+			return IsInCone(observer, target);
+		}
+
+		// Return the enemies the given observer had a clear line of sight to at the start of the
+		// frame, sorted by UID, and their number through the given pointer (0 if none). The
+		// sightings stay valid until the next Update
+		const SSighting* GetSightings(TEntityUID observer, TUInt32* numSightings);
+
+
+		/////////////////////////////////////
+		//	Private interface
+	private:
+
+		// A pair of tanks with a clear line of sight, and whether each is in the other's cone
+		struct SSightPair
+		{
+			TUInt32 first;
+			TUInt32 second;
+			bool    firstSeesSecond;
+			bool    secondSeesFirst;
+		};
+
+		// Cached line of sight for a pair of tanks, with the state it was calculated for. Keyed on
+		// the pair of UIDs, lower UID in the high 32 bits
+		struct SSightCacheEntry
+		{
+			TUInt64  key;
+			CVector3 from;       // Tank positions when calculated
+			CVector3 to;
+			TFloat32 time;       // Perception time when calculated
+			TUInt32  generation; // Occluder generation when calculated
+			TUInt32  frame;      // Frame the entry was stored in the cache
+			bool     blocked;
+		};
+
+		// Sort predicate for an observer's sightings - by target
+		static bool SightingLess(const SSighting& a, const SSighting& b)
+		{
+			return a.target < b.target;
+		}
+
+
+		// Return the index of the given tank in this frame's tank list, or -1 if it isn't there
+		TInt32 TankIndex(TEntityUID uid);
+
+		// Sort the tanks into grid cells
+		void BinTanks();
+
+		// Find the given observer's sighting of the given target, or 0 if it has no clear line of
+		// sight to it
+		const SSighting* FindSighting(TEntityUID observer, TEntityUID target);
+
+		// Return true if the target is within the observer's turret cone
+		bool InCone(TUInt32 observer, const CVector3& toTarget, TFloat32 distance)
+		{
+			return distance > 0.0f && Dot(m_Facings[observer], toTarget) > m_CosConeAngle * distance;
+		}
+
+		// Add a pair with a clear line of sight, checking the cone in each direction
+		void AddSightPair(TUInt32 first, TUInt32 second);
+
+		// Return the first hash table slot to try for the given pair key in a table of the given size
+		static TUInt32 CacheSlot(TUInt64 key, TUInt32 tableSize)
+		{
+			return static_cast<TUInt32>((key * 0x9E3779B97F4A7C15ull) >> 32) & (tableSize - 1);
+		}
+
+		// Find the given pair in the cache written last frame, or return 0 if it isn't there
+		const SSightCacheEntry* FindCachedSight(TUInt64 key);
+
+		// Store this frame's pairs in the cache, to be looked up next frame
+		void StoreCachedSights();
+
+
+		// Cosine of the turret cone half-angle and the view range
+		TFloat32 m_CosConeAngle;
+		TFloat32 m_ViewRange;
+
+		// This frame's live tanks, sorted by UID, with their team, turret position and facing
+		vector<TEntityUID> m_TankUIDs;
+		vector<TUInt32>    m_Teams;
+		vector<CVector3>   m_Positions;
+		vector<CVector3>   m_Facings;
+
+		// Grid covering the tanks' extent, with cells at least the view range wide. The tanks in
+		// cell c are the indices in m_CellTanks from m_CellStart[c] to m_CellStart[c + 1]
+		TFloat32        m_CellSize;
+		TFloat32        m_GridMinX;
+		TFloat32        m_GridMinZ;
+		TInt32          m_NumCellsX;
+		TInt32          m_NumCellsZ;
+		vector<TUInt32> m_CellStart;
+		vector<TUInt32> m_CellTanks;
+		vector<TUInt32> m_TankCells; // Cell for each tank
+		vector<TUInt32> m_CellFill;  // Next free slot in each cell while sorting
+
+		// Pairs with a clear line of sight this frame, and each observer's sightings built from
+		// them. The sightings for observer o are from m_FirstSighting[o] to m_FirstSighting[o + 1],
+		// sorted by target UID
+		vector<SSightPair> m_SightPairs;
+		vector<TUInt32>    m_FirstSighting;
+		vector<SSighting>  m_Sightings;
+
+		// Line of sight queries for opposing pairs not answered by the cache this frame, tested in
+		// one batch
+		vector<SSightQuery> m_SightQueries;
+		vector<TUInt32>     m_QueryObservers;
+		vector<TUInt32>     m_QueryTargets;
+
+		// Line of sight cache. Each frame's pairs are stored in one of two open addressing hash
+		// tables and looked up in the other, written the frame before. A slot holds an entry only
+		// if its frame stamp is the frame the table was written, so neither table ever needs
+		// clearing and pairs that drop out (a tank has died, left or moved out of range) are
+		// simply not carried over
+		vector<SSightCacheEntry> m_SightCaches[2];
+		vector<SSightCacheEntry> m_FrameSights;  // This frame's pairs, stored after the batch
+		vector<TUInt32>          m_QueryEntries; // Index in m_FrameSights to fill for each query
+
+		TFloat32 m_CacheMoveDistance;
+		TFloat32 m_CacheTimeout;
+		TFloat32 m_Time;
+		TUInt32  m_Frame;
+
+		// Cache statistics
+		TUInt32 m_CacheHits;
+		TUInt32 m_CacheMisses;
+		TUInt32 m_FrameCacheHits;
+		TUInt32 m_FrameCacheMisses;
+	};
+
+
+} // namespace gen
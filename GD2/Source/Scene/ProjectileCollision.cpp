@@ -0,0 +1,254 @@
+/*******************************************
+	ProjectileCollision.cpp
+
+	Shell against tank collision pass
+********************************************/
+
+#include "ProjectileCollision.h"
+#include "EntityManager.h"
+#include "TankEntity.h"
+#include "ShellEntity.h"
+
+namespace gen
+{
+
+// Entity manager holding the tanks and shells
+extern thread_local CEntityManager EntityManager;
+
+// Messenger used to deliver the hits
+extern thread_local CMessenger Messenger;
+
+// Half-size of the box around a tank that a shell must be inside to hit it
+const TFloat32 kTankHalfWidth  = 2.0f; // X
+const TFloat32 kTankHalfHeight = 4.0f; // Y
+const TFloat32 kTankHalfLength = 4.0f; // Z
+const CVector3 kTankHalfSize( kTankHalfWidth, kTankHalfHeight, kTankHalfLength );
+
+// Largest number of cells on each side of the grid, limits memory use when tanks are far apart
+const TInt32 kMaxCellsPerSide = 64;
+
+
+// Slab test of the segment from 'start' along 'dir' (t from 0 to 1) against the box with the given
+// centre and half-size. Returns true on a hit and sets t to where the segment enters the box (0 if
+// it starts inside)
+static bool SegmentHitsBox( const CVector3& start, const CVector3& dir, const CVector3& centre,
+                            const CVector3& halfSize, TFloat32& t )
+{
+	TFloat32 tNear = 0.0f;
+	TFloat32 tFar = 1.0f;
+	for (TUInt32 axis = 0; axis < 3; ++axis)
+	{
+		TFloat32 boxMin = centre[axis] - halfSize[axis];
+		TFloat32 boxMax = centre[axis] + halfSize[axis];
+		if (dir[axis] == 0.0f)
+		{
+			// Parallel to this slab, must start within it
+			if (start[axis] < boxMin || start[axis] > boxMax)
+			{
+				return false;
+			}
+		}
+		else
+		{
+			TFloat32 t1 = (boxMin - start[axis]) / dir[axis];
+			TFloat32 t2 = (boxMax - start[axis]) / dir[axis];
+			tNear = Max( tNear, Min( t1, t2 ) );
+			tFar = Min( tFar, Max( t1, t2 ) );
+			if (tNear > tFar)
+			{
+				return false;
+			}
+		}
+	}
+	t = tNear;
+	return true;
+}
+
+
+// Constructor takes the width of a grid cell
+CProjectileCollision::CProjectileCollision( TFloat32 cellSize /*= 16.0f*/ )
+{
+	m_CellSize = cellSize;
+	m_BaseCellSize = cellSize;
+	m_GridMinX = m_GridMinZ = 0.0f;
+	m_NumCellsX = m_NumCellsZ = 0;
+	m_NumTests = 0;
+	m_NumHits = 0;
+}
+
+
+// Test all live shells against the tanks, send the hit messages and destroy the shells that hit.
+// Call once per frame after the entity updates
+void CProjectileCollision::Update()
+{
+	m_NumTests = 0;
+	m_NumHits = 0;
+	m_HitTargets.clear();
+	m_HitMessages.clear();
+	m_HitShells.clear();
+
+	BinTanks();
+	if (m_TankUIDs.empty())
+	{
+		return;
+	}
+
+	EntityManager.BeginEnumEntities( "", "", "Projectile" );
+	CEntity* entity = EntityManager.EnumEntity();
+	while (entity != 0)
+	{
+		CShellEntity* shell = static_cast<CShellEntity*>(entity);
+		const CVector3& start = shell->GetPrevPosition();
+		const CVector3& end = shell->Position();
+		CVector3 dir = end - start;
+
+		// Range of cells holding tanks whose box could touch the segment
+		TInt32 minCellX = CellX( Min( start.x, end.x ) - kTankHalfWidth );
+		TInt32 maxCellX = CellX( Max( start.x, end.x ) + kTankHalfWidth );
+		TInt32 minCellZ = CellZ( Min( start.z, end.z ) - kTankHalfLength );
+		TInt32 maxCellZ = CellZ( Max( start.z, end.z ) + kTankHalfLength );
+
+		// Find the enemy tank hit earliest along the segment
+		TInt32 hitTank = -1;
+		TFloat32 hitT = 0.0f;
+		for (TInt32 cellZ = minCellZ; cellZ <= maxCellZ; ++cellZ)
+		{
+			for (TInt32 cellX = minCellX; cellX <= maxCellX; ++cellX)
+			{
+				TUInt32 cell = cellZ * m_NumCellsX + cellX;
+				for (TUInt32 i = m_CellStart[cell]; i < m_CellStart[cell + 1]; ++i)
+				{
+					TUInt32 tank = m_CellTanks[i];
+					if (m_Teams[tank] == shell->GetTeam())
+					{
+						continue;
+					}
+
+					++m_NumTests;
+					TFloat32 t;
+					if (SegmentHitsBox( start, dir, m_Positions[tank], kTankHalfSize, t ) &&
+					    (hitTank < 0 || t < hitT))
+					{
+						hitTank = tank;
+						hitT = t;
+					}
+				}
+			}
+		}
+
+		if (hitTank >= 0)
+		{
+			SMessage msg;
+			msg.type = Msg_Hit;
+			msg.from = shell->GetShooter();
+			SDamagePayload damage;
+			damage.damage = shell->GetDamage();
+			msg.SetPayload( damage );
+
+			m_HitTargets.push_back( m_TankUIDs[hitTank] );
+			m_HitMessages.push_back( msg );
+			m_HitShells.push_back( shell->GetUID() );
+			m_DamageDealt[shell->GetShooter()] += static_cast<TUInt32>(shell->GetDamage());
+		}
+		entity = EntityManager.EnumEntity();
+	}
+	EntityManager.EndEnumEntities();
+
+	m_NumHits = static_cast<TUInt32>(m_HitShells.size());
+	if (m_NumHits > 0)
+	{
+		Messenger.SendMessageBatch( &m_HitTargets[0], &m_HitMessages[0], m_NumHits );
+	}
+
+	// Destroy shells after enumeration is complete, destroying changes the entity list
+	for (TUInt32 shell = 0; shell < m_HitShells.size(); ++shell)
+	{
+		EntityManager.DestroyEntity( m_HitShells[shell] );
+	}
+}
+
+
+// Gather the live tanks and sort them into grid cells
+void CProjectileCollision::BinTanks()
+{
+	m_TankUIDs.clear();
+	m_Teams.clear();
+	m_Positions.clear();
+
+	EntityManager.BeginEnumEntities( "", "", "Tank" );
+	CEntity* entity = EntityManager.EnumEntity();
+	while (entity != 0)
+	{
+		CTankEntity* tank = static_cast<CTankEntity*>(entity);
+		if (tank->m_State != CTankEntity::Dead)
+		{
+			m_TankUIDs.push_back( tank->GetUID() );
+			m_Teams.push_back( tank->GetTeam() );
+			m_Positions.push_back( tank->Position() );
+		}
+		entity = EntityManager.EnumEntity();
+	}
+	EntityManager.EndEnumEntities();
+
+	TUInt32 numTanks = static_cast<TUInt32>(m_TankUIDs.size());
+	if (numTanks == 0)
+	{
+		return;
+	}
+
+	// Size the grid to the extent of the tanks, growing the cells if the tanks are spread too far
+	// for the cell limit. Shells outside it are clamped to the edge cells, which is safe because
+	// the box test still decides whether there is a hit
+	TFloat32 minX = m_Positions[0].x, maxX = minX;
+	TFloat32 minZ = m_Positions[0].z, maxZ = minZ;
+	for (TUInt32 tank = 1; tank < numTanks; ++tank)
+	{
+		minX = Min( minX, m_Positions[tank].x );
+		maxX = Max( maxX, m_Positions[tank].x );
+		minZ = Min( minZ, m_Positions[tank].z );
+		maxZ = Max( maxZ, m_Positions[tank].z );
+	}
+	m_GridMinX = minX;
+	m_GridMinZ = minZ;
+	m_CellSize = Max( m_BaseCellSize, Max( maxX - minX, maxZ - minZ ) / kMaxCellsPerSide );
+	m_NumCellsX = Min( static_cast<TInt32>((maxX - minX) / m_CellSize) + 1, kMaxCellsPerSide );
+	m_NumCellsZ = Min( static_cast<TInt32>((maxZ - minZ) / m_CellSize) + 1, kMaxCellsPerSide );
+
+	// Counting sort of the tanks by cell so each cell's tanks are contiguous
+	TUInt32 numCells = m_NumCellsX * m_NumCellsZ;
+	m_CellStart.assign( numCells + 1, 0 );
+	m_TankCells.resize( numTanks );
+	for (TUInt32 tank = 0; tank < numTanks; ++tank)
+	{
+		m_TankCells[tank] = CellZ( m_Positions[tank].z ) * m_NumCellsX + CellX( m_Positions[tank].x );
+		++m_CellStart[m_TankCells[tank] + 1];
+	}
+	for (TUInt32 cell = 0; cell < numCells; ++cell)
+	{
+		m_CellStart[cell + 1] += m_CellStart[cell];
+	}
+	m_CellFill.assign( m_CellStart.begin(), m_CellStart.end() - 1 );
+	m_CellTanks.resize( numTanks );
+	for (TUInt32 tank = 0; tank < numTanks; ++tank)
+	{
+		m_CellTanks[m_CellFill[m_TankCells[tank]]++] = tank;
+	}
+}
+
+// Return the grid cell containing the given coordinate on each axis, clamped to the grid
+TInt32 CProjectileCollision::CellX( TFloat32 x )
+{
+	TFloat32 cell = (x - m_GridMinX) / m_CellSize;
+	if (cell < 0.0f) return 0;
+	return Min( static_cast<TInt32>(cell), m_NumCellsX - 1 );
+}
+
+TInt32 CProjectileCollision::CellZ( TFloat32 z )
+{
+	TFloat32 cell = (z - m_GridMinZ) / m_CellSize;
+	if (cell < 0.0f) return 0;
+	return Min( static_cast<TInt32>(cell), m_NumCellsZ - 1 );
+}
+
+
+} // namespace gen
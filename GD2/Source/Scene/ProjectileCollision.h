@@ -0,0 +1,116 @@
+/*******************************************
+ProjectileCollision.h
+
+Shell against tank collision pass
+********************************************/
+
+#pragma once
+
+#include <vector>
+#include <map>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "Entity.h"
+#include "Messenger.h"
+
+namespace gen
+{
+
+	// Projectile collision pass, run once per frame after the entities have been updated. The live
+	// tanks are binned into a uniform grid on the XZ plane, then the segment each shell swept along
+	// this frame is tested only against the enemy tanks in the cells it overlaps, so fast shells or
+	// long frames can't pass through a tank. Each shell hits the first tank along its segment. Hit
+	// messages for the whole frame are sent together and the shells that hit are destroyed
+	class CProjectileCollision
+	{
+		/////////////////////////////////////
+		//	Constructors/Destructors
+	public:
+		// Constructor takes the width of a grid cell
+		CProjectileCollision(TFloat32 cellSize = 16.0f);
+
+		// No destructor needed
+
+	private:
+		// Disallow use of copy constructor and assignment operator (private and not defined)
+		CProjectileCollision(const CProjectileCollision&);
+		CProjectileCollision& operator=(const CProjectileCollision&);
+
+
+		/////////////////////////////////////
+		//	Public interface
+	public:
+
+		// Test all live shells against the tanks, send the hit messages and destroy the shells
+		// that hit. Call once per frame after the entity updates
+		void Update();
+
+		// Return the number of shell against tank box tests / hits last frame
+		TUInt32 GetNumTests()
+		{
+			return m_NumTests;
+		}
+		TUInt32 GetNumHits()
+		{
+			return m_NumHits;
+		}
+
+		// Return the total damage of the shells fired by the given tank that have hit an enemy
+		TUInt32 GetDamageDealt(TEntityUID shooter)
+		{
+			TDamageIter found = m_DamageDealt.find(shooter);
+			return (found != m_DamageDealt.end()) ? found->second : 0;
+		}
+
+
+		/////////////////////////////////////
+		//	Private interface
+	private:
+
+		// Gather the live tanks and sort them into grid cells
+		void BinTanks();
+
+		// Return the grid cell containing the given coordinate on each axis, clamped to the grid
+		TInt32 CellX(TFloat32 x);
+		TInt32 CellZ(TFloat32 z);
+
+
+		// Width of a grid cell, and the width asked for - cells are grown when the tanks are far apart
+		TFloat32 m_CellSize;
+		TFloat32 m_BaseCellSize;
+
+		// This frame's live tanks with their team and position
+		vector<TEntityUID> m_TankUIDs;
+		vector<TUInt32>    m_Teams;
+		vector<CVector3>   m_Positions;
+
+		// Grid covering the tanks' extent. The tanks in cell c are the indices in m_CellTanks from
+		// m_CellStart[c] to m_CellStart[c + 1]
+		TFloat32        m_GridMinX;
+		TFloat32        m_GridMinZ;
+		TInt32          m_NumCellsX;
+		TInt32          m_NumCellsZ;
+		vector<TUInt32> m_CellStart;
+		vector<TUInt32> m_CellTanks;
+		vector<TUInt32> m_TankCells; // Cell for each tank
+		vector<TUInt32> m_CellFill;  // Next free slot in each cell while sorting
+
+		// This frame's hits, sent as one batch, and the shells to destroy
+		vector<TEntityUID> m_HitTargets;
+		vector<SMessage>   m_HitMessages;
+		vector<TEntityUID> m_HitShells;
+
+		// Statistics for the last frame
+		TUInt32 m_NumTests;
+		TUInt32 m_NumHits;
+
+		// Total damage dealt by each tank that has hit an enemy, keyed on the shooter's UID
+		typedef map<TEntityUID, TUInt32> TDamageDealt;
+		typedef TDamageDealt::iterator TDamageIter;
+		TDamageDealt m_DamageDealt;
+	};
+
+
+} // namespace gen
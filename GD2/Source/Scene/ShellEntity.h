@@ -42,6 +42,9 @@ namespace gen
 		(
 			CEntityTemplate* entityTemplate,
 			TEntityUID       UID,
+			TEntityUID       shooter,
+			TUInt32          team,
+			TInt32           damage,
 			const string& name = "",
 			const CVector3& position = CVector3::kOrigin,
 			const CVector3& rotation = CVector3(0.0f, 0.0f, 0.0f),
@@ -57,18 +60,47 @@ namespace gen
 		/////////////////////////////////////
 		// Update
 
-		// Update the shell - performs simple shell behaviour
+		// Update the shell - moves it forward and expires it once its lifetime is over. Hits are
+		// found by the projectile collision pass after all entities have been updated
 		// Return false if the entity is to be destroyed
 		// Keep as a virtual function in case of further derivation
 		virtual bool Update(TFloat32 updateTime);
 
+		/////////////////////////////////////
+		// Getters
+
+		TEntityUID GetShooter()
+		{
+			return m_Shooter;
+		}
+		TUInt32 GetTeam()
+		{
+			return m_Team;
+		}
+		TInt32 GetDamage()
+		{
+			return m_Damage;
+		}
+
+		// Position at the start of the last update, the shell swept from here to its current
+		// position during the update
+		const CVector3& GetPrevPosition()
+		{
+			return m_PrevPosition;
+		}
+
 		/////////////////////////////////////
 		//	Private interface
 	private:
 
 		/////////////////////////////////////
 		// Data
-		// Add your shell data here
+
+		TEntityUID m_Shooter; // Tank that fired the shell
+		TUInt32    m_Team;    // Team of the tank that fired the shell, other teams can be hit
+		TInt32     m_Damage;  // HP damage caused on a hit
+		TFloat32   m_Life;    // Time left before the shell expires
+		CVector3   m_PrevPosition; // Position before the last move
 	};
 
 
@@ -0,0 +1,158 @@
+/*******************************************
+	Steering.cpp
+
+	Batched tank steering
+********************************************/
+
+#include <xmmintrin.h> // SSE intrinsics
+
+#include "Steering.h"
+#include "EntityManager.h"
+#include "TankEntity.h"
+
+namespace gen
+{
+
+// Entity manager holding the tanks
+extern thread_local CEntityManager EntityManager;
+
+
+// Constructor takes the angle (degrees) within which a tank counts as facing its target
+CSteering::CSteering( TFloat32 alignAngle /*= 3.0f*/ )
+{
+	TFloat32 cosAlignAngle = Cos( ToRadians( alignAngle ) );
+	m_CosAlignAngleSq = cosAlignAngle * cosAlignAngle;
+	m_NumSteered = 0;
+}
+
+
+// Add a tank to this frame's steering pass. Pass its position, facing, the point to drive to, its
+// current speed and its template's maximum speed, acceleration and turn speed
+void CSteering::AddTank( TEntityUID uid, const CVector3& position, const CVector3& facing,
+                         const CVector3& target, TFloat32 speed, TFloat32 maxSpeed,
+                         TFloat32 acceleration, TFloat32 turnSpeed )
+{
+	// Tanks steer on the ground, so only the XZ part of the facing is used
+	TFloat32 facingLength = Sqrt( facing.x * facing.x + facing.z * facing.z );
+	if (facingLength == 0.0f)
+	{
+		return;
+	}
+
+	m_UIDs.push_back( uid );
+	m_Targets.push_back( target );
+	m_PosX.push_back( position.x );
+	m_PosZ.push_back( position.z );
+	m_FacingX.push_back( facing.x / facingLength );
+	m_FacingZ.push_back( facing.z / facingLength );
+	m_TargetX.push_back( target.x );
+	m_TargetZ.push_back( target.z );
+	m_Speed.push_back( speed );
+	m_MaxSpeed.push_back( maxSpeed );
+	m_Acceleration.push_back( acceleration );
+	m_TurnSpeed.push_back( turnSpeed );
+}
+
+
+// Steer and move all tanks added since the last call, passing the time since the last update
+void CSteering::Update( TFloat32 updateTime )
+{
+	m_NumSteered = static_cast<TUInt32>(m_UIDs.size());
+	if (m_NumSteered > 0)
+	{
+		RunKernel();
+	}
+
+	// Apply the results to the tanks - matrices are not held in the arrays so this part is done
+	// one tank at a time
+	for (TUInt32 tank = 0; tank < m_NumSteered; ++tank)
+	{
+		CEntity* entity = EntityManager.GetEntity( m_UIDs[tank] );
+		if (!entity)
+		{
+			continue;
+		}
+		static_cast<CTankEntity*>(entity)->SetSpeed( m_Speed[tank] );
+
+		if (m_Turn[tank] == 0.0f)
+		{
+			entity->Matrix().FaceTarget( m_Targets[tank] );
+			entity->Matrix().MoveLocalZ( m_Speed[tank] * updateTime );
+		}
+		else
+		{
+			entity->Matrix().MoveLocalZ( m_TurnSpeed[tank] * updateTime );
+			entity->Matrix().RotateLocalY( m_Turn[tank] * m_TurnSpeed[tank] * 0.5f * updateTime );
+		}
+	}
+
+	m_UIDs.clear();
+	m_Targets.clear();
+	m_PosX.clear();
+	m_PosZ.clear();
+	m_FacingX.clear();
+	m_FacingZ.clear();
+	m_TargetX.clear();
+	m_TargetZ.clear();
+	m_Speed.clear();
+	m_MaxSpeed.clear();
+	m_Acceleration.clear();
+	m_TurnSpeed.clear();
+}
+
+
+// Work out the turn direction and new speed for all tanks, four at a time. With d the vector to
+// the target, f the unit facing and r = (f.z, -f.x) the unit right axis, the tank is facing the
+// target if f.d > 0 and (f.d)^2 >= cos^2(angle) * d.d. Otherwise the sign of r.d gives the side the
+// target is on
+void CSteering::RunKernel()
+{
+	// Pad the arrays to a multiple of four. Padding results are ignored
+	TUInt32 numPadded = (m_NumSteered + 3) & ~3u;
+	m_PosX.resize( numPadded );
+	m_PosZ.resize( numPadded );
+	m_FacingX.resize( numPadded );
+	m_FacingZ.resize( numPadded );
+	m_TargetX.resize( numPadded );
+	m_TargetZ.resize( numPadded );
+	m_Speed.resize( numPadded );
+	m_MaxSpeed.resize( numPadded );
+	m_Acceleration.resize( numPadded );
+	m_TurnSpeed.resize( numPadded );
+	m_Turn.resize( numPadded );
+
+	__m128 cosAlignSq = _mm_set1_ps( m_CosAlignAngleSq );
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps( 1.0f );
+	__m128 minusOne = _mm_set1_ps( -1.0f );
+
+	for (TUInt32 tank = 0; tank < numPadded; tank += 4)
+	{
+		__m128 facingX = _mm_loadu_ps( &m_FacingX[tank] );
+		__m128 facingZ = _mm_loadu_ps( &m_FacingZ[tank] );
+		__m128 toTargetX = _mm_sub_ps( _mm_loadu_ps( &m_TargetX[tank] ), _mm_loadu_ps( &m_PosX[tank] ) );
+		__m128 toTargetZ = _mm_sub_ps( _mm_loadu_ps( &m_TargetZ[tank] ), _mm_loadu_ps( &m_PosZ[tank] ) );
+
+		__m128 forward = _mm_add_ps( _mm_mul_ps( facingX, toTargetX ), _mm_mul_ps( facingZ, toTargetZ ) );
+		__m128 side = _mm_sub_ps( _mm_mul_ps( facingZ, toTargetX ), _mm_mul_ps( facingX, toTargetZ ) );
+		__m128 distanceSq = _mm_add_ps( _mm_mul_ps( toTargetX, toTargetX ), _mm_mul_ps( toTargetZ, toTargetZ ) );
+
+		// Facing the target - in front and within the cone
+		__m128 aligned = _mm_and_ps( _mm_cmpgt_ps( forward, zero ),
+		                             _mm_cmpge_ps( _mm_mul_ps( forward, forward ), _mm_mul_ps( cosAlignSq, distanceSq ) ) );
+
+		// Otherwise turn to the side the target is on
+		__m128 left = _mm_cmplt_ps( side, zero );
+		__m128 turn = _mm_or_ps( _mm_and_ps( left, minusOne ), _mm_andnot_ps( left, one ) );
+		_mm_storeu_ps( &m_Turn[tank], _mm_andnot_ps( aligned, turn ) );
+
+		// Accelerate if below maximum speed
+		__m128 speed = _mm_loadu_ps( &m_Speed[tank] );
+		__m128 accelerate = _mm_cmplt_ps( speed, _mm_loadu_ps( &m_MaxSpeed[tank] ) );
+		speed = _mm_add_ps( speed, _mm_and_ps( accelerate, _mm_loadu_ps( &m_Acceleration[tank] ) ) );
+		_mm_storeu_ps( &m_Speed[tank], speed );
+	}
+}
+
+
+} // namespace gen
@@ -0,0 +1,96 @@
+/*******************************************
+Steering.h
+
+Batched tank steering
+********************************************/
+
+#pragma once
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "Entity.h"
+
+namespace gen
+{
+
+	// Steering pass for tanks. During their state updates, tanks that are driving somewhere add
+	// themselves with a target point. After all entity updates the pass works out every tank's
+	// steering at once, then turns and moves the tanks. Each tank accelerates towards its maximum
+	// speed; if it is facing the target it drives straight at it, otherwise it turns towards it at
+	// its turn speed. The decision uses dot products against the tank's forward and right axes
+	// rather than angles, and the tank data is held as separate arrays of each value (structure of
+	// arrays) so four tanks are steered at once with SSE
+	class CSteering
+	{
+		/////////////////////////////////////
+		//	Constructors/Destructors
+	public:
+		// Constructor takes the angle (degrees) within which a tank counts as facing its target
+		CSteering(TFloat32 alignAngle = 3.0f);
+
+		// No destructor needed
+
+	private:
+		// Disallow use of copy constructor and assignment operator (private and not defined)
+		CSteering(const CSteering&);
+		CSteering& operator=(const CSteering&);
+
+
+		/////////////////////////////////////
+		//	Public interface
+	public:
+
+		// Add a tank to this frame's steering pass. Pass its position, facing, the point to drive
+		// to, its current speed and its template's maximum speed, acceleration and turn speed
+		void AddTank(TEntityUID uid, const CVector3& position, const CVector3& facing,
+		             const CVector3& target, TFloat32 speed, TFloat32 maxSpeed,
+		             TFloat32 acceleration, TFloat32 turnSpeed);
+
+		// Steer and move all tanks added since the last call, passing the time since the last
+		// update. Call once per frame after the entity updates
+		void Update(TFloat32 updateTime);
+
+		// Return the number of tanks steered by the last update
+		TUInt32 GetNumSteered()
+		{
+			return m_NumSteered;
+		}
+
+
+		/////////////////////////////////////
+		//	Private interface
+	private:
+
+		// Work out the turn direction and new speed for all tanks, four at a time
+		void RunKernel();
+
+
+		// Square of the cosine of the facing angle
+		TFloat32 m_CosAlignAngleSq;
+
+		// Tanks added this frame with their full target points (used to face the target)
+		vector<TEntityUID> m_UIDs;
+		vector<CVector3>   m_Targets;
+
+		// Kernel inputs - positions, unit facings and targets on the XZ plane, speed settings.
+		// Padded to a multiple of four before the kernel runs
+		vector<TFloat32> m_PosX, m_PosZ;
+		vector<TFloat32> m_FacingX, m_FacingZ;
+		vector<TFloat32> m_TargetX, m_TargetZ;
+		vector<TFloat32> m_Speed;
+		vector<TFloat32> m_MaxSpeed;
+		vector<TFloat32> m_Acceleration;
+		vector<TFloat32> m_TurnSpeed;
+
+		// Kernel output - 0 to drive at the target, -1 to turn left, 1 to turn right. The new
+		// speed is written back to m_Speed
+		vector<TFloat32> m_Turn;
+
+		TUInt32 m_NumSteered;
+	};
+
+
+} // namespace gen
@@ -7,7 +7,7 @@
 // Additional technical notes for the assignment:
 // - Each tank has a team number (0 or 1), HP and other instance data - see the end of TankEntity.h
 //   You will need to add other instance data suitable for the assignment requirements
-// - A function GetTankUID is defined in TankAssignment.cpp and made available here, which returns
+// - A function GetTankUID is defined in Simulation.cpp and made available here, which returns
 //   the UID of the tank on a given team. This can be used to get the enemy tank UID
 // - Tanks have three parts: the root, the body and the turret. Each part has its own matrix, which
 //   can be accessed with the Matrix function - root: Matrix(), body: Matrix(1), turret: Matrix(2)
@@ -27,85 +27,55 @@
 //   using their entity pointers. The return value from EntityManager.GetEntity will be NULL if the
 //   entity no longer exists. Use this to avoid trying to target a tank that no longer exists etc.
 
+#include <algorithm>
+using namespace std;
+
 #include "TankEntity.h"
 #include "EntityManager.h"
 #include "Messenger.h"
+#include "Perception.h"
+#include "Steering.h"
+#include "NavGrid.h"
+#include "FlowField.h"
+#include "ThinkScheduler.h"
+#include "TankProfiler.h"
 
 namespace gen
 {
 
-	// Reference to entity manager from TankAssignment.cpp, allows look up of entities by name, UID etc.
+	// Reference to entity manager from Simulation.cpp, allows look up of entities by name, UID etc.
 	// Can then access other entity's data. See the CEntityManager.h file for functions. Example:
 	//    CVector3 targetPos = EntityManager.GetEntity( targetUID )->GetMatrix().Position();
-	extern CEntityManager EntityManager;
+	extern thread_local CEntityManager EntityManager;
 
 	// Messenger class for sending messages to and between entities
-	extern CMessenger Messenger;
+	extern thread_local CMessenger Messenger;
+
+	// Tank visibility worked out once per frame before the updates
+	extern thread_local CPerception Perception;
+
+	// Steering pass that turns and moves the tanks after the updates
+	extern thread_local CSteering Steering;
+
+	// Navigation grid for finding paths around buildings
+	extern thread_local CNavGrid NavGrid;
+
+	// Flow fields shared by all tanks heading for the same crate or patrol point
+	extern thread_local CFlowFields FlowFields;
 
-	// Helper function made available from TankAssignment.cpp - gets UID of tank A (team 0) or B (team 1).
+	// Decides which tanks make their expensive decisions (target selection) this frame
+	extern thread_local CThinkScheduler ThinkScheduler;
+
+	// Flow field keys for patrol points are the point's grid cell with the top bit set, so they can't clash with the crate UIDs
+	const TUInt32 PatrolFlowKey = 0x80000000u;
+
+	// Helper function made available from Simulation.cpp - gets UID of tank A (team 0) or B (team 1).
 	// Will be needed to implement the required tank behaviour in the Update function below
 	extern TEntityUID GetTankUID(int team);
 
-	/*Will determind wether the tank has line of sight*/
-	bool LineOfSight(CVector3 TurretFacing, CMatrix4x4 TurretMatrix, CEntity* TankTarget)
-	{
-		
-
-		EntityManager.BeginEnumEntities("", "", "Scenery");
-		CEntity* Building = EntityManager.EnumEntity();
-		while (Building != 0)
-		{
-			if (Building->GetName() == "Building")
-			{
-				/* Gets all the corners of the building*/
-				CVector3 BuildingPoints[4];
-				CVector3 buildingpointTR = Building->Position();
-				buildingpointTR.x = Building->Position().x + 8.0f;
-				buildingpointTR.z = Building->Position().z + 8.0f;
-				BuildingPoints[0] = buildingpointTR;
-		
-				CVector3 buildingpointBR = Building->Position();
-				buildingpointBR.x = Building->Position().x + 8.0f;
-				buildingpointBR.z = Building->Position().z - 8.0f;
-				BuildingPoints[1] = buildingpointBR;
-		
-				CVector3 buildingpointTL = Building->Position();
-				buildingpointTL.x = Building->Position().x - 8.0f;
-				buildingpointTL.z = Building->Position().z + 8.0f;
-				BuildingPoints[2] = buildingpointTL;
-		
-				CVector3 buildingpointBL = Building->Position();
-				buildingpointBL.x = Building->Position().x - 8.0f;
-				buildingpointBL.z = Building->Position().z - 8.0f;
-				BuildingPoints[3] = buildingpointBL;
-		
-				/* Will run through all the building points */
-				for (int i = 0; i < 4; i++)
-				{
-					/* Gets the vector between tanks */
-					CVector3 TankToTank = TankTarget->Position() - TurretMatrix.Position();
-					/* Normalises the vector */
-					CVector3 NormTankToTank = Normalise(TankToTank);
-					CVector3 DistVector = BuildingPoints[i] - TurretMatrix.Position();
-					/* Gets the length of the distance vector */
-					float Dist = sqrt(LengthSquared(DistVector));
-					/*Works out how far away we are*/
-					CVector3 DistanceAway = TurretMatrix.Position() + Dist * NormTankToTank;
-					/* Point to box to determine line of sight */
-					if (DistanceAway.x > Building->Position().x - 8 && DistanceAway.x < Building->Position().x + 8)
-					{
-						if(DistanceAway.z > Building->Position().z - 6 && DistanceAway.z < Building->Position().z + 6)
-						{
-						return true;
-						}
-					}
-				}
-			}
-			Building = EntityManager.EnumEntity();
-		}
-		EntityManager.EndEnumEntities();
-		return false;
-	}
+	// Random number generator for an entity, from Simulation.cpp - each tank has its own stream so
+	// its numbers don't depend on what any other tank does
+	extern CRandom GetEntityRandom(TEntityUID uid);
 
 	/*Sphere to sphere collision*/
 	bool SphereToSphere(CVector3 A, CVector3 B)
@@ -121,28 +91,6 @@ namespace gen
 			return false;
 		}
 	}
-	/*This will update all the tank targets so the list is never outdated*/
-	void CTankEntity::UpdateTankTargets()
-	{
-		m_Target.clear();
-		EntityManager.BeginEnumEntities("", "", "Tank");
-		CEntity* entity = EntityManager.EnumEntity();
-		int counter = 0;
-		/* Will get all the enemies of the current team and will put them into the target list */
-		while (entity != 0)
-		{
-			CTankEntity* TargetTank = static_cast<CTankEntity*>(entity);
-			if (TargetTank != this && TargetTank != NULL && TargetTank->m_Team != this->m_Team)
-			{
-
-				m_Target.push_back(TargetTank->GetUID());
-				++counter;
-			}
-			entity = EntityManager.EnumEntity();
-		}
-		EntityManager.EndEnumEntities();
-	}
-
 	/* This will update all the tank data that the tanks need */
 	void CTankEntity::UpdateTankData(int index)
 	{
@@ -160,6 +108,7 @@ namespace gen
 	/*Used to find the angles between tanks*/
 	float AngleMath(CMatrix4x4 TurretWorldMatrix, CVector3 TankFacingVector, CVector3 DistanceVector)
 	{
+		CTankProfileScope profile(TankZone_AngleMath);
 		/*Gets the magnitudes of both vectors */
 		float MagnitudeA = (TankFacingVector.x * TankFacingVector.x) + (TankFacingVector.y * TankFacingVector.y) + (TankFacingVector.z * TankFacingVector.z);
 		float MagnitudeB = (DistanceVector.x * DistanceVector.x) + (DistanceVector.y * DistanceVector.y) + (DistanceVector.z * DistanceVector.z);
@@ -179,14 +128,63 @@ namespace gen
 		float Angle = ACOS * 180.0f / 3.14;
 		return Angle;
 	}
+	/* Queues the tank to drive towards the target point, the steering pass moves it after all the updates */
+	void CTankEntity::SteerTowards(const CVector3& target)
+	{
+		CMatrix4x4 BodyMatrix = Matrix(1) * Matrix();
+		Steering.AddTank(GetUID(), Matrix().Position(), BodyMatrix.ZAxis(), target, m_Speed,
+			m_TankTemplate->GetMaxSpeed(), m_TankTemplate->GetAcceleration(), m_TankTemplate->GetTurnSpeed());
+	}
+	/* Drives the tank to the target point along a path around the buildings. A new path is asked for when the target moves,
+	   until one is ready (or if there is no path) the tank drives straight at the target */
+	void CTankEntity::DriveTo(const CVector3& target)
+	{
+		if (!HasPath || DistanceSquared(target, PathGoal) > 1.0f)
+		{
+			EPathResult result = NavGrid.FindPath(Matrix().Position(), target, Path);
+			if (result == Path_Pending)
+			{
+				SteerTowards(target);
+				return;
+			}
+			if (result == Path_None)
+			{
+				Path.clear();
+				Path.push_back(target);
+			}
+			HasPath = true;
+			PathGoal = target;
+			PathPointer = 0;
+		}
+		/* Move on to the next waypoint once close to the current one */
+		while (PathPointer + 1 < Path.size() && SphereToSphere(Matrix().Position(), Path[PathPointer]))
+		{
+			++PathPointer;
+		}
+		SteerTowards(Path[PathPointer]);
+	}
+	/* Drives the tank to a goal that other tanks may share, using the goal's flow field. The field is identified by goalKey.
+	   Until the field reaches the tank, and for the last stretch to the goal, the tank uses DriveTo */
+	void CTankEntity::FollowFlow(TUInt32 goalKey, const CVector3& target)
+	{
+		CVector3 direction;
+		if (FlowFields.GetDirection(goalKey, target, Matrix().Position(), direction))
+		{
+			SteerTowards(Matrix().Position() + direction * 5.0f);
+		}
+		else
+		{
+			DriveTo(target);
+		}
+	}
 	/* This is used to check the random poses and to make sure the tanks aren't already on the randompos */
-	CVector3 RandomPosChecker(CVector3 MatrixPos, CVector3 RanPos)
+	CVector3 RandomPosChecker(CVector3 MatrixPos, CVector3 RanPos, CRandom& random)
 	{
 		if (MatrixPos.x > RanPos.x - 5 && MatrixPos.x < RanPos.x + 5 &&
 			MatrixPos.z > RanPos.z - 5 && MatrixPos.z < RanPos.z + 5)
 		{
-			RanPos = CVector3(Random(MatrixPos.x - 20, MatrixPos.x + 20), 0.5, Random(MatrixPos.z - 20, MatrixPos.z + 20));
-			RandomPosChecker(MatrixPos, RanPos);
+			RanPos = CVector3(random.Random(MatrixPos.x - 20, MatrixPos.x + 20), 0.5, random.Random(MatrixPos.z - 20, MatrixPos.z + 20));
+			return RandomPosChecker(MatrixPos, RanPos, random);
 		}
 		else
 		{
@@ -224,219 +222,314 @@ namespace gen
 		m_HP = m_TankTemplate->GetMaxHP();
 		m_State = Inactive;
 		m_Timer = 0.0f;
+		m_Random = GetEntityRandom(UID);
+		RandomPos = CVector3(m_Random.Random(-20, 20), 0.5, m_Random.Random(-20, 20));
+	}
+
+
+	/*-----------------------------------------------------------------------------------------
+		State Machine Tables
+	-----------------------------------------------------------------------------------------*/
+
+	/* What each state is called, the handler that runs it and whether a tank in the state calls its team for help when
+	   it is hit. In the same order as EState so it can be indexed by the state */
+	const CTankEntity::SStateInfo CTankEntity::sm_States[NumStates] =
+	{
+		{ "Inactive", &CTankEntity::UpdateInactive, false },
+		{ "Patrol",   &CTankEntity::UpdatePatrol,   true  },
+		{ "Ammo",     &CTankEntity::UpdateAmmo,     true  },
+		{ "Health",   &CTankEntity::UpdateHealth,   true  },
+		{ "Dead",     &CTankEntity::UpdateDead,     false },
+		{ "Aim",      &CTankEntity::UpdateAim,      true  },
+		{ "Evade",    &CTankEntity::UpdateEvade,    true  },
+	};
+
+	/* The state a message moves the tank to. If there is an accept function the tank only changes state when it returns
+	   true, it also picks up any data the new state needs from the message */
+	const CTankEntity::STransition CTankEntity::sm_Transitions[] =
+	{
+		{ Msg_Start,  Patrol,   &CTankEntity::AcceptStart  },
+		{ Msg_Ammo,   Ammo,     &CTankEntity::AcceptAmmo   },
+		{ Msg_Health, Health,   &CTankEntity::AcceptHealth },
+		{ Msg_Help,   Aim,      &CTankEntity::AcceptHelp   },
+		{ Msg_Stop,   Inactive, NULL                       },
+	};
+	const TUInt32 CTankEntity::sm_NumTransitions = sizeof(sm_Transitions) / sizeof(sm_Transitions[0]);
+
+	/* Return the name of the given state */
+	const char* CTankEntity::GetStateName(EState state)
+	{
+		return sm_States[state].name;
 	}
 
 
-	// Update the tank - controls its behaviour. The shell code just performs some test behaviour, it
-	// is to be rewritten as one of the assignment requirements
+	// Update the tank - processes its messages. Damage from hits is applied and the other messages change the state
+	// through the transition table. The state's behaviour is run afterwards by the tank state machine along with all
+	// the other tanks in the same state
 	// Return false if the entity is to be destroyed
 	bool CTankEntity::Update(TFloat32 updateTime)
 	{
-		// Fetch any messages
-		SMessage msg;
-		while (Messenger.FetchMessage(GetUID(), &msg))
+		CTankProfileScope profile(TankZone_Messages);
+
+		// Fetch all messages in one batch
+		TUInt32 numMessages;
+		const SMessage* messages = Messenger.FetchAll(GetUID(), &numMessages);
+
+		/* Total up the damage from all the hits and apply it in one go, remember who hit the tank last so its team can
+		   be told */
+		TInt32 damage = 0;
+		for (TUInt32 i = 0; i < numMessages; ++i)
 		{
-			// Set state variables based on received messages
-			switch (msg.type)
+			if (messages[i].type == Msg_Hit)
 			{
-			case Msg_Start:
-				UpdateTankTargets();
-				targetPos = PatrolList.at(PatrolPointer);
-				m_State = Patrol;
-				break;
-			case Msg_Hit:
-				this->m_HP -= msg.damage;
-				break;
-			case Msg_Ammo:
-				if (ShootsFired >= 5 && m_State != Dead)
-				{
-					m_State = Ammo;
-				}
-				break;
-			case Msg_Health:
-				if (m_HP <= 50 && m_State != Dead)
+				if (messages[i].HasPayload<SDamagePayload>())
 				{
-					m_State = Health;
+					damage += messages[i].GetPayload<SDamagePayload>().damage;
 				}
-				break;
-			case Msg_Help:
-				UpdateTankTargets();
-				for (int i = 0; i < m_Target.size(); i++)
+				WasHit = true;
+				LastHitBy = messages[i].from;
+			}
+		}
+		this->m_HP -= damage;
+
+		// Set state based on received messages
+		for (TUInt32 i = 0; i < numMessages; ++i)
+		{
+			const SMessage& msg = messages[i];
+			for (TUInt32 t = 0; t < sm_NumTransitions; ++t)
+			{
+				if (sm_Transitions[t].message == msg.type)
 				{
-					if (msg.from == m_Target.at(i))
+					if (sm_Transitions[t].accept == NULL || (this->*sm_Transitions[t].accept)(msg))
 					{
-						CEntity* Entity = EntityManager.GetEntity(msg.from);
-						CTankEntity* TankEntity = static_cast<CTankEntity*>(Entity);
-						if (TankEntity->m_State != Dead)
-						{
-							SavedEnemyIndex = i;
-						}
+						m_State = sm_Transitions[t].newState;
 					}
+					break;
 				}
-				m_State = Aim;
-				break;
-			case Msg_Stop:
-				m_State = Inactive;
-				break;
 			}
 		}
+		return true; // Don't destroy the entity
+	}
 
-		/* Tanks start in this state */
-		if (m_State == Inactive)
+	/* Run the behaviour for the tank's current state, called by the tank state machine. If the tank was hit this tick and
+	   its state calls for help it tells its team. The handler's time is counted against the state by the tank profiler.
+	   Return false if the tank is to be destroyed */
+	bool CTankEntity::UpdateState(TFloat32 updateTime)
+	{
+		const SStateInfo& state = sm_States[m_State];
+		bool alive;
 		{
-			
+			CTankProfileScope profile(static_cast<ETankProfileZone>(m_State));
+			alive = (this->*state.handler)(updateTime);
 		}
-		/* This state is triggered when the the tanks have fired or can't shoot there target */
-		if (m_State == Evade)
+		if (!alive)
 		{
-			/*Check the random pos*/
-			RandomPos = RandomPosChecker(Matrix().Position(), RandomPos);
-			/* This will get the rotation of the turret */
-			CVector3 Rotation;
-			Matrix(2).DecomposeAffineEuler(NULL, &Rotation, NULL);
-			/* Make the turns rotate to the front of the turret */
-			if (Rotation.y < 0)
-			{
-				Matrix(2).RotateLocalY(m_TankTemplate->GetTurretTurnSpeed() * updateTime);
-			}
-			if (Rotation.y > 0)
-			{
-				Matrix(2).RotateLocalY(-m_TankTemplate->GetTurretTurnSpeed() * updateTime);
-			}
-			/*Gets the body matrix*/
-			CMatrix4x4 BodyMatrix = Matrix(0) * Matrix(1);
-			CVector3 Facing = -BodyMatrix.ZAxis();
-			targetPos = this->RandomPos;
-			CVector3 DistanceVect = Matrix().Position() - targetPos;
-			DistanceVect.Normalise();
-			/* Makes the speed faster if not already at the max*/
-			if (m_Speed < m_TankTemplate->GetMaxSpeed())
-			{
-				m_Speed += m_TankTemplate->GetAcceleration();
-			}
-			/*Finds the angle*/
-			float Angle = AngleMath(BodyMatrix, Facing, DistanceVect);
-			/*Gets the dot product to determine weather it left or right*/
-			float DotProduct = Dot(DistanceVect, BodyMatrix.XAxis());
-			/* if the angle is dead ahead then more at normal speed*/
-			if (Angle < 3.0f)
-			{
-				Matrix().FaceTarget(RandomPos);
-				Matrix().MoveLocalZ(m_Speed * updateTime);
-			}
-			else
+			return false;
+		}
+		if (WasHit && state.callsForHelp)
+		{
+			CallForHelp();
+		}
+		WasHit = false;
+
+		if (this->m_HP <= 0)
+		{
+			m_State = Dead;
+		}
+		return true;
+	}
+
+	/* Send a help message to all the other tanks on this team that are free to come and help. The message comes from the
+	   tank that hit this one so the helpers know who to aim at */
+	void CTankEntity::CallForHelp()
+	{
+		CTankProfileScope profile(TankZone_Help);
+		SMessage msg;
+		msg.type = Msg_Help;
+		msg.from = LastHitBy;
+
+		EntityManager.BeginEnumEntities("", "", "Tank");
+		CEntity* entity = EntityManager.EnumEntity();
+		while (entity != 0)
+		{
+			CTankEntity* TankEntity = static_cast<CTankEntity*>(entity);
+			if (TankEntity->GetTeam() == this->GetTeam())
 			{
-				/* If the angle is not dead ahead this will determine which way the tank needs to turn */
-				if (DotProduct > 0.0f)
-				{
-					Matrix().MoveLocalZ(m_TankTemplate->GetTurnSpeed() * updateTime);
-					Matrix().RotateLocalY((-m_TankTemplate->GetTurnSpeed() / 2) * updateTime);
-				}
-				if (DotProduct < -0.0f)
+				/* Will only send to tanks that are not in there states */
+				if (TankEntity != this && TankEntity->GetShootsFired() != 10 && TankEntity->m_State != TankEntity->Dead &&
+					TankEntity->m_State != TankEntity->Aim && TankEntity->m_State != TankEntity->Ammo && TankEntity->m_State != TankEntity->Health
+					)
 				{
-					Matrix().MoveLocalZ(m_TankTemplate->GetTurnSpeed() * updateTime);
-					Matrix().RotateLocalY((m_TankTemplate->GetTurnSpeed() / 2) * updateTime);
+					Messenger.SendMessage(TankEntity->GetUID(), msg);
 				}
 			}
-			/* Check to see if the tank is already at the random pos */
-			if (SphereToSphere(Matrix().GetPosition(), this->RandomPos))
-			{
-				m_State = Patrol;
-				Fired = false;
-				this->RandomPos = CVector3(Random(Matrix().Position().x - 20, Matrix().Position().x + 20), 0.5, Random(Matrix().Position().z - 20, Matrix().Position().z + 20));
-			}
-			/* If the tank is hit it will send this message out to all the other tanks on its team */
-			if (msg.type == Msg_Hit)
+			entity = EntityManager.EnumEntity();
+		}
+		EntityManager.EndEnumEntities();
+	}
+
+
+	/*-----------------------------------------------------------------------------------------
+		Message Transitions
+	-----------------------------------------------------------------------------------------*/
+
+	/* Start patrolling from the current patrol point */
+	bool CTankEntity::AcceptStart(const SMessage& msg)
+	{
+		targetPos = PatrolList.at(PatrolPointer);
+		return true;
+	}
+
+	/* Only go for the ammo crate if the tank has used enough shells */
+	bool CTankEntity::AcceptAmmo(const SMessage& msg)
+	{
+		if (ShootsFired >= 5 && m_State != Dead)
+		{
+			PickupUID = msg.GetPayload<SPickupPayload>().pickup;
+			return true;
+		}
+		return false;
+	}
+
+	/* Only go for the health crate if the tank is damaged enough */
+	bool CTankEntity::AcceptHealth(const SMessage& msg)
+	{
+		if (m_HP <= 50 && m_State != Dead)
+		{
+			PickupUID = msg.GetPayload<SPickupPayload>().pickup;
+			return true;
+		}
+		return false;
+	}
+
+	/* Aim at the tank that hit the team mate asking for help */
+	bool CTankEntity::AcceptHelp(const SMessage& msg)
+	{
+		/* The attacker may not be one of the targets this tank can see, if not it is added to the list */
+		CEntity* Entity = EntityManager.GetEntity(msg.from);
+		CTankEntity* TankEntity = static_cast<CTankEntity*>(Entity);
+		if (TankEntity != NULL && TankEntity->m_Team != this->m_Team && TankEntity->m_State != Dead)
+		{
+			vector<TEntityUID>::iterator target = find(m_Target.begin(), m_Target.end(), msg.from);
+			if (target == m_Target.end())
 			{
-				EntityManager.BeginEnumEntities("", "", "Tank");
-				CEntity* entity = EntityManager.EnumEntity();
-				while (entity != 0)
-				{
-					CTankEntity* TankEntity = static_cast<CTankEntity*>(entity);
-					if (TankEntity->GetTeam() == this->GetTeam())
-					{
-						/* Will only send to tanks that are not in there states */
-						if (TankEntity != this && TankEntity->GetShootsFired() != 10 && TankEntity->m_State != TankEntity->Dead &&
-							TankEntity->m_State != TankEntity->Aim && TankEntity->m_State != TankEntity->Ammo && TankEntity->m_State != TankEntity->Health
-							)
-						{
-							TEntityUID UID = TankEntity->GetUID();
-							msg.type = Msg_Help;
-							//msg.from = SystemUID;
-							Messenger.SendMessage(UID, msg);
-						}
-					}
-					entity = EntityManager.EnumEntity();
-				}
-				EntityManager.EndEnumEntities();
+				m_Target.push_back(msg.from);
+				target = m_Target.end() - 1;
 			}
+			SavedEnemyIndex = static_cast<int>(target - m_Target.begin());
+		}
+		return true;
+	}
+
 
+	/*-----------------------------------------------------------------------------------------
+		State Handlers
+	-----------------------------------------------------------------------------------------*/
+
+	/* Tanks start in this state */
+	bool CTankEntity::UpdateInactive(TFloat32 updateTime)
+	{
+		return true;
+	}
+
+	/* This state is triggered when the the tanks have fired or can't shoot there target */
+	bool CTankEntity::UpdateEvade(TFloat32 updateTime)
+	{
+		/*Check the random pos*/
+		{
+			CTankProfileScope profile(TankZone_RandomPos);
+			RandomPos = RandomPosChecker(Matrix().Position(), RandomPos, m_Random);
+		}
+		/* This will get the rotation of the turret */
+		CVector3 Rotation;
+		Matrix(2).DecomposeAffineEuler(NULL, &Rotation, NULL);
+		/* Make the turns rotate to the front of the turret */
+		if (Rotation.y < 0)
+		{
+			Matrix(2).RotateLocalY(m_TankTemplate->GetTurretTurnSpeed() * updateTime);
+		}
+		if (Rotation.y > 0)
+		{
+			Matrix(2).RotateLocalY(-m_TankTemplate->GetTurretTurnSpeed() * updateTime);
+		}
+		/* Drive to the random pos */
+		targetPos = this->RandomPos;
+		DriveTo(targetPos);
+		/* Check to see if the tank is already at the random pos */
+		if (SphereToSphere(Matrix().GetPosition(), this->RandomPos))
+		{
+			m_State = Patrol;
+			Fired = false;
+			CTankProfileScope profile(TankZone_RandomPos);
+			this->RandomPos = CVector3(m_Random.Random(Matrix().Position().x - 20, Matrix().Position().x + 20), 0.5, m_Random.Random(Matrix().Position().z - 20, Matrix().Position().z + 20));
 		}
-		/* This state is used by the tanks to get a more accureate shot on the enemy tank */
-		if (m_State == Aim)
+		return true;
+	}
+
+	/* This state is used by the tanks to get a more accureate shot on the enemy tank */
+	bool CTankEntity::UpdateAim(TFloat32 updateTime)
+	{
+		/*Checks to see if the tanks ammo isn't empty*/
+		if (this->ShootsFired != 10)
 		{
-			/*Checks to see if the tanks ammo isn't empty*/
-			if (this->ShootsFired != 10)
+			/* Check to see if the saved index isn't null */
+			if (SavedEnemyIndex < m_Target.size())
 			{
-				/* Check to see if the saved index isn't null */
-				if (SavedEnemyIndex < m_Target.size())
+				/* Check to see if a shot has been fired */
+				if (Fired == false)
 				{
-					/* Check to see if a shot has been fired */
-					if (Fired == false)
+					CEntity* Tank = EntityManager.GetEntity(m_Target.at(SavedEnemyIndex));
+					CTankEntity* TankEntity = static_cast<CTankEntity*>(Tank);
+					/*Check to see if the target is dead*/
+					if (m_Target[SavedEnemyIndex] != NULL && TankEntity->m_State != TankEntity->Dead)
+					{
+						UpdateTankData(m_Target[SavedEnemyIndex]);
+					}
+					/*Check to see if they have line of sight*/
+					bool LineOfSight;
+					{
+						CTankProfileScope profile(TankZone_LineOfSight);
+						LineOfSight = Perception.HasLineOfSight(GetUID(), m_Target[SavedEnemyIndex]);
+					}
+					if (LineOfSight)
 					{
-						CEntity* Tank = EntityManager.GetEntity(m_Target.at(SavedEnemyIndex));
-						CTankEntity* TankEntity = static_cast<CTankEntity*>(Tank);
-						/*Check to see if the target is dead*/
 						if (m_Target[SavedEnemyIndex] != NULL && TankEntity->m_State != TankEntity->Dead)
 						{
-							UpdateTankData(m_Target[SavedEnemyIndex]);
-						}
-						/*Check to see if they have line of sight*/
-						if (!LineOfSight(this->TankFacingVector, this->TurretWorldMatrix, TankTarget))
-						{
-							if (m_Target[SavedEnemyIndex] != NULL && TankEntity->m_State != TankEntity->Dead)
+							/*Gets the angle*/
+							Angle = AngleMath(this->TurretWorldMatrix, this->TankFacingVector, this->DistanceVector);
+							float DotProduct = Dot(DistanceVector, this->TurretWorldMatrix.XAxis());
+							if (this->Timer >= 0.0f)
 							{
-								/*Gets the angle*/
-								Angle = AngleMath(this->TurretWorldMatrix, this->TankFacingVector, this->DistanceVector);
-								float DotProduct = Dot(DistanceVector, this->TurretWorldMatrix.XAxis());
-								if (this->Timer >= 0.0f)
+								Timer -= updateTime;
+								/*If the angle is in the correct rotation*/
+								if (Angle < 2.0f)
 								{
-									Timer -= updateTime;
-									/*If the angle is in the correct rotation*/
-									if (Angle < 2.0f)
-									{
-										TurretWorldMatrix.FaceTarget(TankTarget->Position());
-									}
-									/* Else it will turn the fasters way to reach the target */
-									else if (DotProduct > 0.0f)
-									{
-										Matrix(2).RotateLocalY((m_TankTemplate->GetTurretTurnSpeed() * 2) * updateTime);
-									}
-									else if (DotProduct < -0.0f)
-									{
-										Matrix(2).RotateLocalY((-m_TankTemplate->GetTurretTurnSpeed() * 2) * updateTime);
-									}
-
+									TurretWorldMatrix.FaceTarget(TankTarget->Position());
+								}
+								/* Else it will turn the fasters way to reach the target */
+								else if (DotProduct > 0.0f)
+								{
+									Matrix(2).RotateLocalY((m_TankTemplate->GetTurretTurnSpeed() * 2) * updateTime);
 								}
-								/* If the timer is 0 then it will create the shell*/
-								if (this->Timer <= 0)
+								else if (DotProduct < -0.0f)
 								{
-									CVector3 TurretRot;
-									this->TurretWorldMatrix.DecomposeAffineEuler(NULL, &TurretRot, NULL);
-									CMatrix4x4 NewMatrix = Matrix(2) * Matrix();
-									Timer = 1.0f;
-									EntityManager.CreateShell("Shell Type 1", GetName(), this->TurretWorldMatrix.Position(), TurretRot);
-									++this->ShootsFired;
-									Fired = true;
-									m_State = Evade;
+									Matrix(2).RotateLocalY((-m_TankTemplate->GetTurretTurnSpeed() * 2) * updateTime);
 								}
 
 							}
-							else
+							/* If the timer is 0 then it will create the shell*/
+							if (this->Timer <= 0)
 							{
-								m_State = Evade;
+								CVector3 TurretRot;
+								this->TurretWorldMatrix.DecomposeAffineEuler(NULL, &TurretRot, NULL);
+								CMatrix4x4 NewMatrix = Matrix(2) * Matrix();
 								Timer = 1.0f;
+								EntityManager.CreateShell("Shell Type 1", GetUID(), m_Team, m_TankTemplate->GetShellDamage(), GetName(), this->TurretWorldMatrix.Position(), TurretRot);
+								++this->ShootsFired;
+								Fired = true;
+								m_State = Evade;
 							}
+
 						}
 						else
 						{
@@ -458,298 +551,153 @@ namespace gen
 			}
 			else
 			{
-				m_State = Ammo;
+				m_State = Evade;
 				Timer = 1.0f;
 			}
-
-			/* If the tank is hit it will send this message out to all the other tanks on its team */
-			if (msg.type == Msg_Hit)
-			{
-				EntityManager.BeginEnumEntities("", "", "Tank");
-				CEntity* entity = EntityManager.EnumEntity();
-				while (entity != 0)
-				{
-					CTankEntity* TankEntity = static_cast<CTankEntity*>(entity);
-					if (TankEntity->GetTeam() == this->GetTeam())
-					{
-						if (TankEntity != this && TankEntity->GetShootsFired() != 10 && TankEntity->m_State != TankEntity->Dead &&
-							TankEntity->m_State != TankEntity->Aim && TankEntity->m_State != TankEntity->Ammo && TankEntity->m_State != TankEntity->Health)
-						{
-							TEntityUID UID = TankEntity->GetUID();
-							msg.type = Msg_Help;
-							//msg.from = SystemUID;
-							Messenger.SendMessage(UID, msg);
-						}
-					}
-					entity = EntityManager.EnumEntity();
-				}
-				EntityManager.EndEnumEntities();
-			}
-
 		}
-		/* This is used when the tanks need ammo, takes elements from other states so look above ^ */
-		if (m_State == Ammo)
+		else
 		{
+			m_State = Ammo;
+			Timer = 1.0f;
+		}
+		return true;
+	}
 
-			EntityManager.BeginEnumEntities("", "", "AmmoCreate");
-			CEntity* entity = EntityManager.EnumEntity();
-			if (entity != NULL)
-			{
-				this->targetPos = entity->Position();
-				CMatrix4x4 BodyMatrix = Matrix(0) * Matrix(1);
-				CVector3 Facing = -BodyMatrix.ZAxis();
-				CVector3 DistanceVect = Matrix().Position() - targetPos;
-				DistanceVect.Normalise();
-				if (m_Speed < m_TankTemplate->GetMaxSpeed())
-				{
-					m_Speed += m_TankTemplate->GetAcceleration();
-				}
-				float Angle = AngleMath(BodyMatrix, Facing, DistanceVect);
-				float DotProduct = Dot(DistanceVect, BodyMatrix.XAxis());
-				if (Angle < 3.0f)
-				{
-					Matrix().FaceTarget(this->targetPos);
-					Matrix().MoveLocalZ(m_Speed * updateTime);
-				}
-				else
-				{
-					if (DotProduct > 0.0f)
-					{
-						Matrix().MoveLocalZ(m_TankTemplate->GetTurnSpeed() * updateTime);
-						Matrix().RotateLocalY((-m_TankTemplate->GetTurnSpeed() / 2) * updateTime);
-					}
-					if (DotProduct < -0.0f)
-					{
-						Matrix().MoveLocalZ(m_TankTemplate->GetTurnSpeed() * updateTime);
-						Matrix().RotateLocalY((m_TankTemplate->GetTurnSpeed() / 2) * updateTime);
-					}
-				}
-				if (SphereToSphere(Matrix().GetPosition(), this->targetPos))
-				{
-					AmmoEntity* AE = static_cast<AmmoEntity*>(entity);
-					this->ShootsFired = 0;
-					AE->PickedUp = true;
-					m_State = Patrol;
-				}
-			}
-			else
+	/* This is used when the tanks need ammo, takes elements from other states so look above ^ */
+	bool CTankEntity::UpdateAmmo(TFloat32 updateTime)
+	{
+		/* Head for the crate named in the ammo message, if it's still there */
+		CEntity* entity = EntityManager.GetEntity(PickupUID);
+		if (entity != NULL)
+		{
+			this->targetPos = entity->Position();
+			FollowFlow(PickupUID, this->targetPos);
+			if (SphereToSphere(Matrix().GetPosition(), this->targetPos))
 			{
+				AmmoEntity* AE = static_cast<AmmoEntity*>(entity);
+				this->ShootsFired = 0;
+				AE->PickedUp = true;
 				m_State = Patrol;
 			}
-			if (msg.type == Msg_Hit)
-			{
-				EntityManager.BeginEnumEntities("", "", "Tank");
-				CEntity* entity = EntityManager.EnumEntity();
-				while (entity != 0)
-				{
-					CTankEntity* TankEntity = static_cast<CTankEntity*>(entity);
-					if (TankEntity->GetTeam() == this->GetTeam())
-					{
-						if (TankEntity != this && TankEntity->GetShootsFired() != 10 && TankEntity->m_State != TankEntity->Dead &&
-							TankEntity->m_State != TankEntity->Aim && TankEntity->m_State != TankEntity->Ammo && TankEntity->m_State != TankEntity->Health)
-						{
-							TEntityUID UID = TankEntity->GetUID();
-							msg.type = Msg_Help;
-							//msg.from = SystemUID;
-							Messenger.SendMessage(UID, msg);
-						}
-					}
-					entity = EntityManager.EnumEntity();
-				}
-				EntityManager.EndEnumEntities();
-			}
 		}
-		/* This is the sames as the ammo create but with health instead, see above ^*/
-		if (m_State == Health)
+		else
 		{
-			EntityManager.BeginEnumEntities("", "", "HealthCreate");
-			CEntity* entity = EntityManager.EnumEntity();
-			if (entity != NULL)
-			{
-				this->targetPos = entity->Position();
-				CMatrix4x4 BodyMatrix = Matrix(0) * Matrix(1);
-				CVector3 Facing = -BodyMatrix.ZAxis();
-				CVector3 DistanceVect = Matrix().Position() - targetPos;
-				DistanceVect.Normalise();
-				if (m_Speed < m_TankTemplate->GetMaxSpeed())
-				{
-					m_Speed += m_TankTemplate->GetAcceleration();
-				}
-				float Angle = AngleMath(BodyMatrix, Facing, DistanceVect);
-				float DotProduct = Dot(DistanceVect, BodyMatrix.XAxis());
-				if (Angle < 3.0f)
-				{
-					Matrix().FaceTarget(this->targetPos);
-					Matrix().MoveLocalZ(m_Speed * updateTime);
-				}
-				else
-				{
-					if (DotProduct > 0.0f)
-					{
-						Matrix().MoveLocalZ(m_TankTemplate->GetTurnSpeed() * updateTime);
-						Matrix().RotateLocalY((-m_TankTemplate->GetTurnSpeed() / 2) * updateTime);
-					}
-					if (DotProduct < -0.0f)
-					{
-						Matrix().MoveLocalZ(m_TankTemplate->GetTurnSpeed() * updateTime);
-						Matrix().RotateLocalY((m_TankTemplate->GetTurnSpeed() / 2) * updateTime);
-					}
-				}
-				if (SphereToSphere(Matrix().GetPosition(), this->targetPos))
-				{
-					AmmoEntity* AE = static_cast<AmmoEntity*>(entity);
-					this->m_HP += 50;
-					AE->PickedUp = true;
-					m_State = Patrol;
-				}
-			}
-			else
+			m_State = Patrol;
+		}
+		return true;
+	}
+
+	/* This is the sames as the ammo create but with health instead, see above ^*/
+	bool CTankEntity::UpdateHealth(TFloat32 updateTime)
+	{
+		CEntity* entity = EntityManager.GetEntity(PickupUID);
+		if (entity != NULL)
+		{
+			this->targetPos = entity->Position();
+			FollowFlow(PickupUID, this->targetPos);
+			if (SphereToSphere(Matrix().GetPosition(), this->targetPos))
 			{
+				AmmoEntity* AE = static_cast<AmmoEntity*>(entity);
+				this->m_HP += 50;
+				AE->PickedUp = true;
 				m_State = Patrol;
 			}
-			if (msg.type == Msg_Hit)
-			{
-				EntityManager.BeginEnumEntities("", "", "Tank");
-				CEntity* entity = EntityManager.EnumEntity();
-				while (entity != 0)
-				{
-					CTankEntity* TankEntity = static_cast<CTankEntity*>(entity);
-					if (TankEntity->GetTeam() == this->GetTeam())
-					{
-						if (TankEntity != this && TankEntity->GetShootsFired() != 10 && TankEntity->m_State != TankEntity->Dead &&
-							TankEntity->m_State != TankEntity->Aim && TankEntity->m_State != TankEntity->Ammo && TankEntity->m_State != TankEntity->Health)
-						{
-							TEntityUID UID = TankEntity->GetUID();
-							msg.type = Msg_Help;
-							//msg.from = SystemUID;
-							Messenger.SendMessage(UID, msg);
-						}
-					}
-					entity = EntityManager.EnumEntity();
-				}
-				EntityManager.EndEnumEntities();
-			}
 		}
-		if (m_State == Patrol)
+		else
+		{
+			m_State = Patrol;
+		}
+		return true;
+	}
+
+	/* Follow the patrol route, looking for enemies to aim at */
+	bool CTankEntity::UpdatePatrol(TFloat32 updateTime)
+	{
+		if (PatrolPointer == PatrolList.size())
+		{
+			PatrolPointer = 0;
+		}
+		targetPos = PatrolList.at(PatrolPointer);
+		//m_Speed = 10.0f;
+		CMatrix4x4 BodyMatrix = Matrix(1) * Matrix();
+		if (SphereToSphere(BodyMatrix.Position(), targetPos))
 		{
 			if (PatrolPointer == PatrolList.size())
 			{
 				PatrolPointer = 0;
 			}
 			targetPos = PatrolList.at(PatrolPointer);
-			//m_Speed = 10.0f;
-			CMatrix4x4 BodyMatrix = Matrix(1) * Matrix();
-			CVector3 Facing = -BodyMatrix.ZAxis();
-			if (SphereToSphere(BodyMatrix.Position(), targetPos))
-			{
-				if (PatrolPointer == PatrolList.size())
-				{
-					PatrolPointer = 0;
-				}
-				targetPos = PatrolList.at(PatrolPointer);
-				++PatrolPointer;
-			}
-			if (m_Speed < m_TankTemplate->GetMaxSpeed())
-			{
-				m_Speed += m_TankTemplate->GetAcceleration();
-			}
-			CVector3 DistanceVect = Matrix().Position() - targetPos;
-			DistanceVect.Normalise();
-			float Angle = AngleMath(BodyMatrix, Facing, DistanceVect);
-			float DotProduct = Dot(DistanceVect, BodyMatrix.XAxis());
-			if (Angle < 3.0f)
-			{
-				Matrix().FaceTarget(targetPos);
-				Matrix().MoveLocalZ(m_Speed * updateTime);
-			}
-			else
+			++PatrolPointer;
+		}
+		TInt32 PatrolCell = NavGrid.CellFromPoint(targetPos);
+		if (PatrolCell >= 0)
+		{
+			FollowFlow(PatrolFlowKey | PatrolCell, targetPos);
+		}
+		else
+		{
+			SteerTowards(targetPos);
+		}
+		/* Looking for a target is only done when the scheduler gives the tank a turn, the tank keeps moving in between */
+		if (ThinkScheduler.ShouldThink(GetUID(), m_State, Matrix().Position()))
+		{
+			/* The perception stage has already listed the enemies in sight and whether each is in the turret's cone, they
+			   become the targets */
+			TUInt32 numSightings;
+			const CPerception::SSighting* sightings;
 			{
-				if (DotProduct > 0.0f)
-				{
-					Matrix().MoveLocalZ(m_TankTemplate->GetTurnSpeed() * updateTime);
-					Matrix().RotateLocalY(-(m_TankTemplate->GetTurnSpeed() / 2) * updateTime);
-				}
-				if (DotProduct < -0.0f)
+				CTankProfileScope profile(TankZone_Targets);
+				sightings = Perception.GetSightings(GetUID(), &numSightings);
+				m_Target.clear();
+				for (TUInt32 i = 0; i < numSightings; i++)
 				{
-					Matrix().MoveLocalZ(m_TankTemplate->GetTurnSpeed() * updateTime);
-					Matrix().RotateLocalY((m_TankTemplate->GetTurnSpeed() / 2) * updateTime);
+					m_Target.push_back(sightings[i].target);
 				}
 			}
-			UpdateTankTargets();
-			for (int i = 0; i < m_Target.size(); i++)
+			for (TUInt32 i = 0; i < numSightings; i++)
 			{
-				CEntity* Tank = EntityManager.GetEntity(this->m_Target.at(i));
+				CEntity* Tank = EntityManager.GetEntity(sightings[i].target);
 				CTankEntity* TankEntity = static_cast<CTankEntity*>(Tank);
-				if (TankEntity->m_State != TankEntity->Dead)
+				if (sightings[i].inCone && TankEntity != NULL && TankEntity->m_State != TankEntity->Dead)
 				{
-					UpdateTankData(this->m_Target.at(i));
-					Angle = AngleMath(this->TurretWorldMatrix, this->TankFacingVector, this->DistanceVector);
-					if (Angle < 15.0f && !LineOfSight(this->TankFacingVector, Matrix(), TankTarget))
-					{
-						SavedEnemyIndex = i;
-						m_State = Aim;
-
-					}
-
+					UpdateTankData(sightings[i].target);
+					SavedEnemyIndex = i;
+					m_State = Aim;
 				}
 			}
-			if (m_Target.size() == 0)
-			{
-				Matrix(2).RotateLocalY(m_TankTemplate->GetTurretTurnSpeed() * updateTime);
-			}
+			ThinkScheduler.EndThink();
+		}
+		if (m_Target.size() == 0)
+		{
 			Matrix(2).RotateLocalY(m_TankTemplate->GetTurretTurnSpeed() * updateTime);
-			if (msg.type == Msg_Hit)
-			{
-				EntityManager.BeginEnumEntities("", "", "Tank");
-				CEntity* entity = EntityManager.EnumEntity();
-				while (entity != 0)
-				{
-					CTankEntity* TankEntity = static_cast<CTankEntity*>(entity);
-					if (TankEntity->GetTeam() == this->GetTeam())
-					{
-						if (TankEntity != this && TankEntity->GetShootsFired() != 10 && TankEntity->m_State != TankEntity->Dead &&
-							TankEntity->m_State != TankEntity->Aim && TankEntity->m_State != TankEntity->Ammo && TankEntity->m_State != TankEntity->Health)
-						{
-							TEntityUID UID = TankEntity->GetUID();
-							msg.type = Msg_Help;
-							//msg.from = SystemUID;
-							Messenger.SendMessage(UID, msg);
-						}
-					}
-					entity = EntityManager.EnumEntity();
-				}
-				EntityManager.EndEnumEntities();
-			}
 		}
+		Matrix(2).RotateLocalY(m_TankTemplate->GetTurretTurnSpeed() * updateTime);
+		return true;
+	}
 
-		if (m_State == Dead)
+	/* Throw the turret up and drop it again, then the tank is destroyed */
+	bool CTankEntity::UpdateDead(TFloat32 updateTime)
+	{
+		if (DeathTimer >= 0)
 		{
-			if (DeathTimer >= 0)
+			Matrix(2).MoveY(10 * updateTime);
+			Matrix(2).RotateZ(10 * updateTime);
+			DeathTimer -= updateTime;
+		}
+		else
+		{
+			if (DeathTimer2 <= 1.0f)
 			{
-				Matrix(2).MoveY(10 * updateTime);
-				Matrix(2).RotateZ(10 * updateTime);
-				DeathTimer -= updateTime;
+				Matrix(2).MoveY(-10 * updateTime);
+				Matrix(2).RotateZ(-10 * updateTime);
+				DeathTimer2 += updateTime;
 			}
 			else
 			{
-				if (DeathTimer2 <= 1.0f)
-				{
-					Matrix(2).MoveY(-10 * updateTime);
-					Matrix(2).RotateZ(-10 * updateTime);
-					DeathTimer2 += updateTime;
-				}
-				else
-				{
-					return false;
-				}
+				return false;
 			}
 		}
-
-		if (this->m_HP <= 0)
-		{
-			m_State = Dead;
-		}
-		return true; // Don't destroy the entity
+		return true;
 	}
 
 
@@ -12,6 +12,8 @@ using namespace std;
 #include "Defines.h"
 #include "CVector3.h"
 #include "Entity.h"
+#include "Messenger.h"
+#include "CRandom.h"
 
 namespace gen
 {
@@ -151,7 +153,9 @@ namespace gen
 			Health,
 			Dead,
 			Aim,
-			Evade
+			Evade,
+
+			NumStates // Not a state - the number of states above
 		};
 		EState   m_State; // Current state
 		/////////////////////////////////////
@@ -161,6 +165,10 @@ namespace gen
 		{
 			return m_Speed;
 		}
+		void SetSpeed(TFloat32 Set)
+		{
+			m_Speed = Set;
+		}
 		TInt32 GetHP()
 		{
 			return m_HP;
@@ -219,37 +227,10 @@ namespace gen
 		}
 		string GetStateToString()
 		{
-			switch (m_State)
-			{
-			case gen::CTankEntity::Inactive:
-				return "Inactive";
-				break;
-			case gen::CTankEntity::Patrol:
-				return "Patrol";
-				break;
-			case gen::CTankEntity::Ammo:
-				return "Ammo";
-				break;
-			case gen::CTankEntity::Health:
-				return "Health";
-				break;
-			case gen::CTankEntity::Dead:
-				return "Dead";
-				break;
-			case gen::CTankEntity::Aim:
-				return "Aim";
-				break;
-			case gen::CTankEntity::Evade:
-				return "Evade";
-				break;
-			//case gen::CTankEntity::Stop:
-			//	return "Stop";
-			//	break;
-			//case gen::CTankEntity::Go:
-			//	return "Go";
-			//	break;
-			}
+			return GetStateName(m_State);
 		}
+		// Return the name of the given state
+		static const char* GetStateName(EState state);
 		int GetTeam()
 		{
 			return m_Team;
@@ -258,12 +239,20 @@ namespace gen
 		/////////////////////////////////////
 		// Update
 
-		// Update the tank - performs tank message processing and behaviour
+		// Update the tank - performs tank message processing, the state behaviour is run separately
+		// by UpdateState
 		// Return false if the entity is to be destroyed
 		// Keep as a virtual function in case of further derivation
 		virtual bool Update(TFloat32 updateTime);
+
+		// Run the behaviour for the current state, called by the tank state machine for all the
+		// tanks in the same state together
+		// Return false if the entity is to be destroyed
+		bool UpdateState(TFloat32 updateTime);
 		void UpdateTankData(int Index);
-		void UpdateTankTargets();
+		void SteerTowards(const CVector3& target);
+		void DriveTo(const CVector3& target);
+		void FollowFlow(TUInt32 goalKey, const CVector3& target);
 
 		/////////////////////////////////////
 		//	Private interface
@@ -272,6 +261,53 @@ namespace gen
 		/////////////////////////////////////
 		// Types
 
+		// Each state's name, the member function that runs it and whether a tank in the state
+		// calls its team for help when it is hit
+		typedef bool (CTankEntity::*TStateHandler)(TFloat32 updateTime);
+		struct SStateInfo
+		{
+			const char*   name;
+			TStateHandler handler;
+			bool          callsForHelp;
+		};
+
+		// A change of state caused by a message. The accept function, if any, decides whether the
+		// tank takes the message and reads any data the new state needs from it
+		typedef bool (CTankEntity::*TAcceptMessage)(const SMessage& msg);
+		struct STransition
+		{
+			EMessageType   message;
+			EState         newState;
+			TAcceptMessage accept;
+		};
+
+		// State table in EState order, and the message transition table
+		static const SStateInfo  sm_States[NumStates];
+		static const STransition sm_Transitions[];
+		static const TUInt32     sm_NumTransitions;
+
+
+		/////////////////////////////////////
+		// State machine
+
+		// State handlers, return false if the tank is to be destroyed
+		bool UpdateInactive(TFloat32 updateTime);
+		bool UpdatePatrol(TFloat32 updateTime);
+		bool UpdateAmmo(TFloat32 updateTime);
+		bool UpdateHealth(TFloat32 updateTime);
+		bool UpdateDead(TFloat32 updateTime);
+		bool UpdateAim(TFloat32 updateTime);
+		bool UpdateEvade(TFloat32 updateTime);
+
+		// Message accept functions for the transition table
+		bool AcceptStart(const SMessage& msg);
+		bool AcceptAmmo(const SMessage& msg);
+		bool AcceptHealth(const SMessage& msg);
+		bool AcceptHelp(const SMessage& msg);
+
+		// Tell the rest of the team that this tank has been hit
+		void CallForHelp();
+
 
 		/////////////////////////////////////
 		// Data
@@ -284,7 +320,7 @@ namespace gen
 		TFloat32 m_Speed; // Current speed (in facing direction)
 		TInt32   m_HP;    // Current hit points for the tank
 		TInt32 ShootsFired = 0;
-		vector<TEntityUID> m_Target;
+		vector<TEntityUID> m_Target;      // Enemies in sight at the last think, plus any attacker asked for help with
 		CEntity* TankTarget;
 		CTankEntity* TargetTank;
 		CMatrix4x4 TurretWorldMatrix;
@@ -296,14 +332,22 @@ namespace gen
 		float Timer = 1.0f;
 		float DeathTimer = 1.0f;
 		float DeathTimer2 = 0;
-		int SavedEnemyIndex;
-		CVector3 RandomPos = CVector3(Random( -20, 20), 0.5, Random(-20, 20));
+		int SavedEnemyIndex;              // Target in m_Target to aim at
+		TEntityUID PickupUID = SystemUID; // Crate to collect in the Ammo/Health states
+		vector<CVector3> Path;            // Waypoints to the current destination
+		TUInt32 PathPointer = 0;          // Waypoint being driven to
+		CVector3 PathGoal;                // Destination the path was found for
+		bool HasPath = false;
+		CRandom m_Random;                 // This tank's own random numbers
+		CVector3 RandomPos;
 		bool AtTarget = false;
 		float Angle;
 		bool Fired = false;
 		bool Picked = false;
 		bool BeingFollowed = false;
 		bool Selected = true;
+		bool WasHit = false;              // Hit since the state last ran
+		TEntityUID LastHitBy = SystemUID; // Tank that fired the last shell to hit
 
 		// Tank state
 		TFloat32 m_Timer; // A timer used in the example update function
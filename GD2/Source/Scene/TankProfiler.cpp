@@ -0,0 +1,148 @@
+/*******************************************
+	TankProfiler.cpp
+
+	Per-state timing of tank behaviour
+********************************************/
+
+#include <cstring>
+
+#include "TankProfiler.h"
+
+namespace gen
+{
+
+// Profiler for the current thread's world, from Simulation.cpp
+extern thread_local CTankProfiler TankProfiler;
+
+
+// Names of the zones after the states, in ETankProfileZone order
+const char* const kPartZoneNames[NumTankZones - CTankEntity::NumStates] =
+{
+	"Messages",
+	"Targets",
+	"LineOfSight",
+	"AngleMath",
+	"RandomPos",
+	"Help",
+};
+
+
+/////////////////////////////////////
+// Constructors/Destructors
+
+CTankProfiler::CTankProfiler()
+{
+	memset( m_Counts, 0, sizeof(m_Counts) );
+	memset( m_Calls, 0, sizeof(m_Calls) );
+	memset( &m_Stats, 0, sizeof(m_Stats) );
+	memset( &m_Totals, 0, sizeof(m_Totals) );
+	m_NumFrames = 0;
+	m_StatsFile = 0;
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency( &frequency );
+	m_TickTime = 1.0f / static_cast<TFloat32>(frequency.QuadPart);
+}
+
+// Destructor closes any open stats file
+CTankProfiler::~CTankProfiler()
+{
+	CloseStatsFile();
+}
+
+
+/////////////////////////////////////
+// Counting
+
+// Complete the statistics for the frame just finished, write them to file if required and start
+// the next frame's. Call once per frame after all the tank behaviour
+void CTankProfiler::EndFrame()
+{
+	m_Stats.frame = m_NumFrames++;
+	m_Totals.frame = m_Stats.frame;
+	for (TUInt32 zone = 0; zone < NumTankZones; ++zone)
+	{
+		m_Stats.zones[zone].calls = m_Calls[zone];
+		m_Stats.zones[zone].time = m_Counts[zone] * m_TickTime;
+		m_Totals.zones[zone].calls += m_Stats.zones[zone].calls;
+		m_Totals.zones[zone].time += m_Stats.zones[zone].time;
+	}
+
+	if (m_StatsFile)
+	{
+		fprintf( m_StatsFile, "%u", m_Stats.frame );
+		for (TUInt32 zone = 0; zone < NumTankZones; ++zone)
+		{
+			fprintf( m_StatsFile, ",%u,%.1f", m_Stats.zones[zone].calls, m_Stats.zones[zone].time * 1000000.0f );
+		}
+		fprintf( m_StatsFile, "\n" );
+	}
+
+	// Start the next frame
+	memset( m_Counts, 0, sizeof(m_Counts) );
+	memset( m_Calls, 0, sizeof(m_Calls) );
+}
+
+
+/////////////////////////////////////
+// Statistics
+
+// Return the name of the given zone
+const char* CTankProfiler::GetZoneName( ETankProfileZone zone )
+{
+	if (zone < CTankEntity::NumStates)
+	{
+		return CTankEntity::GetStateName( static_cast<CTankEntity::EState>(zone) );
+	}
+	return kPartZoneNames[zone - CTankEntity::NumStates];
+}
+
+// Write the statistics for every frame to the given CSV file, one line per frame, until
+// CloseStatsFile is called. Returns false if the file could not be opened
+bool CTankProfiler::OpenStatsFile( const string& fileName )
+{
+	CloseStatsFile();
+	m_StatsFile = fopen( fileName.c_str(), "w" );
+	if (!m_StatsFile)
+	{
+		return false;
+	}
+
+	// Column headings, calls and microseconds for each zone
+	fprintf( m_StatsFile, "Frame" );
+	for (TUInt32 zone = 0; zone < NumTankZones; ++zone)
+	{
+		const char* name = GetZoneName( static_cast<ETankProfileZone>(zone) );
+		fprintf( m_StatsFile, ",%sCalls,%sUs", name, name );
+	}
+	fprintf( m_StatsFile, "\n" );
+	return true;
+}
+
+// Stop writing statistics to file
+void CTankProfiler::CloseStatsFile()
+{
+	if (m_StatsFile)
+	{
+		fclose( m_StatsFile );
+		m_StatsFile = 0;
+	}
+}
+
+
+/////////////////////////////////////
+// Scoped counter
+
+CTankProfileScope::CTankProfileScope( ETankProfileZone zone )
+{
+	m_Zone = zone;
+	m_Start = CTankProfiler::GetCounter();
+}
+
+CTankProfileScope::~CTankProfileScope()
+{
+	TankProfiler.AddCall( m_Zone, m_Start );
+}
+
+
+} // namespace gen
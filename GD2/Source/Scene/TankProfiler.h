@@ -0,0 +1,173 @@
+/*******************************************
+TankProfiler.h
+
+Per-state timing of tank behaviour
+********************************************/
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+using namespace std;
+
+#include <windows.h>
+
+#include "Defines.h"
+#include "TankEntity.h"
+
+namespace gen
+{
+
+	// Zones of tank behaviour timed by the tank profiler. Zones below NumStates are the tank
+	// states (CTankEntity::EState), timed around each state's handler. The zones after them are
+	// parts of the behaviour, timed wherever they run - a part's time is also included in the
+	// time of the zone it ran inside
+	enum ETankProfileZone
+	{
+		TankZone_Messages = CTankEntity::NumStates, // Message processing in CTankEntity::Update
+		TankZone_Targets,                           // UpdateTankTargets - gathering the enemy list
+		TankZone_LineOfSight,                       // Line of sight and visibility queries
+		TankZone_AngleMath,                         // Turret to target angle
+		TankZone_RandomPos,                         // Choosing an evade position (RandomPosChecker)
+		TankZone_Help,                              // Help broadcasts to the team
+
+		NumTankZones // Not a zone - the number of zones above
+	};
+
+	// Time and calls for one zone over a frame
+	struct STankZoneStats
+	{
+		TUInt32  calls;
+		TFloat32 time; // Seconds
+	};
+
+	// Tank profiler statistics for one frame
+	struct STankProfileStats
+	{
+		TUInt32        frame; // Frame number, counted by EndFrame
+		STankZoneStats zones[NumTankZones];
+	};
+
+
+	// Tank profiler. Tank behaviour is wrapped in scoped counters (CTankProfileScope) that add the
+	// time and a call to a zone. Counting is always on - a scope costs two reads of the
+	// performance counter. At the end of each frame the counts are turned into the frame's
+	// statistics, which can also be written to a CSV file, and added to totals for the whole run
+	class CTankProfiler
+	{
+		/////////////////////////////////////
+		//	Constructors/Destructors
+	public:
+		CTankProfiler();
+
+		// Destructor closes any open stats file
+		~CTankProfiler();
+
+	private:
+		// Disallow use of copy constructor and assignment operator (private and not defined)
+		CTankProfiler(const CTankProfiler&);
+		CTankProfiler& operator=(const CTankProfiler&);
+
+
+		/////////////////////////////////////
+		//	Public interface
+	public:
+
+		/////////////////////////////////////
+		// Counting
+
+		// Return the current performance counter, to pass to AddCall at the end of the timed code
+		static TInt64 GetCounter()
+		{
+			LARGE_INTEGER counter;
+			QueryPerformanceCounter(&counter);
+			return counter.QuadPart;
+		}
+
+		// Add a call to the given zone that started at the given performance counter
+		void AddCall(ETankProfileZone zone, TInt64 start)
+		{
+			m_Counts[zone] += GetCounter() - start;
+			++m_Calls[zone];
+		}
+
+		// Complete the statistics for the frame just finished, write them to file if required and
+		// start the next frame's. Call once per frame after all the tank behaviour
+		void EndFrame();
+
+
+		/////////////////////////////////////
+		// Statistics
+
+		// Return the name of the given zone
+		static const char* GetZoneName(ETankProfileZone zone);
+
+		// Get the statistics for the last complete frame
+		const STankProfileStats& GetStats()
+		{
+			return m_Stats;
+		}
+
+		// Get the statistics summed over all complete frames, and the number of frames
+		const STankProfileStats& GetTotals()
+		{
+			return m_Totals;
+		}
+		TUInt32 GetNumFrames()
+		{
+			return m_NumFrames;
+		}
+
+		// Write the statistics for every frame to the given CSV file, one line per frame, until
+		// CloseStatsFile is called. Returns false if the file could not be opened
+		bool OpenStatsFile(const string& fileName);
+
+		// Stop writing statistics to file
+		void CloseStatsFile();
+
+		bool IsWritingStats()
+		{
+			return m_StatsFile != 0;
+		}
+
+
+		/////////////////////////////////////
+		//	Private interface
+	private:
+
+		// Performance counter ticks and calls for each zone in the frame in progress
+		TInt64  m_Counts[NumTankZones];
+		TUInt32 m_Calls[NumTankZones];
+
+		// Seconds per performance counter tick
+		TFloat32 m_TickTime;
+
+		// Statistics for the last complete frame and all complete frames
+		STankProfileStats m_Stats;
+		STankProfileStats m_Totals;
+		TUInt32           m_NumFrames;
+
+		FILE* m_StatsFile;
+	};
+
+
+	// Times a zone from construction to the end of the scope, e.g.
+	//     CTankProfileScope profile(TankZone_Targets);
+	class CTankProfileScope
+	{
+	public:
+		CTankProfileScope(ETankProfileZone zone);
+
+		~CTankProfileScope();
+
+	private:
+		// Disallow use of copy constructor and assignment operator (private and not defined)
+		CTankProfileScope(const CTankProfileScope&);
+		CTankProfileScope& operator=(const CTankProfileScope&);
+
+		ETankProfileZone m_Zone;
+		TInt64           m_Start;
+	};
+
+
+} // namespace gen
@@ -0,0 +1,58 @@
+/*******************************************
+	TankStateMachine.cpp
+
+	Per-state batched tank behaviour
+********************************************/
+
+#include "TankStateMachine.h"
+#include "EntityManager.h"
+
+namespace gen
+{
+
+// Entity manager holding the tanks
+extern thread_local CEntityManager EntityManager;
+
+
+// Run the state behaviour for all tanks, passing the time since the last update. Call once per
+// frame after the entity updates and before the steering pass
+void CTankStateMachine::Update( TFloat32 updateTime )
+{
+	// Bucket the tanks by state. The enumeration must be finished before the handlers run as they
+	// enumerate entities themselves
+	for (TUInt32 state = 0; state < CTankEntity::NumStates; ++state)
+	{
+		m_Buckets[state].clear();
+	}
+	EntityManager.BeginEnumEntities( "", "", "Tank" );
+	CEntity* entity = EntityManager.EnumEntity();
+	while (entity != 0)
+	{
+		CTankEntity* tank = static_cast<CTankEntity*>(entity);
+		m_Buckets[tank->m_State].push_back( tank );
+		entity = EntityManager.EnumEntity();
+	}
+	EntityManager.EndEnumEntities();
+
+	// Run each state's handler over its bucket
+	m_Destroyed.clear();
+	for (TUInt32 state = 0; state < CTankEntity::NumStates; ++state)
+	{
+		vector<CTankEntity*>& bucket = m_Buckets[state];
+		for (TUInt32 tank = 0; tank < bucket.size(); ++tank)
+		{
+			if (!bucket[tank]->UpdateState( updateTime ))
+			{
+				m_Destroyed.push_back( bucket[tank]->GetUID() );
+			}
+		}
+	}
+
+	for (TUInt32 tank = 0; tank < m_Destroyed.size(); ++tank)
+	{
+		EntityManager.DestroyEntity( m_Destroyed[tank] );
+	}
+}
+
+
+} // namespace gen
@@ -0,0 +1,68 @@
+/*******************************************
+TankStateMachine.h
+
+Per-state batched tank behaviour
+********************************************/
+
+#pragma once
+
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "Entity.h"
+#include "TankEntity.h"
+
+namespace gen
+{
+
+	// Tank state machine. Tanks only process their messages in their own update, which moves them
+	// between states through the tank's transition table. After all entity updates this pass
+	// sorts the tanks into a bucket for each state and runs each state's handler over its whole
+	// bucket, so the same behaviour code runs for many tanks in a row. A tank runs the handler for
+	// the state it was in at the start of the pass, any state change it makes takes effect next
+	// update. Tanks whose handler asks for them to be destroyed are destroyed after the pass
+	class CTankStateMachine
+	{
+		/////////////////////////////////////
+		//	Constructors/Destructors
+	public:
+		// Default constructor
+		CTankStateMachine() {}
+
+		// No destructor needed
+
+	private:
+		// Disallow use of copy constructor and assignment operator (private and not defined)
+		CTankStateMachine(const CTankStateMachine&);
+		CTankStateMachine& operator=(const CTankStateMachine&);
+
+
+		/////////////////////////////////////
+		//	Public interface
+	public:
+
+		// Run the state behaviour for all tanks, passing the time since the last update. Call once
+		// per frame after the entity updates and before the steering pass
+		void Update(TFloat32 updateTime);
+
+		// Return the number of tanks that were in the given state in the last update
+		TUInt32 GetNumInState(CTankEntity::EState state)
+		{
+			return static_cast<TUInt32>(m_Buckets[state].size());
+		}
+
+
+		/////////////////////////////////////
+		//	Private interface
+	private:
+
+		// Tanks in each state this update
+		vector<CTankEntity*> m_Buckets[CTankEntity::NumStates];
+
+		// Tanks to destroy once all the handlers have run
+		vector<TEntityUID> m_Destroyed;
+	};
+
+
+} // namespace gen
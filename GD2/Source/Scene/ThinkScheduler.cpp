@@ -0,0 +1,150 @@
+/*******************************************
+	ThinkScheduler.cpp
+
+	Time-sliced AI decision making
+********************************************/
+
+#include "ThinkScheduler.h"
+
+namespace gen
+{
+
+// An entity put off by the budget thinks anyway once it is this many think intervals overdue
+const TFloat32 kMaxDelay = 2.0f;
+
+// Entities that haven't asked to think for this many frames are forgotten
+const TUInt32 kForgetFrames = 60;
+
+
+// Constructor takes the thinking time budget per frame in seconds
+CThinkScheduler::CThinkScheduler( TFloat32 budget /*= 0.0005f*/ )
+{
+	m_Budget = budget;
+	m_ThinkLimit = kUnlimitedThinks;
+	m_UseThinkLimit = false;
+	m_BudgetThinks = kUnlimitedThinks;
+	SetDistances( 100.0f, 300.0f );
+	m_Time = 0.0f;
+	m_Frame = 0;
+	m_CurrentStats.thinks = m_CurrentStats.deferred = 0;
+	m_CurrentStats.thinkTime = 0.0f;
+	m_CurrentStats.overrun = false;
+	m_Stats = m_CurrentStats;
+	m_NumOverruns = 0;
+}
+
+
+// Set the number of thinks per second for entities in the given state. A frequency of zero means
+// entities in that state never think
+void CThinkScheduler::SetStateFrequency( TUInt32 state, TFloat32 frequency )
+{
+	if (state >= m_StateFrequencies.size())
+	{
+		m_StateFrequencies.resize( state + 1, 0.0f );
+	}
+	m_StateFrequencies[state] = frequency;
+}
+
+
+// Start a new frame. Pass the time since the last update and the point (e.g. the camera position)
+// that entities near to think more often
+void CThinkScheduler::Update( TFloat32 updateTime, const CVector3& focus )
+{
+	// Finish the last frame's statistics
+	m_CurrentStats.overrun = (m_CurrentStats.thinkTime > m_Budget);
+	if (m_CurrentStats.overrun)
+	{
+		++m_NumOverruns;
+	}
+	m_Stats = m_CurrentStats;
+	m_CurrentStats.thinks = m_CurrentStats.deferred = 0;
+	m_CurrentStats.thinkTime = 0.0f;
+	m_CurrentStats.overrun = false;
+	m_BudgetThinks = kUnlimitedThinks;
+
+	// Forget entities that have stopped asking (e.g. destroyed)
+	TThinkersIter thinker = m_Thinkers.begin();
+	while (thinker != m_Thinkers.end())
+	{
+		if (m_Frame - thinker->second.lastSeen > kForgetFrames)
+		{
+			m_Thinkers.erase( thinker++ );
+		}
+		else
+		{
+			++thinker;
+		}
+	}
+
+	++m_Frame;
+	m_Time += updateTime;
+	m_Focus = focus;
+}
+
+// Return true if the entity in the given state and position should think now. If true, call
+// EndThink when the thinking is done so its time is counted
+bool CThinkScheduler::ShouldThink( TEntityUID uid, TUInt32 state, const CVector3& position )
+{
+	TFloat32 frequency = (state < m_StateFrequencies.size()) ? m_StateFrequencies[state] : 0.0f;
+	if (frequency <= 0.0f)
+	{
+		return false;
+	}
+
+	// Think less often further from the focus
+	TFloat32 distanceSq = DistanceSquared( position, m_Focus );
+	if (distanceSq > m_QuarterDistanceSq)
+	{
+		frequency *= 0.25f;
+	}
+	else if (distanceSq > m_HalfDistanceSq)
+	{
+		frequency *= 0.5f;
+	}
+	TFloat32 interval = 1.0f / frequency;
+
+	TThinkersIter found = m_Thinkers.find( uid );
+	if (found == m_Thinkers.end())
+	{
+		// New entities think straight away
+		SThinker newThinker = { m_Time - interval, m_Frame };
+		found = m_Thinkers.insert( TThinkers::value_type( uid, newThinker ) ).first;
+	}
+	SThinker& thinker = found->second;
+	thinker.lastSeen = m_Frame;
+
+	TFloat32 sinceThink = m_Time - thinker.lastThink;
+	if (sinceThink < interval)
+	{
+		return false;
+	}
+	bool budgetUsed = m_UseThinkLimit ? (m_CurrentStats.thinks >= m_ThinkLimit)
+	                                  : (m_CurrentStats.thinkTime >= m_Budget);
+	if (budgetUsed)
+	{
+		// Note how many thinks there had been, the frame can be repeated with that limit
+		if (m_BudgetThinks == kUnlimitedThinks)
+		{
+			m_BudgetThinks = m_CurrentStats.thinks;
+		}
+		if (sinceThink < interval * kMaxDelay)
+		{
+			++m_CurrentStats.deferred;
+			return false;
+		}
+	}
+
+	thinker.lastThink = m_Time;
+	++m_CurrentStats.thinks;
+	m_Timer.GetLapTime(); // Start timing the think
+	return true;
+}
+
+// Call after thinking to add the time taken to the frame's total
+void CThinkScheduler::EndThink()
+{
+	m_CurrentStats.thinkTime += m_Timer.GetLapTime();
+}
+
+
+} // namespace gen
@@ -0,0 +1,172 @@
+/*******************************************
+ThinkScheduler.h
+
+Time-sliced AI decision making
+********************************************/
+
+#pragma once
+
+#include <vector>
+#include <map>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "CTimer.h"
+#include "Entity.h"
+
+namespace gen
+{
+
+	// Statistics for one frame of the think scheduler
+	struct SThinkStats
+	{
+		TUInt32  thinks;    // Number of entities that thought
+		TUInt32  deferred;  // Number of thinks put off to a later frame as the budget was used up
+		TFloat32 thinkTime; // Time spent thinking (seconds)
+		bool     overrun;   // True if the think time went over the budget
+	};
+
+
+	// Think scheduler. Entities call ShouldThink before their expensive decisions (e.g. choosing
+	// a target) and only make them when it returns true, while cheap per-tick work such as
+	// movement carries on every update. Each entity thinks at a frequency set by its state, reduced
+	// with distance from a focus point (the camera). Time spent thinking is measured and once the
+	// frame's budget is used up further thinks are put off to later frames, unless an entity is
+	// badly overdue. As the entities that have just thought are not due again for a while, those
+	// put off get their turn next, so thinking is spread round-robin across frames
+	class CThinkScheduler
+	{
+	public:
+		// Think limit meaning any number of thinks
+		static const TUInt32 kUnlimitedThinks = 0xffffffff;
+
+		/////////////////////////////////////
+		//	Constructors/Destructors
+	public:
+		// Constructor takes the thinking time budget per frame in seconds
+		CThinkScheduler(TFloat32 budget = 0.0005f);
+
+		// No destructor needed
+
+	private:
+		// Disallow use of copy constructor and assignment operator (private and not defined)
+		CThinkScheduler(const CThinkScheduler&);
+		CThinkScheduler& operator=(const CThinkScheduler&);
+
+
+		/////////////////////////////////////
+		//	Public interface
+	public:
+
+		/////////////////////////////////////
+		// Settings
+
+		// Set the thinking time budget per frame in seconds
+		void SetBudget(TFloat32 budget)
+		{
+			m_Budget = budget;
+		}
+
+		// Use a fixed number of thinks per frame in place of the time budget, e.g. to repeat a
+		// recorded frame exactly, until UseTimeBudget is called. Overdue entities still think
+		// once the limit is reached, as they do once the budget is used up
+		void SetThinkLimit(TUInt32 thinks)
+		{
+			m_ThinkLimit = thinks;
+			m_UseThinkLimit = true;
+		}
+		void UseTimeBudget()
+		{
+			m_UseThinkLimit = false;
+		}
+
+		// Set the number of thinks per second for entities in the given state. A frequency of
+		// zero means entities in that state never think
+		void SetStateFrequency(TUInt32 state, TFloat32 frequency);
+
+		// Set the distances from the focus point at which think frequency is halved and quartered
+		void SetDistances(TFloat32 halfDistance, TFloat32 quarterDistance)
+		{
+			m_HalfDistanceSq = halfDistance * halfDistance;
+			m_QuarterDistanceSq = quarterDistance * quarterDistance;
+		}
+
+
+		/////////////////////////////////////
+		// Scheduling
+
+		// Start a new frame. Pass the time since the last update and the point (e.g. the camera
+		// position) that entities near to think more often
+		void Update(TFloat32 updateTime, const CVector3& focus);
+
+		// Return true if the entity in the given state and position should think now. If true,
+		// call EndThink when the thinking is done so its time is counted
+		bool ShouldThink(TEntityUID uid, TUInt32 state, const CVector3& position);
+
+		// Call after thinking to add the time taken to the frame's total
+		void EndThink();
+
+
+		/////////////////////////////////////
+		// Statistics
+
+		// Get the statistics for the last complete frame
+		const SThinkStats& GetStats()
+		{
+			return m_Stats;
+		}
+
+		// Get the number of thinks after which the current frame's budget (or think limit) stopped
+		// further thinks, or kUnlimitedThinks if it hasn't. Passing this to SetThinkLimit for the
+		// same frame gives the same thinks, however long they take
+		TUInt32 GetBudgetThinks()
+		{
+			return m_BudgetThinks;
+		}
+
+		// Get the number of frames that went over budget since the scheduler was created
+		TUInt32 GetNumOverruns()
+		{
+			return m_NumOverruns;
+		}
+
+
+		/////////////////////////////////////
+		//	Private interface
+	private:
+
+		// Scheduling data for one entity
+		struct SThinker
+		{
+			TFloat32 lastThink; // Scheduler time of the last think
+			TUInt32  lastSeen;  // Last frame the entity asked to think, unused entries are removed
+		};
+		typedef map<TEntityUID, SThinker> TThinkers;
+		typedef TThinkers::iterator TThinkersIter;
+
+		TThinkers m_Thinkers;
+
+		// Thinks per second for each state
+		vector<TFloat32> m_StateFrequencies;
+
+		TFloat32 m_Budget;
+		TUInt32  m_ThinkLimit;
+		bool     m_UseThinkLimit;
+		TUInt32  m_BudgetThinks; // Thinks this frame when the budget first stopped one
+		TFloat32 m_HalfDistanceSq;
+		TFloat32 m_QuarterDistanceSq;
+
+		CVector3 m_Focus;
+		TFloat32 m_Time;
+		TUInt32  m_Frame;
+
+		// Statistics for the frame in progress and the last complete frame
+		SThinkStats m_CurrentStats;
+		SThinkStats m_Stats;
+		TUInt32     m_NumOverruns;
+		CTimer      m_Timer;
+	};
+
+
+} // namespace gen
@@ -0,0 +1,518 @@
+/*******************************************
+	Simulation.cpp
+
+	Battle simulation shared by the game and
+	the headless battle simulator
+********************************************/
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "CTimer.h"
+#include "CRandom.h"
+#include "EntityManager.h"
+#include "Messenger.h"
+#include "LineOfSight.h"
+#include "Perception.h"
+#include "ProjectileCollision.h"
+#include "Steering.h"
+#include "NavGrid.h"
+#include "FlowField.h"
+#include "ThinkScheduler.h"
+#include "TankStateMachine.h"
+#include "TankProfiler.h"
+#include "ParseLevel.h"
+#include "Replay.h"
+#include "Simulation.h"
+
+namespace gen
+{
+	//-----------------------------------------------------------------------------
+	// Global world variables
+	//-----------------------------------------------------------------------------
+
+	// The world variables here and in the scene modules are thread_local so every thread has a
+	// world of its own. The game uses the main thread's world, the battle runner runs each battle
+	// on a new thread and so gets a newly constructed world for each
+
+	// Messenger class for sending messages to and between entities. Other threads reach a world's
+	// messenger through GetWorldMessenger
+	thread_local CMessenger Messenger;
+
+	// Random number streams in a world, all from the world's seed. Each user has a stream of its own
+	// so adding random calls in one place doesn't change the numbers anywhere else. The entity
+	// streams follow the fixed ones, numbered by UID
+	enum ERandomStream
+	{
+		RandomStream_Level,   // Scattering entities while the level loads
+		RandomStream_Crates,  // Crate drop positions
+		RandomStream_Entities // First entity stream
+	};
+	thread_local TUInt32 WorldSeed;
+	thread_local CRandom LevelRandom;
+	thread_local CRandom CrateRandom;
+
+	// Entity manager
+	thread_local CEntityManager EntityManager;
+	thread_local CParseLevel LevelParser(&EntityManager, &LevelRandom);
+
+	// Line of sight tests against the buildings
+	thread_local CLineOfSight LineOfSight;
+
+	// Tank visibility, worked out once per frame before the entity updates
+	thread_local CPerception Perception;
+
+	// Tank state behaviour, run for all the tanks in each state together after the entity updates
+	thread_local CTankStateMachine TankStateMachine;
+
+	// Time spent in each tank state and parts of the tank behaviour
+	thread_local CTankProfiler TankProfiler;
+
+	// Tank movement, worked out for all tanks together after the entity updates
+	thread_local CSteering Steering;
+
+	// Navigation grid over the play area with paths around the buildings and trees
+	thread_local CNavGrid NavGrid;
+
+	// Flow fields towards the crates and patrol points, built on the navigation grid
+	thread_local CFlowFields FlowFields;
+
+	// Spreads the tanks' target selection over frames within a time budget
+	thread_local CThinkScheduler ThinkScheduler;
+
+	// Shell against tank collisions, tested once per frame after the entity updates
+	thread_local CProjectileCollision ProjectileCollision;
+
+	// Tanks in the level, and the patrol routes for each team that follow the quads
+	thread_local vector<TEntityUID> TanksUIDs;
+	thread_local vector<CTankEntity*> TankEntities;
+	thread_local vector<TEntityUID> QuadPatrolUIDs; // Tanks whose patrol routes follow the quads
+	thread_local vector<CVector3> TeamOnePatrolList;
+	thread_local vector<CVector3> TeamTwoPatrolList;
+
+	// Time until the next crates are dropped
+	thread_local float AmmoTimer = 20.0f;
+	thread_local float HealthTimer = 30.0f;
+
+	// Tank UIDs
+	thread_local TEntityUID TankA;
+	thread_local TEntityUID TankB;
+
+	// Times each phase of a step when phase times are requested
+	thread_local CTimer PhaseTimer;
+
+	// Player commands waiting for the next step, and those carried out in the current step
+	thread_local vector<SSimCommand> PendingCommands;
+	thread_local vector<SSimCommand> StepCommands;
+
+	// Records each step if set
+	thread_local CReplayRecorder* Recorder = 0;
+
+	// Names of the phases, in ESimPhase order
+	const char* SimPhaseNames[NumSimPhases] =
+	{
+		"Messages", "Perception", "Navigation", "Think", "Entities", "States", "Steering", "Collision", "Level"
+	};
+
+
+	//-----------------------------------------------------------------------------
+	// Helper functions
+	//-----------------------------------------------------------------------------
+
+	// Get UID of tank A (team 0) or B (team 1)
+	TEntityUID GetTankUID(int team)
+	{
+		return (team == 0) ? TankA : TankB;
+	}
+
+	// Return a random number generator for the entity with the given UID, independent of those of
+	// other entities and the rest of the world
+	CRandom GetEntityRandom(TEntityUID uid)
+	{
+		return CRandom(WorldSeed, RandomStream_Entities + static_cast<TUInt64>(uid));
+	}
+
+	// Return the name of the given phase
+	const char* GetSimPhaseName(ESimPhase phase)
+	{
+		return SimPhaseNames[phase];
+	}
+
+	// Get the area on the XZ plane the battle is fought over - everything placed in the level apart
+	// from the floor and sky, and the tanks' patrol routes, with a margin for tanks evading and
+	// steering round the edge. Crates are dropped around the origin, so it is always included
+	void GetPlayArea(CVector3& areaMin, CVector3& areaMax)
+	{
+		const TFloat32 kPlayAreaMargin = 50.0f;
+		areaMin = areaMax = CVector3::kOrigin;
+		EntityManager.BeginEnumEntities("", "");
+		CEntity* entity = EntityManager.EnumEntity();
+		while (entity != 0)
+		{
+			const string& templateName = entity->Template()->GetName();
+			if (templateName != "Floor" && templateName != "Skybox")
+			{
+				vector<CVector3> points(1, entity->Position());
+				if (entity->Template()->GetType() == "Tank")
+				{
+					vector<CVector3> patrolList = static_cast<CTankEntity*>(entity)->GetPatrolList();
+					points.insert(points.end(), patrolList.begin(), patrolList.end());
+				}
+				for (TUInt32 point = 0; point < points.size(); ++point)
+				{
+					areaMin = CVector3(Min(areaMin.x, points[point].x), 0.0f, Min(areaMin.z, points[point].z));
+					areaMax = CVector3(Max(areaMax.x, points[point].x), 0.0f, Max(areaMax.z, points[point].z));
+				}
+			}
+			entity = EntityManager.EnumEntity();
+		}
+		EntityManager.EndEnumEntities();
+		areaMin -= CVector3(kPlayAreaMargin, 0.0f, kPlayAreaMargin);
+		areaMax += CVector3(kPlayAreaMargin, 0.0f, kPlayAreaMargin);
+	}
+
+	// Add the time since the last phase ended to the given phase, if timing
+	void EndPhase(SSimPhaseTimes* phaseTimes, ESimPhase phase)
+	{
+		if (phaseTimes)
+		{
+			phaseTimes->time[phase] += PhaseTimer.GetLapTime();
+		}
+	}
+
+	// Carry out a player command
+	void RunCommand(const SSimCommand& command)
+	{
+		if (command.type == Command_Start)
+		{
+			SendToAllTanks(Msg_Start);
+		}
+		else if (command.type == Command_Stop)
+		{
+			SendToAllTanks(Msg_Stop);
+		}
+		else if (command.type == Command_Evade)
+		{
+			CTankEntity* tank = static_cast<CTankEntity*>(EntityManager.GetEntity(command.uid));
+			if (tank != 0)
+			{
+				tank->m_State = CTankEntity::Evade;
+				tank->SetTargetPos(command.position);
+			}
+		}
+		else if (command.type == Command_Move)
+		{
+			CEntity* entity = EntityManager.GetEntity(command.uid);
+			if (entity != 0)
+			{
+				entity->Position() = command.position;
+
+				// Moving a building changes what it hides and where tanks can drive
+				LineOfSight.OccluderMoved(command.uid);
+				NavGrid.ObstacleMoved(command.uid);
+			}
+		}
+	}
+
+	// Set the patrol route of the tanks on the given team that follow the quads to the four quads
+	// starting with the given name
+	void SyncPatrolList(const string& quadName, TUInt32 team, vector<CVector3>& patrolList)
+	{
+		/* Runs through all the Scenery */
+		EntityManager.BeginEnumEntities("", "", "Scenery");
+		CEntity* entity = EntityManager.EnumEntity();
+		while (entity != 0)
+		{
+			/* If the entity is a quad it will update the position*/
+			if (entity->GetName() == quadName)
+			{
+				CEntity* EntityArray[4];
+				for (int i = 0; i < 4; i++)
+				{
+					EntityArray[i] = entity;
+					entity = EntityManager.EnumEntity();
+				}
+				/* Runs through the tanks following the quads so it get set there patrol points to the quads. Looked up
+				   by UID as destroyed tanks are still in the list */
+				for (int j = 0; j < QuadPatrolUIDs.size(); j++)
+				{
+					CTankEntity* tank = static_cast<CTankEntity*>(EntityManager.GetEntity(QuadPatrolUIDs[j]));
+					if (tank != 0 && tank->GetTeam() == team)
+					{
+						for (int i = 0; i < patrolList.size(); i++)
+						{
+							patrolList[i] = EntityArray[i]->Position();
+						}
+						tank->SetPatrolList(patrolList);
+					}
+				}
+			}
+			else
+			{
+				entity = EntityManager.EnumEntity();
+			}
+		}
+		EntityManager.EndEnumEntities();
+	}
+
+
+	//-----------------------------------------------------------------------------
+	// World setup
+	//-----------------------------------------------------------------------------
+
+	// Load the level and prepare the line of sight, navigation and think scheduler data for it.
+	// Anything the meshes need to load (e.g. render methods) must already be set up. All the
+	// world's random numbers come from the given seed. Returns false if the level file could not
+	// be loaded
+	bool SimulationSetup(const string& levelFile, TUInt32 seed /*= 1*/)
+	{
+		WorldSeed = seed;
+		LevelRandom.Seed(seed, RandomStream_Level);
+		CrateRandom.Seed(seed, RandomStream_Crates);
+
+		if (!LevelParser.ParseFile(levelFile))
+		{
+			return false;
+		}
+
+		// Buildings block line of sight
+		LineOfSight.BuildOccluders("Building");
+
+		// Bake the navigation grid over the play area with cells small enough for the clearance to
+		// matter, keeping tanks this far from scenery
+		CVector3 areaMin, areaMax;
+		GetPlayArea(areaMin, areaMax);
+		NavGrid.Create(areaMin, areaMax, 2.0f);
+		NavGrid.AddObstacles("Building", 3.0f);
+		NavGrid.AddObstacles("Tree", 3.0f);
+
+		// How often tanks in each state look for targets. Inactive tanks don't
+		ThinkScheduler.SetStateFrequency(CTankEntity::Inactive, 0.0f);
+		ThinkScheduler.SetStateFrequency(CTankEntity::Patrol, 10.0f);
+
+		// List the tanks. Those placed in the level follow the quads and take each team's patrol route
+		// from its first tank, generated tanks keep their own routes
+		const vector<TEntityUID>& generatedTanks = LevelParser.GetGeneratedTanks();
+		bool Team1Added = false;
+		bool Team0Added = false;
+		EntityManager.BeginEnumEntities("", "", "Tank");
+		CEntity* entity = EntityManager.EnumEntity();
+		while (entity != 0)
+		{
+			CTankEntity* tank = static_cast<CTankEntity*>(entity);
+			TanksUIDs.push_back(tank->GetUID());
+			TankEntities.push_back(tank);
+			if (binary_search(generatedTanks.begin(), generatedTanks.end(), tank->GetUID()))
+			{
+				entity = EntityManager.EnumEntity();
+				continue;
+			}
+			QuadPatrolUIDs.push_back(tank->GetUID());
+			if (tank->GetTeam() == 0)
+			{
+				if (!Team0Added)
+				{
+					TeamOnePatrolList = tank->GetPatrolList();
+					Team0Added = true;
+				}
+			}
+			else if (tank->GetTeam() == 1)
+			{
+				if (!Team1Added)
+				{
+					TeamTwoPatrolList = tank->GetPatrolList();
+					Team1Added = true;
+				}
+			}
+			entity = EntityManager.EnumEntity();
+		}
+		EntityManager.EndEnumEntities();
+
+		return true;
+	}
+
+	// Destroy all entities and templates
+	void SimulationShutdown()
+	{
+		PendingCommands.clear();
+		TanksUIDs.clear();
+		TankEntities.clear();
+		QuadPatrolUIDs.clear();
+		EntityManager.DestroyAllEntities();
+		EntityManager.DestroyAllTemplates();
+	}
+
+	// Return the calling thread's world messenger. The global Messenger is thread_local, so a thread
+	// helping with a world's step must be handed this pointer by the world's thread and send through
+	// it - sending to its own Messenger would go to a different (empty) world
+	CMessenger* GetWorldMessenger()
+	{
+		return &Messenger;
+	}
+
+
+	//-----------------------------------------------------------------------------
+	// Simulation
+	//-----------------------------------------------------------------------------
+
+	// Advance the battle one step, passing the time step and the point (e.g. the camera position)
+	// that tanks near to think more often. If phase times are passed, the time spent in each phase
+	// is added to them
+	void SimulationStep(TFloat32 updateTime, const CVector3& focus, SSimPhaseTimes* phaseTimes /*= 0*/)
+	{
+		if (phaseTimes)
+		{
+			PhaseTimer.GetLapTime();
+		}
+
+		// Carry out the player's commands since the last step
+		StepCommands.swap(PendingCommands);
+		PendingCommands.clear();
+		for (TUInt32 command = 0; command < StepCommands.size(); ++command)
+		{
+			RunCommand(StepCommands[command]);
+		}
+
+		// Advance the messenger clock, delivering any timed messages now due
+		Messenger.Update(updateTime);
+		EndPhase(phaseTimes, Phase_Messages);
+
+		// Work out which tanks can see each other this frame
+		Perception.Update(updateTime);
+		EndPhase(phaseTimes, Phase_Perception);
+
+		// New frame's path search budget, then extend the flow fields still being built
+		NavGrid.Update();
+		FlowFields.Update();
+		EndPhase(phaseTimes, Phase_Navigation);
+
+		// Start the think scheduler's frame, tanks nearer the focus think more often
+		ThinkScheduler.Update(updateTime, focus);
+		EndPhase(phaseTimes, Phase_Think);
+
+		// Call all entity update functions
+		EntityManager.UpdateAllEntities(updateTime);
+		EndPhase(phaseTimes, Phase_Entities);
+
+		// Run the tanks' state behaviour, state by state, then finish the frame's tank profile
+		TankStateMachine.Update(updateTime);
+		TankProfiler.EndFrame();
+		EndPhase(phaseTimes, Phase_States);
+
+		// Turn and move the tanks that are driving somewhere
+		Steering.Update(updateTime);
+		EndPhase(phaseTimes, Phase_Steering);
+
+		// Find the shells that have hit a tank this frame
+		ProjectileCollision.Update();
+		EndPhase(phaseTimes, Phase_Collision);
+
+		// Patrol routes follow the quads, which can be moved about
+		SyncPatrolList("Quad", 0, TeamOnePatrolList);
+		SyncPatrolList("Quad2", 1, TeamTwoPatrolList);
+
+		/* This will spawn an ammo create after a set amount of time */
+		if (AmmoTimer < 0)
+		{
+			EntityManager.CreateAmmoCreate("AmmoCreate.01", "", CVector3(CrateRandom.Random(-20, 20), 10.0f, CrateRandom.Random(-20, 20)), { 0,0,0 }, { 0.2,0.2,0.2 });
+			AmmoTimer = 20.0f;
+		}
+		else
+		{
+			AmmoTimer -= updateTime;
+		}
+		/* This will spawn an health create after a set amount of time */
+		if (HealthTimer < 0)
+		{
+			EntityManager.CreateHealthCreate("HealthCreate.01", "", CVector3(CrateRandom.Random(-20, 20), 10.0f, CrateRandom.Random(-20, 20)), { 0,0,0 }, { 0.2,0.2,0.2 });
+			HealthTimer = 30.0f;
+		}
+		else
+		{
+			HealthTimer -= updateTime;
+		}
+		EndPhase(phaseTimes, Phase_Level);
+
+		if (Recorder)
+		{
+			Recorder->RecordStep(updateTime, focus, ThinkScheduler.GetBudgetThinks(), StepCommands);
+		}
+	}
+
+	// Send a system message of the given type (e.g. Msg_Start) to all tanks
+	void SendToAllTanks(EMessageType type)
+	{
+		SMessage msg;
+		msg.type = type;
+		msg.from = SystemUID;
+		EntityManager.BeginEnumEntities("", "", "Tank");
+		CEntity* entity = EntityManager.EnumEntity();
+		while (entity != 0)
+		{
+			Messenger.SendMessage(entity->GetUID(), msg);
+			entity = EntityManager.EnumEntity();
+		}
+		EntityManager.EndEnumEntities();
+	}
+
+	// Queue a player command to be carried out at the start of the next step. A move replaces any
+	// move of the same entity already queued
+	void SimulationCommand(const SSimCommand& command)
+	{
+		if (command.type == Command_Move)
+		{
+			for (TUInt32 pending = 0; pending < PendingCommands.size(); ++pending)
+			{
+				if (PendingCommands[pending].type == Command_Move && PendingCommands[pending].uid == command.uid)
+				{
+					PendingCommands[pending].position = command.position;
+					return;
+				}
+			}
+		}
+		PendingCommands.push_back(command);
+	}
+
+	// Return a checksum of the world state - entity positions and tank HP and states. Two runs of
+	// the same battle should have the same checksum after the same steps. FNV-1a hash
+	TUInt32 SimulationChecksum()
+	{
+		TUInt32 hash = 2166136261u;
+		EntityManager.BeginEnumEntities("", "");
+		CEntity* entity = EntityManager.EnumEntity();
+		while (entity != 0)
+		{
+			TUInt32 values[6];
+			values[0] = entity->GetUID();
+			memcpy(&values[1], &entity->Position(), 3 * sizeof(TUInt32));
+			values[4] = values[5] = 0;
+			if (entity->Template()->GetType() == "Tank")
+			{
+				CTankEntity* tank = static_cast<CTankEntity*>(entity);
+				values[4] = tank->GetHP();
+				values[5] = tank->m_State;
+			}
+
+			const TUInt8* bytes = reinterpret_cast<const TUInt8*>(values);
+			for (TUInt32 byte = 0; byte < sizeof(values); ++byte)
+			{
+				hash = (hash ^ bytes[byte]) * 16777619u;
+			}
+			entity = EntityManager.EnumEntity();
+		}
+		EntityManager.EndEnumEntities();
+		return hash;
+	}
+
+	// Record every step from now on with the given recorder, or stop recording if it is null
+	void SimulationRecord(CReplayRecorder* recorder)
+	{
+		Recorder = recorder;
+	}
+
+
+} // namespace gen
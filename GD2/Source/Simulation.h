@@ -0,0 +1,116 @@
+/*******************************************
+	Simulation.h
+
+	Battle simulation shared by the game and
+	the headless battle simulator
+********************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Defines.h"
+#include "CVector3.h"
+#include "Messenger.h"
+
+namespace gen
+{
+
+class CReplayRecorder;
+
+///////////////////////////////
+// Simulation phases
+
+// The stages of one simulation step, in the order they run
+enum ESimPhase
+{
+	Phase_Messages,   // Messenger clock
+	Phase_Perception, // Tank visibility
+	Phase_Navigation, // Path searches and flow fields
+	Phase_Think,      // Think scheduler frame start
+	Phase_Entities,   // Entity updates (message processing, shells, crates)
+	Phase_States,     // Tank state behaviour
+	Phase_Steering,   // Tank movement
+	Phase_Collision,  // Shell hits
+	Phase_Level,      // Patrol routes and crate spawning
+
+	NumSimPhases // Not a phase - the number of phases above
+};
+
+// Time spent in each phase in seconds, added to over every step it is passed to
+struct SSimPhaseTimes
+{
+	TFloat32 time[NumSimPhases];
+};
+
+// Return the name of the given phase
+const char* GetSimPhaseName( ESimPhase phase );
+
+
+///////////////////////////////
+// Player commands
+
+// Things the player does to the battle. They are queued and carried out at the start of the next
+// step, so the steps can be recorded and replayed exactly
+enum ESimCommandType
+{
+	Command_Start, // Send all tanks the start message
+	Command_Stop,  // Send all tanks the stop message
+	Command_Evade, // Send a tank to the given position in the evade state
+	Command_Move,  // Move an entity (e.g. a building or crate) to the given position
+
+	NumSimCommandTypes // Not a command - the number of commands above
+};
+
+struct SSimCommand
+{
+	ESimCommandType type;
+	TEntityUID      uid;      // Entity for evade and move
+	CVector3        position; // Position for evade and move
+};
+
+
+///////////////////////////////
+// World setup
+
+// Load the level and prepare the line of sight, navigation and think scheduler data for it.
+// Anything the meshes need to load (e.g. render methods) must already be set up. All the world's
+// random numbers come from the given seed, a world with the same seed runs the same on any thread.
+// Returns false if the level file could not be loaded
+bool SimulationSetup( const string& levelFile, TUInt32 seed = 1 );
+
+// Destroy all entities and templates
+void SimulationShutdown();
+
+// Return the calling thread's world messenger. The global Messenger is thread_local, so a thread
+// helping with a world's step must be handed this pointer by the world's thread and send through
+// it - sending to its own Messenger would go to a different (empty) world
+CMessenger* GetWorldMessenger();
+
+
+///////////////////////////////
+// Simulation
+
+// Advance the battle one step, passing the time step and the point (e.g. the camera position)
+// that tanks near to think more often. If phase times are passed, the time spent in each phase
+// is added to them
+void SimulationStep( TFloat32 updateTime, const CVector3& focus, SSimPhaseTimes* phaseTimes = 0 );
+
+// Send a system message of the given type (e.g. Msg_Start) to all tanks
+void SendToAllTanks( EMessageType type );
+
+// Queue a player command to be carried out at the start of the next step. A move replaces any
+// move of the same entity already queued
+void SimulationCommand( const SSimCommand& command );
+
+// Return a checksum of the world state - entity positions and tank HP and states. Two runs of the
+// same battle should have the same checksum after the same steps
+TUInt32 SimulationChecksum();
+
+// Record every step from now on with the given recorder, or stop recording if it is null
+void SimulationRecord( CReplayRecorder* recorder );
+
+
+} // namespace gen
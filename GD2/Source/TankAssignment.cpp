@@ -17,20 +17,21 @@ using namespace std;
 #include "Light.h"
 #include "EntityManager.h"
 #include "Messenger.h"
-#include "ParseLevel.h"
+#include "LineOfSight.h"
+#include "Perception.h"
+#include "NavGrid.h"
+#include "FlowField.h"
+#include "ThinkScheduler.h"
+#include "TankProfiler.h"
+#include "Simulation.h"
+#include "Replay.h"
 #include "TankAssignment.h"
 
 namespace gen
 {
-	vector<TEntityUID> TanksUIDs;
-	vector<CTankEntity*> TankEntities;
 	CTankEntity* SelectedTank;
-	vector<CVector3> TeamOnePatrolList;
-	vector<CVector3> TeamTwoPatrolList;
 	CVector3 TankPoses[6];
 	int NumTanks = 6;
-	float AmmoTimer = 20.0f;
-	float HealthTimer = 30.0f;
 	bool SelectedTankBool = false;
 	int SavedIndex = 0;
 	//-----------------------------------------------------------------------------
@@ -45,6 +46,12 @@ namespace gen
 	// Amount of time to pass before calculating new average update time
 	const float UpdateTimePeriod = 1.0f;
 
+	// Level and seed for the battle, and the file each battle is recorded to for replaying in the
+	// battle simulator
+	const string LevelFile = "Entities.xml";
+	const TUInt32 LevelSeed = 1;
+	const string ReplayFile = "LastBattle.rec";
+
 
 	//-----------------------------------------------------------------------------
 	// Global system variables
@@ -67,23 +74,25 @@ namespace gen
 	extern TUInt32 MouseY;
 	extern CVector2 MousePixel;
 
-	extern TEntityUID GetTankUID(int Team);
-
 	// Messenger class for sending messages to and between entities
-	extern CMessenger Messenger;
+	extern thread_local CMessenger Messenger;
 
 
 	//-----------------------------------------------------------------------------
 	// Global game/scene variables
 	//-----------------------------------------------------------------------------
 
-	// Entity manager
-	CEntityManager EntityManager;
-	CParseLevel LevelParser(&EntityManager);
+	// World shared with the battle simulation, see Simulation.cpp
+	extern thread_local CEntityManager EntityManager;
+	extern thread_local CLineOfSight LineOfSight;
+	extern thread_local CPerception Perception;
+	extern thread_local CNavGrid NavGrid;
+	extern thread_local CFlowFields FlowFields;
+	extern thread_local CThinkScheduler ThinkScheduler;
+	extern thread_local CTankProfiler TankProfiler;
+	extern thread_local vector<TEntityUID> TanksUIDs;
+	extern thread_local vector<CTankEntity*> TankEntities;
 
-	// Tank UIDs
-	TEntityUID TankA;
-	TEntityUID TankB;
 	int Counter = 0;
 
 	// Other scene elements
@@ -98,6 +107,9 @@ namespace gen
 	int NumUpdateTimes = 0;
 	float AverageUpdateTime = -1.0f; // Invalid value at first
 
+	// Records the battle's steps and player commands
+	CReplayRecorder Recorder;
+
 
 	//-----------------------------------------------------------------------------
 	// Scene management
@@ -110,41 +122,18 @@ namespace gen
 		// Prepare render methods
 
 		InitialiseMethods();
-		LevelParser.ParseFile("Entities.xml");
 
-		////////////////////////////////
-		// Create tank entities
-		// Type (template name), team number, tank name, position, rotation
-		bool Team1Added = false;
-		bool Team0Added = false;
-		EntityManager.BeginEnumEntities("", "", "Tank");
-		CEntity* entity = EntityManager.EnumEntity();
-		while (entity != 0)
+		// Load the level and prepare the battle simulation for it
+		if (!SimulationSetup(LevelFile, LevelSeed))
 		{
-			TEntityUID UID = entity->GetUID();
-			TanksUIDs.push_back(UID);
-			TankEntities.push_back(static_cast<CTankEntity*>(entity));
-			if (TankEntities.at(Counter)->GetTeam() == 0)
-			{
-				if (!Team0Added)
-				{
-					TeamOnePatrolList = TankEntities.at(Counter)->GetPatrolList();
-					Team0Added = true;
-				}
-			}
-			else if (TankEntities.at(Counter)->GetTeam() == 1)
-			{
-				if (!Team1Added)
-				{
-					TeamTwoPatrolList = TankEntities.at(Counter)->GetPatrolList();
-					Team1Added = true;
-				}
-			}
-			entity = EntityManager.EnumEntity();
-			++Counter;
+			return false;
+		}
+
+		// Record the battle, carry on without a recording if the file can't be written
+		if (Recorder.Open(ReplayFile, LevelFile, LevelSeed))
+		{
+			SimulationRecord(&Recorder);
 		}
-		EntityManager.EndEnumEntities();
-		Counter = 0;
 
 		/////////////////////////////
 		// Camera / light setup
@@ -179,20 +168,12 @@ namespace gen
 		// Release camera
 		delete MainCamera;
 
-		// Destroy all entities
-		EntityManager.DestroyAllEntities();
-		EntityManager.DestroyAllTemplates();
-	}
-
-
-	//-----------------------------------------------------------------------------
-	// Game Helper functions
-	//-----------------------------------------------------------------------------
+		// Finish the recording while the world is still there for the final keyframe
+		SimulationRecord(0);
+		Recorder.Close();
 
-	// Get UID of tank A (team 0) or B (team 1)
-	TEntityUID GetTankUID(int team)
-	{
-		return (team == 0) ? TankA : TankB;
+		// Destroy all entities
+		SimulationShutdown();
 	}
 
 
@@ -200,8 +181,9 @@ namespace gen
 	// Game loop functions
 	//-----------------------------------------------------------------------------
 
-	// Draw one frame of the scene
-	void RenderScene(float updateTime)
+	// Draw one frame of the scene, entities interpolated the fraction alpha (0 to 1) of the way from
+	// the previous update to the current one
+	void RenderScene(float updateTime, float alpha)
 	{
 		// Setup the viewport - defines which part of the back-buffer we will render to (usually all of it)
 		D3D10_VIEWPORT vp;
@@ -230,7 +212,7 @@ namespace gen
 		SetLights(&Lights[0]);
 
 		// Render entities and draw on-screen text
-		EntityManager.RenderAllEntities();
+		EntityManager.RenderAllEntities(alpha);
 		RenderSceneText(updateTime);
 
 		// Present the backbuffer contents to the display
@@ -281,10 +263,43 @@ namespace gen
 			outText.str("");
 			outText << "Start: " << "Key_1" << endl << "Stop: " << "Key_2" << endl << "Chase Camera: " << "Key_3" << endl << "Chase Camera Exit: " << "Key_4" << endl
 					<< "Mouse_RButton: " << " Pick Up Objects" << endl << "Mouse_LButton: " << "Click on Tank then a space in world to make" << endl 
-					<<" it move there (Puts into Evade State)";
+					<<" it move there (Puts into Evade State)" << endl << "Message Stats CSV: " << "Key_F5" << endl << "Tank Profile CSV: " << "Key_F6";
 			RenderText(outText.str(), 2, 30, 0.0f, 0.0f, 0.0f);
 			RenderText(outText.str(), 0, 28, 1.0f, 1.0f, 0.0f);
 			outText.str("");
+
+			// Messenger statistics for the last frame
+			const SMessengerStats& messageStats = Messenger.GetStats();
+			TUInt32 messagesSent = 0;
+			TUInt32 messagesFetched = 0;
+			for (int type = 0; type < NumMessageTypes; ++type)
+			{
+				messagesSent += messageStats.sent[type];
+				messagesFetched += messageStats.fetched[type];
+			}
+			outText << "Messages Sent: " << messagesSent << " Fetched: " << messagesFetched << " Waiting: " << messageStats.backlog
+					<< (Messenger.IsWritingStats() ? " (Writing CSV)" : "") << endl
+					<< "Sight Cache Hits: " << static_cast<int>(Perception.GetFrameCacheHitRate() * 100.0f) << "%" << endl
+					<< "Paths Searched: " << NavGrid.GetSearches() << " Cached: " << NavGrid.GetCacheHits()
+					<< " Searches/ms: " << NavGrid.GetSearchesPerMs() << endl
+					<< "Flow Fields: " << FlowFields.GetNumFields() << " Cells Built: " << FlowFields.GetFrameCells() << endl
+					<< "Tanks Thought: " << ThinkScheduler.GetStats().thinks << " Deferred: " << ThinkScheduler.GetStats().deferred
+					<< " Over Budget: " << ThinkScheduler.GetNumOverruns();
+			RenderText(outText.str(), 2, 124, 0.0f, 0.0f, 0.0f);
+			RenderText(outText.str(), 0, 122, 1.0f, 1.0f, 0.0f);
+			outText.str("");
+
+			// Tank behaviour time by state and part for the last frame
+			const STankProfileStats& profileStats = TankProfiler.GetStats();
+			outText << "Tank AI (calls, us)" << (TankProfiler.IsWritingStats() ? " (Writing CSV)" : "");
+			for (int zone = 0; zone < NumTankZones; ++zone)
+			{
+				outText << endl << CTankProfiler::GetZoneName(static_cast<ETankProfileZone>(zone)) << ": "
+						<< profileStats.zones[zone].calls << ", " << static_cast<int>(profileStats.zones[zone].time * 1000000.0f);
+			}
+			RenderText(outText.str(), 2, 202, 0.0f, 0.0f, 0.0f);
+			RenderText(outText.str(), 0, 200, 1.0f, 1.0f, 0.0f);
+			outText.str("");
 		}
 		// Write FPS text string
 		RenderText(outText.str(), 0, 0, 1.0f, 1.0f, 0.0f);
@@ -406,8 +421,8 @@ namespace gen
 					CVector3 MousePointer = MainCamera->WorldPtFromPixel(MousePixel, ViewportWidth, ViewportHeight);
 					CVector3 RayCast = Normalise(MousePointer - MainCamera->Position());
 					CVector3 NewPos = MainCamera->Position() + ((-MainCamera->Position().y / RayCast.y) * RayCast);
-					SelectedTank->m_State = SelectedTank->Evade;
-					SelectedTank->SetTargetPos(NewPos);
+					SSimCommand command = { Command_Evade, SelectedTank->GetUID(), NewPos };
+					SimulationCommand(command);
 					SelectedTank = NULL;
 					SelectedTankBool = false;
 				}
@@ -445,9 +460,8 @@ namespace gen
 				CVector3 RayCast = Normalise(MousePointer - MainCamera->Position());
 				CVector3 NewPos = MainCamera->Position() + ((-MainCamera->Position().y / RayCast.y) * RayCast);
 				//CVector3 CameraPos = MainCamera->Position() + RayCast * 100;
-				NearestEntity->Position().x = NewPos.x;
-				NearestEntity->Position().y = NewPos.y;
-				NearestEntity->Position().z = NewPos.z;
+				SSimCommand command = { Command_Move, NearestEntity->GetUID(), NewPos };
+				SimulationCommand(command);
 			}
 		}
 		/* This allows the ammoCreate to be picked up */
@@ -477,9 +491,8 @@ namespace gen
 				CVector3 RayCast = Normalise(MousePointer - MainCamera->Position());
 				CVector3 NewPos = MainCamera->Position() + ((-MainCamera->Position().y / RayCast.y) * RayCast);
 				//CVector3 CameraPos = MainCamera->Position() + RayCast * 100;
-				NearestEntity->Position().x = NewPos.x;
-				NearestEntity->Position().y = NewPos.y;
-				NearestEntity->Position().z = NewPos.z;
+				SSimCommand command = { Command_Move, NearestEntity->GetUID(), NewPos };
+				SimulationCommand(command);
 			}
 		}
 		/* This allows the HealthCreate to be picked up */
@@ -509,116 +522,73 @@ namespace gen
 				CVector3 RayCast = Normalise(MousePointer - MainCamera->Position());
 				CVector3 NewPos = MainCamera->Position() + ((-MainCamera->Position().y / RayCast.y) * RayCast);
 				//CVector3 CameraPos = MainCamera->Position() + RayCast * 100;
-				NearestEntity->Position().x = NewPos.x;
-				NearestEntity->Position().y = NewPos.y;
-				NearestEntity->Position().z = NewPos.z;
+				SSimCommand command = { Command_Move, NearestEntity->GetUID(), NewPos };
+				SimulationCommand(command);
 			}
 		}
 	}
 
 
-	// Update the scene between rendering
+	// Update the scene between rendering, called in fixed steps
 	void UpdateScene(float updateTime)
 	{
-		// Call all entity update functions
-		EntityManager.UpdateAllEntities(updateTime);
-
-		// Set camera speeds
-		// Key F1 used for full screen toggle
-		if (KeyHit(Key_F2)) CameraMoveSpeed = 5.0f;
-		if (KeyHit(Key_F3)) CameraMoveSpeed = 40.0f;
+		// Advance the battle, tanks nearer the camera think more often
+		SimulationStep(updateTime, MainCamera->Position());
 
-		// System messages
-		// Go
-
-		/* Runs through all the Scenery */
-		EntityManager.BeginEnumEntities("", "", "Scenery");
-		CEntity* entity = EntityManager.EnumEntity();
-		while (entity != 0)
+		// Toggle writing messenger statistics to file
+		if (KeyHit(Key_F5))
 		{
-			/* If the entity is a quad it will update the position*/
-			if (entity->GetName() == "Quad")
+			if (Messenger.IsWritingStats())
 			{
-				CEntity* EntityArray[4];
-				for (int i = 0; i < 4; i++)
-				{
-					EntityArray[i] = entity;
-					entity = EntityManager.EnumEntity();
-				}
-				/* Runs through all the tanks so it get set there patrol points to the quads */
-				for (int j = 0; j < TankEntities.size(); j++)
-				{
-					if (TankEntities.at(j)->GetTeam() == 0)
-					{
-						for (int i = 0; i < TeamOnePatrolList.size(); i++)
-						{
-							TeamOnePatrolList[i] = EntityArray[i]->Position();
-						}
-						TankEntities.at(j)->SetPatrolList(TeamOnePatrolList);
-					}
-				}
-
+				Messenger.CloseStatsFile();
 			}
 			else
 			{
-				entity = EntityManager.EnumEntity();
+				Messenger.OpenStatsFile("MessengerStats.csv");
 			}
 		}
-		EntityManager.EndEnumEntities();
 
-		/* Runs through all the Scenery */
-		EntityManager.BeginEnumEntities("", "", "Scenery");
-		entity = EntityManager.EnumEntity();
-		while (entity != 0)
+		// Toggle writing tank profile statistics to file
+		if (KeyHit(Key_F6))
 		{
-			/* If the entity is a quad it will update the position*/
-			if (entity->GetName() == "Quad2")
+			if (TankProfiler.IsWritingStats())
 			{
-				CEntity* EntityArray[4];
-				for (int i = 0; i < 4; i++)
-				{
-					EntityArray[i] = entity;
-					entity = EntityManager.EnumEntity();
-				}
-				/* Runs through all the tanks so it get set there patrol points to the quads */
-				for (int j = 0; j < TankEntities.size(); j++)
-				{
-					if (TankEntities.at(j)->GetTeam() == 1)
-					{
-						for (int i = 0; i < TeamTwoPatrolList.size(); i++)
-						{
-							TeamTwoPatrolList[i] = EntityArray[i]->Position();
-						}
-						TankEntities.at(j)->SetPatrolList(TeamTwoPatrolList);
-					}
-
-				}
+				TankProfiler.CloseStatsFile();
 			}
 			else
 			{
-				entity = EntityManager.EnumEntity();
+				TankProfiler.OpenStatsFile("TankProfile.csv");
 			}
 		}
-		EntityManager.EndEnumEntities();
 
+		// System messages
+		// Go
 		/* When 1 is pressed it will send a message to all the tanks to start */
 		if (KeyHit(Key_1))
 		{
-			SMessage msg;
-			EntityManager.BeginEnumEntities("", "", "Tank");
-			CEntity* entity = EntityManager.EnumEntity();
-			while (entity != 0)
-			{
-				TEntityUID UID = entity->GetUID();
-				//TanksUIDs[i] = UID;
-				msg.type = Msg_Start;
-				msg.from = SystemUID;
-				Messenger.SendMessage(UID, msg);
-				entity = EntityManager.EnumEntity();
-			}
-			EntityManager.EndEnumEntities();
+			SSimCommand command = { Command_Start, 0, CVector3::kOrigin };
+			SimulationCommand(command);
 		}
 
+		// Stop
+		/* When 2 is pressed it will send a message to all the tanks telling them to stop */
+		if (KeyHit(Key_2))
+		{
+			SSimCommand command = { Command_Stop, 0, CVector3::kOrigin };
+			SimulationCommand(command);
+		}
+	}
+
+
+	// Update the camera once per frame before rendering, pass the frame time and the interpolation
+	// fraction used for rendering
+	void UpdateCamera(float updateTime, float alpha)
+	{
+		// Set camera speeds
+		// Key F1 used for full screen toggle
+		if (KeyHit(Key_F2)) CameraMoveSpeed = 5.0f;
+		if (KeyHit(Key_F3)) CameraMoveSpeed = 40.0f;
+
 		/* This will allow the user to use the chase camera */
 		if (TanksUIDs.at(Counter) == TankEntities.at(Counter)->GetUID())
 		{
@@ -656,7 +626,7 @@ namespace gen
 		/* This will constantly update the camera so it can be behind the tank */
 		if (TankEntities.at(Counter)->GetFollowed() == true && TanksUIDs.at(Counter) == TankEntities.at(Counter)->GetUID())
 		{
-			MainCamera->Position() = TankEntities.at(Counter)->Position();
+			MainCamera->Position() = TankEntities.at(Counter)->InterpolatedPosition(alpha);
 			MainCamera->Position().y += 3.0f;
 			//MainCamera->Matrix().FaceTarget(TankEntities[Counter]->Position().kZAxis);
 		}
@@ -667,46 +637,6 @@ namespace gen
 			Counter = 0;
 		}
 
-		/* This will spawn an ammo create after a set amount of time */
-		if (AmmoTimer < 0)
-		{
-			EntityManager.CreateAmmoCreate("AmmoCreate.01", "", CVector3(Random(-20, 20), 10.0f, Random(-20, 20)), { 0,0,0 }, { 0.2,0.2,0.2 });
-			AmmoTimer = 20.0f;
-		}
-		else
-		{
-			AmmoTimer -= updateTime;
-		}
-		/* This will spawn an health create after a set amount of time */
-		if (HealthTimer < 0)
-		{
-			EntityManager.CreateHealthCreate("HealthCreate.01", "", CVector3(Random(-20, 20), 10.0f, Random(-20, 20)), { 0,0,0 }, { 0.2,0.2,0.2 });
-			HealthTimer = 30.0f;
-		}
-		else
-		{
-			HealthTimer -= updateTime;
-		}
-
-		// Stop
-		/* When 2 is pressed it will send a message to all the tanks telling them to stop */
-		if (KeyHit(Key_2))
-		{
-			SMessage msg;
-			EntityManager.BeginEnumEntities("", "", "Tank");
-			CEntity* entity = EntityManager.EnumEntity();
-			while (entity != 0)
-			{
-				TEntityUID UID = entity->GetUID();
-				//TanksUIDs[i] = UID;
-				msg.type = Msg_Stop;
-				msg.from = SystemUID;
-				Messenger.SendMessage(UID, msg);
-				entity = EntityManager.EnumEntity();
-			}
-			EntityManager.EndEnumEntities();
-		}
-
 		// Move the camera
 		MainCamera->Control(Key_Up, Key_Down, Key_Left, Key_Right, Key_W, Key_S, Key_A, Key_D,
 			CameraMoveSpeed * updateTime, CameraRotSpeed * updateTime);
@@ -21,13 +21,18 @@ void SceneShutdown();
 ///////////////////////////////
 // Game loop functions
 
-// Draw one frame of the scene
-void RenderScene( float updateTime );
+// Draw one frame of the scene, entities interpolated the fraction alpha (0 to 1) of the way from
+// the previous update to the current one
+void RenderScene( float updateTime, float alpha = 1.0f );
 
 // Render on-screen text each frame
 void RenderSceneText( float updateTime );
 
-// Update the scene between rendering
+// Update the scene between rendering, called in fixed steps
 void UpdateScene( float updateTime );
 
+// Update the camera once per frame before rendering, pass the frame time and the interpolation
+// fraction used for rendering
+void UpdateCamera( float updateTime, float alpha = 1.0f );
+
 } // namespace gen